@@ -10,22 +10,64 @@ Rcpp::Rostream<true>&  Rcpp::Rcout = Rcpp::Rcpp_cout_get();
 Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
+// arrow_export_impl
+Rcpp::NumericVector arrow_export_impl(std::vector<std::string> classes, std::string filename, std::vector<std::string> outfiles, int64_t start, int64_t end, Rcpp::CharacterVector filter_msg_type, Rcpp::IntegerVector filter_stock_locate, Rcpp::NumericVector min_timestamp, Rcpp::NumericVector max_timestamp, Rcpp::List filter_payload, int64_t batch_size, int64_t max_buffer_size, bool quiet, std::vector<std::string> columns, std::string index_file);
+RcppExport SEXP _RITCH_arrow_export_impl(SEXP classesSEXP, SEXP filenameSEXP, SEXP outfilesSEXP, SEXP startSEXP, SEXP endSEXP, SEXP filter_msg_typeSEXP, SEXP filter_stock_locateSEXP, SEXP min_timestampSEXP, SEXP max_timestampSEXP, SEXP filter_payloadSEXP, SEXP batch_sizeSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP, SEXP columnsSEXP, SEXP index_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type classes(classesSEXP);
+    Rcpp::traits::input_parameter< std::string >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type outfiles(outfilesSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type start(startSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type end(endSEXP);
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type filter_msg_type(filter_msg_typeSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type filter_stock_locate(filter_stock_locateSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type min_timestamp(min_timestampSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type max_timestamp(max_timestampSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type filter_payload(filter_payloadSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type batch_size(batch_sizeSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type max_buffer_size(max_buffer_sizeSEXP);
+    Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type columns(columnsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(arrow_export_impl(classes, filename, outfiles, start, end, filter_msg_type, filter_stock_locate, min_timestamp, max_timestamp, filter_payload, batch_size, max_buffer_size, quiet, columns, index_file));
+    return rcpp_result_gen;
+END_RCPP
+}
+// bars_impl
+Rcpp::List bars_impl(std::string filename, Rcpp::IntegerVector filter_stock_locate, int64_t interval, int64_t max_buffer_size, bool quiet, std::string index_file);
+RcppExport SEXP _RITCH_bars_impl(SEXP filenameSEXP, SEXP filter_stock_locateSEXP, SEXP intervalSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP, SEXP index_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type filter_stock_locate(filter_stock_locateSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type interval(intervalSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type max_buffer_size(max_buffer_sizeSEXP);
+    Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(bars_impl(filename, filter_stock_locate, interval, max_buffer_size, quiet, index_file));
+    return rcpp_result_gen;
+END_RCPP
+}
 // count_messages_impl
-Rcpp::DataFrame count_messages_impl(std::string filename, int64_t max_buffer_size, bool quiet);
-RcppExport SEXP _RITCH_count_messages_impl(SEXP filenameSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP) {
+Rcpp::DataFrame count_messages_impl(std::string filename, int64_t max_buffer_size, bool quiet, std::string index_file);
+RcppExport SEXP _RITCH_count_messages_impl(SEXP filenameSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP, SEXP index_fileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< std::string >::type filename(filenameSEXP);
     Rcpp::traits::input_parameter< int64_t >::type max_buffer_size(max_buffer_sizeSEXP);
     Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
-    rcpp_result_gen = Rcpp::wrap(count_messages_impl(filename, max_buffer_size, quiet));
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(count_messages_impl(filename, max_buffer_size, quiet, index_file));
     return rcpp_result_gen;
 END_RCPP
 }
 // filter_itch_impl
-void filter_itch_impl(std::string infile, std::string outfile, int64_t start, int64_t end, Rcpp::CharacterVector filter_msg_type, Rcpp::IntegerVector filter_stock_locate, Rcpp::NumericVector min_timestamp, Rcpp::NumericVector max_timestamp, bool append, int64_t max_buffer_size, bool quiet);
-RcppExport SEXP _RITCH_filter_itch_impl(SEXP infileSEXP, SEXP outfileSEXP, SEXP startSEXP, SEXP endSEXP, SEXP filter_msg_typeSEXP, SEXP filter_stock_locateSEXP, SEXP min_timestampSEXP, SEXP max_timestampSEXP, SEXP appendSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP) {
+void filter_itch_impl(std::string infile, std::string outfile, int64_t start, int64_t end, Rcpp::CharacterVector filter_msg_type, Rcpp::IntegerVector filter_stock_locate, Rcpp::NumericVector min_timestamp, Rcpp::NumericVector max_timestamp, Rcpp::List filter_payload, bool append, int64_t max_buffer_size, bool quiet, std::string index_file);
+RcppExport SEXP _RITCH_filter_itch_impl(SEXP infileSEXP, SEXP outfileSEXP, SEXP startSEXP, SEXP endSEXP, SEXP filter_msg_typeSEXP, SEXP filter_stock_locateSEXP, SEXP min_timestampSEXP, SEXP max_timestampSEXP, SEXP filter_payloadSEXP, SEXP appendSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP, SEXP index_fileSEXP) {
 BEGIN_RCPP
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< std::string >::type infile(infileSEXP);
@@ -36,10 +78,12 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type filter_stock_locate(filter_stock_locateSEXP);
     Rcpp::traits::input_parameter< Rcpp::NumericVector >::type min_timestamp(min_timestampSEXP);
     Rcpp::traits::input_parameter< Rcpp::NumericVector >::type max_timestamp(max_timestampSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type filter_payload(filter_payloadSEXP);
     Rcpp::traits::input_parameter< bool >::type append(appendSEXP);
     Rcpp::traits::input_parameter< int64_t >::type max_buffer_size(max_buffer_sizeSEXP);
     Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
-    filter_itch_impl(infile, outfile, start, end, filter_msg_type, filter_stock_locate, min_timestamp, max_timestamp, append, max_buffer_size, quiet);
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    filter_itch_impl(infile, outfile, start, end, filter_msg_type, filter_stock_locate, min_timestamp, max_timestamp, filter_payload, append, max_buffer_size, quiet, index_file);
     return R_NilValue;
 END_RCPP
 }
@@ -67,9 +111,141 @@ BEGIN_RCPP
     return R_NilValue;
 END_RCPP
 }
+// build_itch_index_impl
+int64_t build_itch_index_impl(std::string filename, std::string index_file, int64_t every, bool by_stock, int64_t max_buffer_size, bool quiet);
+RcppExport SEXP _RITCH_build_itch_index_impl(SEXP filenameSEXP, SEXP index_fileSEXP, SEXP everySEXP, SEXP by_stockSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type every(everySEXP);
+    Rcpp::traits::input_parameter< bool >::type by_stock(by_stockSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type max_buffer_size(max_buffer_sizeSEXP);
+    Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
+    rcpp_result_gen = Rcpp::wrap(build_itch_index_impl(filename, index_file, every, by_stock, max_buffer_size, quiet));
+    return rcpp_result_gen;
+END_RCPP
+}
+// read_itch_lazy_impl
+Rcpp::List read_itch_lazy_impl(std::vector<std::string> classes, std::string filename, int64_t start, int64_t end, Rcpp::CharacterVector filter_msg_type, Rcpp::IntegerVector filter_stock_locate, Rcpp::NumericVector min_timestamp, Rcpp::NumericVector max_timestamp, Rcpp::List filter_payload, int64_t max_buffer_size, bool quiet, std::vector<std::string> columns, std::string index_file);
+RcppExport SEXP _RITCH_read_itch_lazy_impl(SEXP classesSEXP, SEXP filenameSEXP, SEXP startSEXP, SEXP endSEXP, SEXP filter_msg_typeSEXP, SEXP filter_stock_locateSEXP, SEXP min_timestampSEXP, SEXP max_timestampSEXP, SEXP filter_payloadSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP, SEXP columnsSEXP, SEXP index_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type classes(classesSEXP);
+    Rcpp::traits::input_parameter< std::string >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type start(startSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type end(endSEXP);
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type filter_msg_type(filter_msg_typeSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type filter_stock_locate(filter_stock_locateSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type min_timestamp(min_timestampSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type max_timestamp(max_timestampSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type filter_payload(filter_payloadSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type max_buffer_size(max_buffer_sizeSEXP);
+    Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type columns(columnsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(read_itch_lazy_impl(classes, filename, start, end, filter_msg_type, filter_stock_locate, min_timestamp, max_timestamp, filter_payload, max_buffer_size, quiet, columns, index_file));
+    return rcpp_result_gen;
+END_RCPP
+}
+// order_lifetimes_impl
+Rcpp::List order_lifetimes_impl(std::string filename, Rcpp::IntegerVector filter_stock_locate, int64_t max_buffer_size, bool quiet, std::string index_file);
+RcppExport SEXP _RITCH_order_lifetimes_impl(SEXP filenameSEXP, SEXP filter_stock_locateSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP, SEXP index_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type filter_stock_locate(filter_stock_locateSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type max_buffer_size(max_buffer_sizeSEXP);
+    Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(order_lifetimes_impl(filename, filter_stock_locate, max_buffer_size, quiet, index_file));
+    return rcpp_result_gen;
+END_RCPP
+}
+// order_book_impl
+Rcpp::List order_book_impl(std::string filename, Rcpp::IntegerVector filter_stock_locate, Rcpp::NumericVector snapshots, int64_t n_levels, int64_t max_buffer_size, bool quiet, std::string index_file, std::string checkpoint_file);
+RcppExport SEXP _RITCH_order_book_impl(SEXP filenameSEXP, SEXP filter_stock_locateSEXP, SEXP snapshotsSEXP, SEXP n_levelsSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP, SEXP index_fileSEXP, SEXP checkpoint_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type filter_stock_locate(filter_stock_locateSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type snapshots(snapshotsSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type n_levels(n_levelsSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type max_buffer_size(max_buffer_sizeSEXP);
+    Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    Rcpp::traits::input_parameter< std::string >::type checkpoint_file(checkpoint_fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(order_book_impl(filename, filter_stock_locate, snapshots, n_levels, max_buffer_size, quiet, index_file, checkpoint_file));
+    return rcpp_result_gen;
+END_RCPP
+}
+// bbo_impl
+Rcpp::List bbo_impl(std::string filename, Rcpp::IntegerVector filter_stock_locate, int64_t interval, int64_t max_buffer_size, bool quiet, std::string index_file, std::string checkpoint_file);
+RcppExport SEXP _RITCH_bbo_impl(SEXP filenameSEXP, SEXP filter_stock_locateSEXP, SEXP intervalSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP, SEXP index_fileSEXP, SEXP checkpoint_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type filter_stock_locate(filter_stock_locateSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type interval(intervalSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type max_buffer_size(max_buffer_sizeSEXP);
+    Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    Rcpp::traits::input_parameter< std::string >::type checkpoint_file(checkpoint_fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(bbo_impl(filename, filter_stock_locate, interval, max_buffer_size, quiet, index_file, checkpoint_file));
+    return rcpp_result_gen;
+END_RCPP
+}
+// write_order_checkpoint_impl
+int64_t write_order_checkpoint_impl(std::string filename, std::string checkpoint_file, Rcpp::IntegerVector filter_stock_locate, Rcpp::NumericVector timestamp, int64_t max_buffer_size, bool quiet, std::string index_file);
+RcppExport SEXP _RITCH_write_order_checkpoint_impl(SEXP filenameSEXP, SEXP checkpoint_fileSEXP, SEXP filter_stock_locateSEXP, SEXP timestampSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP, SEXP index_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< std::string >::type checkpoint_file(checkpoint_fileSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type filter_stock_locate(filter_stock_locateSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type timestamp(timestampSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type max_buffer_size(max_buffer_sizeSEXP);
+    Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(write_order_checkpoint_impl(filename, checkpoint_file, filter_stock_locate, timestamp, max_buffer_size, quiet, index_file));
+    return rcpp_result_gen;
+END_RCPP
+}
+// read_itch_chunked_impl
+Rcpp::List read_itch_chunked_impl(std::vector<std::string> classes, std::string filename, int64_t start, int64_t end, Rcpp::CharacterVector filter_msg_type, Rcpp::IntegerVector filter_stock_locate, Rcpp::NumericVector min_timestamp, Rcpp::NumericVector max_timestamp, Rcpp::List filter_payload, Rcpp::Function callback, int64_t chunk_size, int64_t chunk_bytes, int64_t max_buffer_size, bool quiet, std::vector<std::string> columns, std::string index_file);
+RcppExport SEXP _RITCH_read_itch_chunked_impl(SEXP classesSEXP, SEXP filenameSEXP, SEXP startSEXP, SEXP endSEXP, SEXP filter_msg_typeSEXP, SEXP filter_stock_locateSEXP, SEXP min_timestampSEXP, SEXP max_timestampSEXP, SEXP filter_payloadSEXP, SEXP callbackSEXP, SEXP chunk_sizeSEXP, SEXP chunk_bytesSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP, SEXP columnsSEXP, SEXP index_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type classes(classesSEXP);
+    Rcpp::traits::input_parameter< std::string >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type start(startSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type end(endSEXP);
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type filter_msg_type(filter_msg_typeSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type filter_stock_locate(filter_stock_locateSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type min_timestamp(min_timestampSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type max_timestamp(max_timestampSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type filter_payload(filter_payloadSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Function >::type callback(callbackSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type chunk_size(chunk_sizeSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type chunk_bytes(chunk_bytesSEXP);
+    Rcpp::traits::input_parameter< int64_t >::type max_buffer_size(max_buffer_sizeSEXP);
+    Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type columns(columnsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(read_itch_chunked_impl(classes, filename, start, end, filter_msg_type, filter_stock_locate, min_timestamp, max_timestamp, filter_payload, callback, chunk_size, chunk_bytes, max_buffer_size, quiet, columns, index_file));
+    return rcpp_result_gen;
+END_RCPP
+}
 // read_itch_impl
-Rcpp::List read_itch_impl(std::vector<std::string> classes, std::string filename, int64_t start, int64_t end, Rcpp::CharacterVector filter_msg_type, Rcpp::IntegerVector filter_stock_locate, Rcpp::NumericVector min_timestamp, Rcpp::NumericVector max_timestamp, int64_t max_buffer_size, bool quiet);
-RcppExport SEXP _RITCH_read_itch_impl(SEXP classesSEXP, SEXP filenameSEXP, SEXP startSEXP, SEXP endSEXP, SEXP filter_msg_typeSEXP, SEXP filter_stock_locateSEXP, SEXP min_timestampSEXP, SEXP max_timestampSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP) {
+Rcpp::List read_itch_impl(std::vector<std::string> classes, std::string filename, int64_t start, int64_t end, Rcpp::CharacterVector filter_msg_type, Rcpp::IntegerVector filter_stock_locate, Rcpp::NumericVector min_timestamp, Rcpp::NumericVector max_timestamp, Rcpp::List filter_payload, int64_t max_buffer_size, bool quiet, int n_threads, std::vector<std::string> columns, std::string index_file);
+RcppExport SEXP _RITCH_read_itch_impl(SEXP classesSEXP, SEXP filenameSEXP, SEXP startSEXP, SEXP endSEXP, SEXP filter_msg_typeSEXP, SEXP filter_stock_locateSEXP, SEXP min_timestampSEXP, SEXP max_timestampSEXP, SEXP filter_payloadSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP, SEXP n_threadsSEXP, SEXP columnsSEXP, SEXP index_fileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -81,15 +257,19 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type filter_stock_locate(filter_stock_locateSEXP);
     Rcpp::traits::input_parameter< Rcpp::NumericVector >::type min_timestamp(min_timestampSEXP);
     Rcpp::traits::input_parameter< Rcpp::NumericVector >::type max_timestamp(max_timestampSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type filter_payload(filter_payloadSEXP);
     Rcpp::traits::input_parameter< int64_t >::type max_buffer_size(max_buffer_sizeSEXP);
     Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
-    rcpp_result_gen = Rcpp::wrap(read_itch_impl(classes, filename, start, end, filter_msg_type, filter_stock_locate, min_timestamp, max_timestamp, max_buffer_size, quiet));
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type columns(columnsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(read_itch_impl(classes, filename, start, end, filter_msg_type, filter_stock_locate, min_timestamp, max_timestamp, filter_payload, max_buffer_size, quiet, n_threads, columns, index_file));
     return rcpp_result_gen;
 END_RCPP
 }
 // write_itch_impl
-int64_t write_itch_impl(Rcpp::List ll, std::string filename, bool append, bool gz, size_t max_buffer_size, bool quiet);
-RcppExport SEXP _RITCH_write_itch_impl(SEXP llSEXP, SEXP filenameSEXP, SEXP appendSEXP, SEXP gzSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP) {
+int64_t write_itch_impl(Rcpp::List ll, std::string filename, bool append, bool gz, size_t max_buffer_size, bool quiet, int n_threads, int compression_level, bool background);
+RcppExport SEXP _RITCH_write_itch_impl(SEXP llSEXP, SEXP filenameSEXP, SEXP appendSEXP, SEXP gzSEXP, SEXP max_buffer_sizeSEXP, SEXP quietSEXP, SEXP n_threadsSEXP, SEXP compression_levelSEXP, SEXP backgroundSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -99,22 +279,37 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< bool >::type gz(gzSEXP);
     Rcpp::traits::input_parameter< size_t >::type max_buffer_size(max_buffer_sizeSEXP);
     Rcpp::traits::input_parameter< bool >::type quiet(quietSEXP);
-    rcpp_result_gen = Rcpp::wrap(write_itch_impl(ll, filename, append, gz, max_buffer_size, quiet));
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type compression_level(compression_levelSEXP);
+    Rcpp::traits::input_parameter< bool >::type background(backgroundSEXP);
+    rcpp_result_gen = Rcpp::wrap(write_itch_impl(ll, filename, append, gz, max_buffer_size, quiet, n_threads, compression_level, background));
     return rcpp_result_gen;
 END_RCPP
 }
 
+void init_lazy_columns(DllInfo* dll);
+
 static const R_CallMethodDef CallEntries[] = {
-    {"_RITCH_count_messages_impl", (DL_FUNC) &_RITCH_count_messages_impl, 3},
-    {"_RITCH_filter_itch_impl", (DL_FUNC) &_RITCH_filter_itch_impl, 11},
+    {"_RITCH_arrow_export_impl", (DL_FUNC) &_RITCH_arrow_export_impl, 15},
+    {"_RITCH_bars_impl", (DL_FUNC) &_RITCH_bars_impl, 6},
+    {"_RITCH_count_messages_impl", (DL_FUNC) &_RITCH_count_messages_impl, 4},
+    {"_RITCH_filter_itch_impl", (DL_FUNC) &_RITCH_filter_itch_impl, 13},
     {"_RITCH_gunzip_file_impl", (DL_FUNC) &_RITCH_gunzip_file_impl, 3},
     {"_RITCH_gzip_file_impl", (DL_FUNC) &_RITCH_gzip_file_impl, 3},
-    {"_RITCH_read_itch_impl", (DL_FUNC) &_RITCH_read_itch_impl, 10},
-    {"_RITCH_write_itch_impl", (DL_FUNC) &_RITCH_write_itch_impl, 6},
+    {"_RITCH_build_itch_index_impl", (DL_FUNC) &_RITCH_build_itch_index_impl, 6},
+    {"_RITCH_read_itch_lazy_impl", (DL_FUNC) &_RITCH_read_itch_lazy_impl, 13},
+    {"_RITCH_order_lifetimes_impl", (DL_FUNC) &_RITCH_order_lifetimes_impl, 5},
+    {"_RITCH_order_book_impl", (DL_FUNC) &_RITCH_order_book_impl, 8},
+    {"_RITCH_bbo_impl", (DL_FUNC) &_RITCH_bbo_impl, 7},
+    {"_RITCH_write_order_checkpoint_impl", (DL_FUNC) &_RITCH_write_order_checkpoint_impl, 7},
+    {"_RITCH_read_itch_chunked_impl", (DL_FUNC) &_RITCH_read_itch_chunked_impl, 16},
+    {"_RITCH_read_itch_impl", (DL_FUNC) &_RITCH_read_itch_impl, 14},
+    {"_RITCH_write_itch_impl", (DL_FUNC) &_RITCH_write_itch_impl, 9},
     {NULL, NULL, 0}
 };
 
 RcppExport void R_init_RITCH(DllInfo *dll) {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    init_lazy_columns(dll);
 }
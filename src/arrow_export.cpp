@@ -0,0 +1,158 @@
+#include "arrow_export.h"
+
+// [[Rcpp::export]]
+Rcpp::NumericVector arrow_export_impl(std::vector<std::string> classes,
+                                      std::string filename,
+                                      std::vector<std::string> outfiles,
+                                      int64_t start, int64_t end,
+                                      Rcpp::CharacterVector filter_msg_type,
+                                      Rcpp::IntegerVector filter_stock_locate,
+                                      Rcpp::NumericVector min_timestamp,
+                                      Rcpp::NumericVector max_timestamp,
+                                      Rcpp::List filter_payload,
+                                      int64_t batch_size,
+                                      int64_t max_buffer_size,
+                                      bool quiet,
+                                      std::vector<std::string> columns,
+                                      std::string index_file) {
+  if (classes.size() != outfiles.size())
+    Rcpp::stop("Each message class needs an outfile");
+  if (batch_size < 1) Rcpp::stop("batch_size must be positive");
+
+  const MessageFilter filter(filter_msg_type, filter_stock_locate,
+                             min_timestamp, max_timestamp, filter_payload);
+  OrderLineage lineage(filter_payload);
+
+  const int n_classes = classes.size();
+  int executions_pos = -1;
+  for (int c = 0; c < n_classes; c++)
+    if (classes[c] == "executions") executions_pos = c;
+
+  // as in read_itch_impl, the executions and the lineage need all order
+  // messages, an index then only restricts the stock_locates
+  ItchReader reader(filename, max_buffer_size);
+  ItchIndex index(index_file);
+  std::vector<int64_t> skipped(MSG_CLASS_SIZE, 0);
+  if (index.matches(reader) && (executions_pos >= 0 || lineage.active)) {
+    index.restrict_ranges(reader, filter);
+  } else if (index.matches(reader)) {
+    std::vector<int> class_pos;
+    for (const std::string &cls : classes)
+      class_pos.push_back(get_class_position(cls));
+    index.seek(reader, filter, start, class_pos, skipped);
+  }
+
+  // one parser and one file per class, the vectors of a parser hold exactly
+  // one batch and are reused for the next batch
+  ParserTable table;
+  std::vector<MessageParser*> parsers;
+  std::vector<ArrowFileWriter*> writers;
+  auto clean_up = [&]() {
+    for (MessageParser * p : parsers) delete p;
+    for (ArrowFileWriter * w : writers) delete w;
+  };
+
+  ArrowBatch batch;
+  try {
+    for (int c = 0; c < n_classes; c++) {
+      const int pos = get_class_position(classes[c]);
+      const int64_t n_skipped = pos >= 0 ? skipped[pos] : 0;
+      MessageParser * p = create_parser(classes[c], start - n_skipped,
+                                        end < 0 ? end : end - n_skipped);
+      parsers.push_back(p);
+      p->select_columns(columns);
+      p->init_vectors(batch_size);
+      table.add_parser(p);
+    }
+
+    for (const std::string &col : columns) {
+      bool found = false;
+      for (MessageParser * p : parsers) if (p->has_column(col)) found = true;
+      if (!found)
+        Rcpp::stop("Column '%s' not found in the selected message classes",
+                   col.c_str());
+    }
+
+    // the schema is given by an empty batch
+    for (int c = 0; c < n_classes; c++) {
+      batch.clear();
+      parsers[c]->to_arrow(batch);
+      writers.push_back(new ArrowFileWriter(outfiles[c], batch));
+    }
+  } catch (...) {
+    clean_up();
+    throw;
+  }
+
+  std::map<MessageParser*, ArrowFileWriter*> parser_to_writer;
+  for (int c = 0; c < n_classes; c++) parser_to_writer[parsers[c]] = writers[c];
+  ExecutionsParser * executions = executions_pos < 0 ? NULL :
+    static_cast<ExecutionsParser*>(parsers[executions_pos]);
+
+  // writes the batch of a parser if it is full (or if force and not empty)
+  auto flush = [&](MessageParser * p, bool force) {
+    if (p->n_parsed() == 0 || (!force && p->n_parsed() < batch_size)) return;
+    batch.clear();
+    p->to_arrow(batch);
+    parser_to_writer[p]->write_batch(batch);
+    p->clear();
+  };
+
+  int64_t total_msgs = 0;
+  try {
+    unsigned char * buf;
+    int64_t this_buffer_size;
+    bool max_ts_reached = false;
+
+    while (!max_ts_reached && (this_buffer_size = reader.next_block(buf)) > 0) {
+      Rcpp::checkUserInterrupt();
+
+      int64_t i = 0;
+      while (has_full_message(buf, i, this_buffer_size)) {
+        unsigned char * msg = &buf[i + 2];
+        if (getNBytes64<6>(&msg[5]) > filter.max_ts) {
+          max_ts_reached = true;
+          break;
+        }
+
+        const bool in_lineage = !lineage.active || lineage.passes(msg);
+        const bool passes = in_lineage && filter.passes(msg);
+        if (passes) {
+          table.parse_message(msg);
+          if (table.parsers[msg[0]] != NULL) flush(table.parsers[msg[0]], false);
+        }
+        if (executions != NULL) {
+          executions->track(msg, passes);
+          flush(executions, false);
+        }
+
+        i += get_message_size(msg[0]);
+        total_msgs++;
+      }
+      reader.consume(i);
+    }
+
+    for (int c = 0; c < n_classes; c++) {
+      flush(parsers[c], true);
+      writers[c]->close();
+    }
+  } catch (...) {
+    clean_up();
+    throw;
+  }
+
+  Rcpp::NumericVector res(n_classes);
+  for (int c = 0; c < n_classes; c++) res[c] = writers[c]->n_rows;
+  res.attr("names") = classes;
+
+  if (!quiet) {
+    Rprintf("[Counting]   num messages %s\n", format_thousands(total_msgs).c_str());
+    for (int c = 0; c < n_classes; c++)
+      Rprintf("[Arrow]      %s '%s' messages to '%s'\n",
+              format_thousands(writers[c]->n_rows).c_str(),
+              classes[c].c_str(), outfiles[c].c_str());
+  }
+
+  clean_up();
+  return res;
+}
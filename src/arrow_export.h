@@ -0,0 +1,32 @@
+#ifndef ARROWEXPORT_H
+#define ARROWEXPORT_H
+
+#include <Rcpp.h>
+#include "specifications.h"
+#include "helper_functions.h"
+#include "itch_reader.h"
+#include "message_filter.h"
+#include "itch_index.h"
+#include "read_functions.h"
+#include "arrow_writer.h"
+
+// Entry function to write the message classes of an ITCH file to Arrow IPC
+// files (one per class), the messages are parsed into record batches of at
+// most batch_size rows, which are written as soon as they are full.
+// Returns the number of messages written per class
+Rcpp::NumericVector arrow_export_impl(std::vector<std::string> classes,
+                                      std::string filename,
+                                      std::vector<std::string> outfiles,
+                                      int64_t start, int64_t end,
+                                      Rcpp::CharacterVector filter_msg_type,
+                                      Rcpp::IntegerVector filter_stock_locate,
+                                      Rcpp::NumericVector min_timestamp,
+                                      Rcpp::NumericVector max_timestamp,
+                                      Rcpp::List filter_payload,
+                                      int64_t batch_size = 1e6,
+                                      int64_t max_buffer_size = 1e8,
+                                      bool quiet = false,
+                                      std::vector<std::string> columns = {},
+                                      std::string index_file = "");
+
+#endif // ARROWEXPORT_H
@@ -0,0 +1,433 @@
+#include <Rcpp.h>
+#include <algorithm>
+#include <cstring>
+#include "arrow_writer.h"
+#include "specifications.h"
+
+// #############################################################################
+// Flatbuffer encoding of the Arrow metadata
+// #############################################################################
+
+/*
+ * A flatbuffer object is a table, a vector of tables, a vector of structs,
+ *   or a string. The objects are built as a tree and serialized front to
+ *   back, every object is followed by its children, i.e., all offsets point
+ *   forward as required by the format.
+ *
+ * A table holds fields, which are either scalars (size 1, 2, 4, or 8 bytes)
+ *   or offsets to one of its children. The slot of a field is its id in the
+ *   flatbuffer schema (a union takes two ids: the type and the value).
+ */
+struct FbField {
+  int slot;
+  int size;
+  int64_t value;
+  int child; // the position in FbObject::children for offsets, else -1
+};
+
+struct FbObject {
+  enum Kind { TABLE, TABLES, STRUCTS, STRING } kind;
+  std::vector<FbField> fields;     // TABLE
+  std::vector<FbObject> children;  // TABLE (the offsets) and TABLES
+  std::string bytes;               // STRUCTS (8 byte aligned) and STRING
+  uint32_t n = 0;                  // STRUCTS, the number of structs
+};
+
+static FbField fb_scalar(int slot, int size, int64_t value) {
+  return {slot, size, value, -1};
+}
+
+static FbObject fb_table() {
+  FbObject o;
+  o.kind = FbObject::TABLE;
+  return o;
+}
+
+static void fb_add_child(FbObject &table, int slot, FbObject child) {
+  table.fields.push_back({slot, 4, 0, (int) table.children.size()});
+  table.children.push_back(child);
+}
+
+static FbObject fb_tables(std::vector<FbObject> tables) {
+  FbObject o;
+  o.kind = FbObject::TABLES;
+  o.children = tables;
+  return o;
+}
+
+static FbObject fb_structs(const std::string &bytes, uint32_t n) {
+  FbObject o;
+  o.kind = FbObject::STRUCTS;
+  o.bytes = bytes;
+  o.n = n;
+  return o;
+}
+
+static FbObject fb_string(const std::string &s) {
+  FbObject o;
+  o.kind = FbObject::STRING;
+  o.bytes = s;
+  return o;
+}
+
+// appends little endian values to a byte string
+static void put_le(std::string &s, int64_t v, int size) {
+  for (int i = 0; i < size; i++) s.push_back((char) ((v >> (8 * i)) & 0xff));
+}
+
+class FbSerializer {
+public:
+  // the serialized root object, padded to 8 bytes
+  std::vector<unsigned char> finish(const FbObject &root) {
+    buf.assign(4, 0);
+    const int64_t root_pos = write(root);
+    set(0, root_pos, 4);
+    pad(8);
+    return buf;
+  }
+
+private:
+  std::vector<unsigned char> buf;
+
+  // pads the buffer until its size is rem modulo align
+  void pad(int64_t align, int64_t rem = 0) {
+    while ((int64_t) buf.size() % align != rem) buf.push_back(0);
+  }
+  void set(int64_t pos, int64_t v, int size) {
+    for (int i = 0; i < size; i++) buf[pos + i] = (v >> (8 * i)) & 0xff;
+  }
+  void append(int64_t v, int size) {
+    buf.resize(buf.size() + size);
+    set(buf.size() - size, v, size);
+  }
+
+  // writes the object and its children, returns the position that an offset
+  // to the object points to
+  int64_t write(const FbObject &o) {
+    int64_t pos;
+    switch (o.kind) {
+    case FbObject::STRING:
+      pad(4);
+      pos = buf.size();
+      append(o.bytes.size(), 4);
+      buf.insert(buf.end(), o.bytes.begin(), o.bytes.end());
+      buf.push_back(0);
+      return pos;
+
+    case FbObject::STRUCTS:
+      // the structs after the length are 8 byte aligned
+      pad(8, 4);
+      pos = buf.size();
+      append(o.n, 4);
+      buf.insert(buf.end(), o.bytes.begin(), o.bytes.end());
+      return pos;
+
+    case FbObject::TABLES:
+      pad(4);
+      pos = buf.size();
+      append(o.children.size(), 4);
+      buf.resize(buf.size() + 4 * o.children.size());
+      for (size_t i = 0; i < o.children.size(); i++) {
+        const int64_t at = pos + 4 + 4 * i;
+        set(at, write(o.children[i]) - at, 4);
+      }
+      return pos;
+
+    case FbObject::TABLE:
+    default:
+      break;
+    }
+
+    // the fields are ordered by size (8 byte fields first) after the 4 byte
+    // offset to the vtable, the table starts 4 bytes before an 8 byte boundary,
+    // i.e., every field is aligned to its size
+    std::vector<FbField> fields = o.fields;
+    std::stable_sort(fields.begin(), fields.end(),
+                     [](const FbField &a, const FbField &b) { return a.size > b.size; });
+
+    int n_slots = 0;
+    int table_size = 4;
+    std::vector<int> field_pos(fields.size());
+    for (size_t i = 0; i < fields.size(); i++) {
+      n_slots = std::max(n_slots, fields[i].slot + 1);
+      field_pos[i] = table_size;
+      table_size += fields[i].size;
+    }
+
+    // the vtable: its size, the size of the table, the position of each slot
+    pad(2);
+    const int64_t vtable_pos = buf.size();
+    append(4 + 2 * n_slots, 2);
+    append(table_size, 2);
+    for (int s = 0; s < n_slots; s++) {
+      int at = 0;
+      for (size_t i = 0; i < fields.size(); i++)
+        if (fields[i].slot == s) at = field_pos[i];
+      append(at, 2);
+    }
+
+    pad(8, 4);
+    pos = buf.size();
+    append(pos - vtable_pos, 4);
+    for (const FbField &f : fields) append(f.value, f.size);
+
+    for (size_t i = 0; i < fields.size(); i++) {
+      if (fields[i].child < 0) continue;
+      const int64_t at = pos + field_pos[i];
+      set(at, write(o.children[fields[i].child]) - at, 4);
+    }
+    return pos;
+  }
+};
+
+// see Message.fbs, Schema.fbs, and File.fbs of the Arrow format
+const int64_t METADATA_V5 = 4;
+const int64_t HEADER_SCHEMA = 1, HEADER_RECORD_BATCH = 3;
+const int64_t TYPE_INT = 2, TYPE_FLOATING_POINT = 3, TYPE_UTF8 = 5, TYPE_BOOL = 6;
+
+static FbObject fb_schema(const std::vector<std::pair<std::string, ArrowType>> &fields) {
+  std::vector<FbObject> fb_fields;
+  for (const auto &f : fields) {
+    FbObject type = fb_table();
+    int64_t type_id;
+    switch (f.second) {
+    case ARROW_INT32:
+    case ARROW_INT64:
+      type_id = TYPE_INT;
+      type.fields.push_back(fb_scalar(0, 4, f.second == ARROW_INT32 ? 32 : 64));
+      type.fields.push_back(fb_scalar(1, 1, 1)); // signed
+      break;
+    case ARROW_FLOAT64:
+      type_id = TYPE_FLOATING_POINT;
+      type.fields.push_back(fb_scalar(0, 2, 2)); // double precision
+      break;
+    case ARROW_BOOL:
+      type_id = TYPE_BOOL;
+      break;
+    case ARROW_UTF8:
+    default:
+      type_id = TYPE_UTF8;
+      break;
+    }
+
+    FbObject field = fb_table();
+    fb_add_child(field, 0, fb_string(f.first));
+    field.fields.push_back(fb_scalar(1, 1, 1)); // nullable
+    field.fields.push_back(fb_scalar(2, 1, type_id));
+    fb_add_child(field, 3, type);
+    fb_add_child(field, 5, fb_tables({})); // children
+    fb_fields.push_back(field);
+  }
+
+  FbObject schema = fb_table();
+  schema.fields.push_back(fb_scalar(0, 2, 0)); // little endian
+  fb_add_child(schema, 1, fb_tables(fb_fields));
+  return schema;
+}
+
+static std::vector<unsigned char> fb_message(int64_t header_type,
+                                             FbObject header,
+                                             int64_t body_length) {
+  FbObject msg = fb_table();
+  msg.fields.push_back(fb_scalar(0, 2, METADATA_V5));
+  msg.fields.push_back(fb_scalar(1, 1, header_type));
+  fb_add_child(msg, 2, header);
+  msg.fields.push_back(fb_scalar(3, 8, body_length));
+  return FbSerializer().finish(msg);
+}
+
+// #############################################################################
+// ArrowBatch
+// #############################################################################
+
+ArrowColumn & ArrowBatch::add_column(const std::string &name, ArrowType type,
+                                     int64_t n) {
+  if (columns.size() > 0 && n != length)
+    Rcpp::stop("All columns of a record batch must have the same length");
+  length = n;
+  columns.push_back({name, type, 0, {}});
+  return columns.back();
+}
+
+int64_t ArrowBatch::add_buffer(ArrowColumn &col, int64_t size) {
+  const int64_t offset = body.size();
+  const int64_t padded = (size + 7) / 8 * 8;
+  body.resize(offset + padded, 0);
+  col.buffers.push_back({offset, size});
+  return offset;
+}
+
+template<typename T, typename IsNA>
+void ArrowBatch::add_validity(ArrowColumn &col, const T * v, int64_t n, IsNA is_na) {
+  for (int64_t i = 0; i < n; i++) if (is_na(v[i])) col.null_count++;
+  if (col.null_count == 0) {
+    add_buffer(col, 0);
+    return;
+  }
+
+  unsigned char * bits = body.data() + add_buffer(col, (n + 7) / 8);
+  for (int64_t i = 0; i < n; i++)
+    if (!is_na(v[i])) bits[i / 8] |= 1 << (i % 8);
+}
+
+void ArrowBatch::add_int32(const std::string &name, const int * v, int64_t n) {
+  ArrowColumn &col = add_column(name, ARROW_INT32, n);
+  add_validity(col, v, n, [](int x) { return x == NA_INTEGER; });
+  const int64_t size = n * sizeof(int);
+  const int64_t offset = add_buffer(col, size);
+  if (size > 0) std::memcpy(body.data() + offset, v, size);
+}
+
+void ArrowBatch::add_int64(const std::string &name, const int64_t * v, int64_t n) {
+  ArrowColumn &col = add_column(name, ARROW_INT64, n);
+  add_validity(col, v, n, [](int64_t x) { return x == NA_INT64; });
+  const int64_t size = n * sizeof(int64_t);
+  const int64_t offset = add_buffer(col, size);
+  if (size > 0) std::memcpy(body.data() + offset, v, size);
+}
+
+void ArrowBatch::add_float64(const std::string &name, const double * v, int64_t n) {
+  ArrowColumn &col = add_column(name, ARROW_FLOAT64, n);
+  add_validity(col, v, n, [](double x) { return R_IsNA(x); });
+  const int64_t size = n * sizeof(double);
+  const int64_t offset = add_buffer(col, size);
+  if (size > 0) std::memcpy(body.data() + offset, v, size);
+}
+
+void ArrowBatch::add_bool(const std::string &name, const int * v, int64_t n) {
+  ArrowColumn &col = add_column(name, ARROW_BOOL, n);
+  add_validity(col, v, n, [](int x) { return x == NA_LOGICAL; });
+  unsigned char * bits = body.data() + add_buffer(col, (n + 7) / 8);
+  for (int64_t i = 0; i < n; i++)
+    if (v[i] != NA_LOGICAL && v[i] != 0) bits[i / 8] |= 1 << (i % 8);
+}
+
+void ArrowBatch::add_utf8(const std::string &name, const int64_t * v, int64_t n,
+                          int width) {
+  ArrowColumn &col = add_column(name, ARROW_UTF8, n);
+  add_validity(col, v, n, [](int64_t x) { return x == NA_INT64; });
+
+  // same as StringCache::get() but into one buffer of characters
+  chars.clear();
+  std::vector<int32_t> offsets(n + 1, 0);
+  for (int64_t i = 0; i < n; i++) {
+    if (v[i] == BLANK_KEY) {
+      chars.push_back(' ');
+    } else if (v[i] != NA_INT64) {
+      for (int b = width - 1; b >= 0; --b) {
+        const char c = (v[i] >> (8 * b)) & 0xff;
+        if (width == 1 || c != ' ') chars.push_back(c);
+      }
+    }
+    offsets[i + 1] = chars.size();
+  }
+
+  const int64_t offsets_size = (n + 1) * sizeof(int32_t);
+  int64_t offset = add_buffer(col, offsets_size);
+  std::memcpy(body.data() + offset, offsets.data(), offsets_size);
+  offset = add_buffer(col, chars.size());
+  if (chars.size() > 0) std::memcpy(body.data() + offset, chars.data(), chars.size());
+}
+
+void ArrowBatch::clear() {
+  length = 0;
+  columns.clear();
+  body.clear();
+}
+
+// #############################################################################
+// ArrowFileWriter
+// #############################################################################
+
+ArrowFileWriter::ArrowFileWriter(const std::string &filename,
+                                 const ArrowBatch &schema) :
+  filename(filename) {
+  for (const ArrowColumn &col : schema.columns)
+    fields.push_back({col.name, col.type});
+
+  file = fopen(filename.c_str(), "wb");
+  if (file == NULL) Rcpp::stop("Could not open file '%s'", filename.c_str());
+
+  write("ARROW1\0\0", 8);
+  write_message(fb_message(HEADER_SCHEMA, fb_schema(fields), 0), {});
+}
+
+ArrowFileWriter::~ArrowFileWriter() {
+  if (file != NULL) fclose(file);
+}
+
+void ArrowFileWriter::write(const void * data, int64_t size) {
+  if (size > 0 && fwrite(data, 1, size, file) != (size_t) size)
+    Rcpp::stop("Could not write to file '%s'", filename.c_str());
+  pos += size;
+}
+
+ArrowFileWriter::Block ArrowFileWriter::write_message(
+    const std::vector<unsigned char> &meta,
+    const std::vector<unsigned char> &body) {
+  // the continuation marker and the size of the (8 byte padded) metadata
+  Block b = {pos, 8 + (int64_t) meta.size(), (int64_t) body.size()};
+  const int32_t prefix[2] = {-1, (int32_t) meta.size()};
+  write(prefix, 8);
+  write(meta.data(), meta.size());
+  write(body.data(), body.size());
+  return b;
+}
+
+void ArrowFileWriter::write_batch(const ArrowBatch &batch) {
+  if (batch.columns.size() != fields.size())
+    Rcpp::stop("The record batch does not match the schema of '%s'",
+               filename.c_str());
+
+  std::string nodes, buffers;
+  for (const ArrowColumn &col : batch.columns) {
+    put_le(nodes, batch.length, 8);
+    put_le(nodes, col.null_count, 8);
+    for (const auto &buf : col.buffers) {
+      put_le(buffers, buf.first, 8);
+      put_le(buffers, buf.second, 8);
+    }
+  }
+
+  FbObject rb = fb_table();
+  rb.fields.push_back(fb_scalar(0, 8, batch.length));
+  fb_add_child(rb, 1, fb_structs(nodes, nodes.size() / 16));
+  fb_add_child(rb, 2, fb_structs(buffers, buffers.size() / 16));
+
+  blocks.push_back(write_message(
+    fb_message(HEADER_RECORD_BATCH, rb, batch.body.size()), batch.body
+  ));
+  n_rows += batch.length;
+}
+
+void ArrowFileWriter::close() {
+  if (file == NULL) return;
+
+  // the end of stream marker
+  const int32_t eos[2] = {-1, 0};
+  write(eos, 8);
+
+  std::string fb_blocks;
+  for (const Block &b : blocks) {
+    put_le(fb_blocks, b.offset, 8);
+    put_le(fb_blocks, b.meta_length, 4);
+    put_le(fb_blocks, 0, 4); // padding
+    put_le(fb_blocks, b.body_length, 8);
+  }
+
+  FbObject footer = fb_table();
+  footer.fields.push_back(fb_scalar(0, 2, METADATA_V5));
+  fb_add_child(footer, 1, fb_schema(fields));
+  fb_add_child(footer, 2, fb_structs("", 0)); // no dictionaries
+  fb_add_child(footer, 3, fb_structs(fb_blocks, blocks.size()));
+  const std::vector<unsigned char> meta = FbSerializer().finish(footer);
+
+  const int32_t meta_size = meta.size();
+  write(meta.data(), meta.size());
+  write(&meta_size, 4);
+  write("ARROW1", 6);
+
+  const int res = fclose(file);
+  file = NULL;
+  if (res != 0) Rcpp::stop("Could not close file '%s'", filename.c_str());
+}
@@ -0,0 +1,107 @@
+#ifndef ARROWWRITER_H
+#define ARROWWRITER_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// the Arrow types of the columns of a MessageParser
+enum ArrowType { ARROW_INT32, ARROW_INT64, ARROW_FLOAT64, ARROW_BOOL, ARROW_UTF8 };
+
+// a column of a record batch, its node (length and nulls) and the positions
+// of its buffers (validity, data or validity, offsets, data) in the body
+struct ArrowColumn {
+  std::string name;
+  ArrowType type;
+  int64_t null_count;
+  std::vector<std::pair<int64_t, int64_t>> buffers; // offset and length
+};
+
+/*
+ * ArrowBatch, the values of one record batch in the Arrow columnar layout.
+ *
+ * The columns are added in the order of the schema, each add function copies
+ * the first n values into the body (every buffer is padded to 8 bytes).
+ * Missing values (NA_INTEGER, NA_LOGICAL, NA_REAL, NA_INT64) are marked in a
+ * validity bitmap, which is only written if a column has missing values.
+ * Strings are stored as in the Columns (see key_to_string), i.e., n bytes
+ * in big endian, whitespaces are dropped for strings longer than one byte.
+ *
+ * A batch of 0 rows describes the schema (names and types) of the columns.
+ */
+class ArrowBatch {
+public:
+  void add_int32(const std::string &name, const int * v, int64_t n);
+  void add_int64(const std::string &name, const int64_t * v, int64_t n);
+  void add_float64(const std::string &name, const double * v, int64_t n);
+  void add_bool(const std::string &name, const int * v, int64_t n);
+  void add_utf8(const std::string &name, const int64_t * v, int64_t n, int width);
+  // removes all columns, the memory of the body is kept for the next batch
+  void clear();
+
+  int64_t length = 0;
+  std::vector<ArrowColumn> columns;
+  std::vector<unsigned char> body;
+
+private:
+  ArrowColumn & add_column(const std::string &name, ArrowType type, int64_t n);
+  // appends size bytes (padded to 8) to the body, returns their offset
+  int64_t add_buffer(ArrowColumn &col, int64_t size);
+  // adds the validity bitmap of the column (empty if it has no nulls)
+  template<typename T, typename IsNA>
+  void add_validity(ArrowColumn &col, const T * v, int64_t n, IsNA is_na);
+
+  std::vector<char> chars;
+};
+
+/*
+ * ArrowFileWriter, writes record batches to an Arrow IPC file (Feather v2).
+ *
+ * The main usage is
+ *
+ *   ArrowBatch batch;
+ *   // add the columns with 0 rows for the schema
+ *   ArrowFileWriter writer(filename, batch);
+ *   // repeat: batch.clear(), add the columns with n rows
+ *   writer.write_batch(batch);
+ *   writer.close();
+ *
+ * The flatbuffers of the metadata (Schema, RecordBatch, and Footer) are
+ * encoded by hand, i.e., no Arrow library is needed.
+ */
+class ArrowFileWriter {
+public:
+  // opens the file, writes the magic bytes and the schema of the batch
+  ArrowFileWriter(const std::string &filename, const ArrowBatch &schema);
+  ~ArrowFileWriter();
+  ArrowFileWriter(const ArrowFileWriter&) = delete;
+  ArrowFileWriter& operator=(const ArrowFileWriter&) = delete;
+
+  // the columns of batch must match the schema
+  void write_batch(const ArrowBatch &batch);
+  // writes the footer and closes the file
+  void close();
+
+  // the number of rows written so far
+  int64_t n_rows = 0;
+
+private:
+  // the position of an encapsulated message in the file
+  struct Block {
+    int64_t offset, meta_length, body_length;
+  };
+
+  void write(const void * data, int64_t size);
+  // writes the message (metadata and body), returns its block
+  Block write_message(const std::vector<unsigned char> &meta,
+                      const std::vector<unsigned char> &body);
+
+  FILE * file = NULL;
+  std::string filename;
+  std::vector<std::pair<std::string, ArrowType>> fields;
+  std::vector<Block> blocks;
+  int64_t pos = 0;
+};
+
+#endif // ARROWWRITER_H
@@ -0,0 +1,222 @@
+#include "bars.h"
+
+BarAggregator::BarAggregator(int64_t interval) :
+  interval(interval), current(65536), stocks(65536, 0x2020202020202020) {}
+
+// adds a trade to a bar, the first trade of a bar sets its open
+static void add_to_bar(Bar &b, int64_t price, int64_t shares) {
+  if (b.n_trades == 0) b.open = b.high = b.low = price;
+  if (price > b.high) b.high = price;
+  if (price < b.low) b.low = price;
+  b.close = price;
+  b.volume += shares;
+  b.n_trades++;
+  b.notional += (double) price * (double) shares;
+}
+
+static bool bar_before(const Bar &a, const Bar &b) {
+  return a.start < b.start || (a.start == b.start && a.stock_locate < b.stock_locate);
+}
+
+void BarAggregator::add(int64_t ts, int sl, int64_t price, int64_t shares,
+                        int64_t match_number) {
+  if (shares <= 0) return;
+  trades++;
+  log.push_back({match_number, ts, shares, (uint32_t) price, sl});
+
+  Bar &b = current[sl];
+  const int64_t start = (ts / interval) * interval;
+  if (b.start != start) {
+    if (b.start >= 0) closed.push_back(b);
+    b = Bar();
+    b.start = start;
+    b.stock_locate = sl;
+  }
+  add_to_bar(b, price, shares);
+}
+
+void BarAggregator::remove_broken() {
+  // the bars (sorted) of the broken trades are emptied and then rebuilt from
+  // the other trades of the log in file order
+  auto find_bar = [this](const BarTrade &t) {
+    Bar key;
+    key.start = (t.timestamp / interval) * interval;
+    key.stock_locate = t.stock_locate;
+    return std::lower_bound(closed.begin(), closed.end(), key, bar_before);
+  };
+
+  std::vector<char> rebuild(closed.size(), false);
+  for (const BarTrade &t : log) {
+    if (broken.count(t.match_number) == 0) continue;
+    const size_t i = find_bar(t) - closed.begin();
+    if (!rebuild[i]) {
+      Bar empty;
+      empty.start = closed[i].start;
+      empty.stock_locate = closed[i].stock_locate;
+      closed[i] = empty;
+      rebuild[i] = true;
+    }
+    n_removed++;
+  }
+  if (n_removed == 0) return;
+
+  for (const BarTrade &t : log) {
+    if (broken.count(t.match_number) > 0) continue;
+    auto it = find_bar(t);
+    if (rebuild[it - closed.begin()]) add_to_bar(*it, t.price, t.shares);
+  }
+
+  // bars of only broken trades are dropped
+  closed.erase(std::remove_if(closed.begin(), closed.end(),
+                              [](const Bar &b) { return b.n_trades == 0; }),
+               closed.end());
+  trades -= n_removed;
+}
+
+Rcpp::List BarAggregator::get_data_frame() {
+  for (Bar &b : current) {
+    if (b.start >= 0) closed.push_back(b);
+    b = Bar();
+  }
+  std::sort(closed.begin(), closed.end(), bar_before);
+
+  if (!broken.empty()) remove_broken();
+  std::vector<BarTrade>().swap(log);
+
+  const int64_t n = closed.size();
+  Int64Column  timestamp;
+  IntColumn    stock_locate;
+  StrColumn<8> stock;
+  DblColumn    open, high, low, close;
+  Int64Column  volume;
+  DblColumn    vwap;
+  IntColumn    n_trades_col;
+  for (Column * c : std::vector<Column*>{&timestamp, &stock_locate, &stock,
+                                         &open, &high, &low, &close, &volume,
+                                         &vwap, &n_trades_col})
+    c->resize(n);
+
+  for (int64_t i = 0; i < n; i++) {
+    const Bar &b = closed[i];
+    timestamp[i]    = b.start;
+    stock_locate[i] = b.stock_locate;
+    stock[i]        = stocks[b.stock_locate];
+    open[i]         = ((double) b.open) / 10000.0;
+    high[i]         = ((double) b.high) / 10000.0;
+    low[i]          = ((double) b.low) / 10000.0;
+    close[i]        = ((double) b.close) / 10000.0;
+    volume[i]       = b.volume;
+    vwap[i]         = b.volume > 0 ? b.notional / (double) b.volume / 10000.0 : NA_REAL;
+    n_trades_col[i] = b.n_trades;
+  }
+  std::vector<Bar>().swap(closed);
+
+  return columns_to_data_frame({
+    {"timestamp", &timestamp}, {"stock_locate", &stock_locate},
+    {"stock", &stock}, {"open", &open}, {"high", &high}, {"low", &low},
+    {"close", &close}, {"volume", &volume}, {"vwap", &vwap},
+    {"n_trades", &n_trades_col}
+  }, n);
+}
+
+// [[Rcpp::export]]
+Rcpp::List bars_impl(std::string filename,
+                     Rcpp::IntegerVector filter_stock_locate,
+                     int64_t interval,
+                     int64_t max_buffer_size,
+                     bool quiet,
+                     std::string index_file) {
+  if (interval < 1) Rcpp::stop("interval must be positive");
+
+  // the trades, the broken trades, and the order messages, which give the
+  // price of the 'E' executions
+  Rcpp::CharacterVector msg_types = Rcpp::CharacterVector::create(
+    "A", "F", "E", "C", "X", "D", "U", "P", "Q", "B"
+  );
+  Rcpp::List no_payload = Rcpp::List::create(
+    Rcpp::Named("min_price") = Rcpp::NumericVector(0),
+    Rcpp::Named("max_price") = Rcpp::NumericVector(0),
+    Rcpp::Named("min_shares") = Rcpp::NumericVector(0),
+    Rcpp::Named("buy") = Rcpp::LogicalVector(0),
+    Rcpp::Named("order_ref") = Rcpp::NumericVector(0),
+    Rcpp::Named("match_number") = Rcpp::NumericVector(0),
+    Rcpp::Named("cross_type") = Rcpp::CharacterVector(0)
+  );
+  const MessageFilter filter(msg_types, filter_stock_locate,
+                             Rcpp::NumericVector(0), Rcpp::NumericVector(0),
+                             no_payload);
+
+  ItchReader reader(filename, max_buffer_size);
+  ItchIndex index(index_file);
+  if (index.matches(reader)) index.restrict_ranges(reader, filter);
+
+  OrderStore orders;
+  BarAggregator bars(interval);
+  unsigned char * buf;
+  int64_t this_buffer_size;
+
+  while ((this_buffer_size = reader.next_block(buf)) > 0) {
+    Rcpp::checkUserInterrupt();
+
+    int64_t i = 0;
+    while (has_full_message(buf, i, this_buffer_size)) {
+      unsigned char * msg = &buf[i + 2];
+      if (filter.passes(msg)) {
+        const int64_t ts = getNBytes64<6>(&msg[5]);
+        const int sl = getNBytes32<2>(&msg[1]);
+
+        switch (msg[0]) {
+        case 'A':
+        case 'F':
+          bars.set_stock(sl, getNBytes64<8>(&msg[24]));
+          break;
+        case 'P':
+          bars.set_stock(sl, getNBytes64<8>(&msg[24]));
+          bars.add(ts, sl, getNBytes32<4>(&msg[32]), getNBytes32<4>(&msg[20]),
+                   getNBytes64<8>(&msg[36]));
+          break;
+        case 'Q':
+          bars.set_stock(sl, getNBytes64<8>(&msg[19]));
+          bars.add(ts, sl, getNBytes32<4>(&msg[27]), getNBytes64<8>(&msg[11]),
+                   getNBytes64<8>(&msg[31]));
+          break;
+        case 'E': {
+          // executed at the price of the order, the price of executions of
+          // unknown orders (e.g., the file starts during the day) is not known
+          const OrderEntry * o = orders.find(getNBytes64<8>(&msg[11]));
+          if (o != NULL)
+            bars.add(ts, sl, o->price, getNBytes32<4>(&msg[19]),
+                     getNBytes64<8>(&msg[23]));
+          break;
+        }
+        case 'C':
+          // only printable executions count towards the volume
+          if (msg[31] == 'P')
+            bars.add(ts, sl, getNBytes32<4>(&msg[32]), getNBytes32<4>(&msg[19]),
+                     getNBytes64<8>(&msg[23]));
+          break;
+        case 'B':
+          bars.add_break(getNBytes64<8>(&msg[11]));
+          break;
+        default:
+          break;
+        }
+        track_order(orders, msg);
+      }
+      i += get_message_size(msg[0]);
+    }
+
+    reader.consume(i);
+  }
+
+  Rcpp::List res = bars.get_data_frame();
+  if (!quiet) {
+    Rprintf("[Messages]   aggregated %s trades\n",
+            format_thousands(bars.n_trades()).c_str());
+    if (bars.n_broken() > 0)
+      Rprintf("[Messages]   removed %s broken trades\n",
+              format_thousands(bars.n_broken()).c_str());
+  }
+
+  return res;
+}
@@ -0,0 +1,90 @@
+#ifndef BARS_H
+#define BARS_H
+
+#include <Rcpp.h>
+#include <unordered_set>
+#include "specifications.h"
+#include "helper_functions.h"
+#include "itch_reader.h"
+#include "message_filter.h"
+#include "itch_index.h"
+#include "read_functions.h"
+#include "order_store.h"
+
+// Entry function to aggregate the trades of an ITCH file into time bars
+Rcpp::List bars_impl(std::string filename,
+                     Rcpp::IntegerVector filter_stock_locate,
+                     int64_t interval,
+                     int64_t max_buffer_size = 1e8,
+                     bool quiet = false,
+                     std::string index_file = "");
+
+// one time bar of a stock, the prices are in 1/10000 dollars
+struct Bar {
+  int64_t start = -1; // the start of the interval, -1 if the bar is empty
+  int stock_locate = 0;
+  int64_t open = 0, high = 0, low = 0, close = 0, volume = 0, n_trades = 0;
+  // the sum of price * shares (a double as the product may overflow)
+  double notional = 0;
+};
+
+// a trade as added to a bar, kept to rebuild the bars of broken trades
+struct BarTrade {
+  int64_t match_number, timestamp, shares;
+  uint32_t price;
+  int32_t stock_locate;
+};
+
+/*
+ * BarAggregator, the open, high, low, close, volume, vwap, and number of
+ *   trades per stock and interval, computed while streaming.
+ *
+ * Only the current bar of each stock is kept open, a bar is closed when the
+ * first trade of a later interval of the stock arrives.
+ *
+ * Broken trades ('B') refer to a trade by its match_number and usually arrive
+ * long after the bar of the trade is closed. Therefore, each trade is also
+ * kept in a compact log (32 bytes per trade), the bars with broken trades are
+ * rebuilt from the log without the broken trades by get_data_frame().
+ *
+ * The main usage is
+ *
+ *   BarAggregator bars(interval);
+ *   bars.set_stock(stock_locate, stock);
+ *   bars.add(timestamp, stock_locate, price, shares, match_number);
+ *   bars.add_break(match_number);
+ *   Rcpp::List df = bars.get_data_frame();
+ */
+class BarAggregator {
+public:
+  BarAggregator(int64_t interval);
+  // adds a trade, trades without shares (e.g., crosses that did not match)
+  // are ignored
+  void add(int64_t timestamp, int stock_locate, int64_t price, int64_t shares,
+           int64_t match_number);
+  // the stock (8 bytes, see key_to_string) of a stock_locate
+  void set_stock(int stock_locate, int64_t stock) { stocks[stock_locate] = stock; }
+  // removes the trade with the match_number from its bar (when the bars are
+  // returned), unknown match_numbers are ignored
+  void add_break(int64_t match_number) { broken.insert(match_number); }
+  // the bars ordered by time and stock_locate as a data.frame
+  Rcpp::List get_data_frame();
+  // the number of trades, without the broken trades once the bars are returned
+  int64_t n_trades() const { return trades; }
+  // the number of broken trades that were removed from the bars
+  int64_t n_broken() const { return n_removed; }
+
+private:
+  // removes the broken trades by rebuilding their bars from the log
+  void remove_broken();
+
+  int64_t interval, trades = 0, n_removed = 0;
+  // the current bar and the stock of each stock_locate (2 byte locate codes)
+  std::vector<Bar> current;
+  std::vector<int64_t> stocks;
+  std::vector<Bar> closed;
+  std::vector<BarTrade> log;
+  std::unordered_set<int64_t> broken;
+};
+
+#endif // BARS_H
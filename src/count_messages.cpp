@@ -1,74 +1,49 @@
 #include "count_messages.h"
 
-#ifdef __APPLE__
-#  define fseeko64 fseeko
-#  define ftello64 ftello
-#endif
-
 // counts messages in a file
 std::vector<int64_t> count_messages_internal(std::string filename,
                                              int64_t max_buffer_size) {
-  FILE* infile;
-  infile = fopen(filename.c_str(), "rb");
-  if (infile == NULL) {
-    char buffer [50];
-    snprintf(buffer, sizeof(buffer), "File Error number %i!", errno);
-    Rcpp::stop(buffer);
-  }
-
-  // get size of the file
-  if (fseeko64(infile, 0L, SEEK_END) != 0) {
-    Rcpp::stop("Error seeking to end of file");
-  }
-  int64_t filesize = ftello64(infile);
-  if (filesize == -1) {
-    Rcpp::stop("Error getting file size");
-  }
-  if (fseeko64(infile, 0L, SEEK_SET) != 0) {
-    Rcpp::stop("Error seeking back to start of file");
-  }
+  ItchReader reader(filename, max_buffer_size);
 
-  // create buffer
-  int64_t buf_size = max_buffer_size > filesize ? filesize : max_buffer_size;
   unsigned char * buf;
-  buf = (unsigned char*) malloc(buf_size);
-
-  int64_t bytes_read = 0, this_buffer_size = 0;
+  int64_t this_buffer_size;
   std::vector<int64_t> count(sizeof(MSG_SIZES)/sizeof(MSG_SIZES[0]));
 
-  while (bytes_read < filesize) {
+  while ((this_buffer_size = reader.next_block(buf)) > 0) {
     Rcpp::checkUserInterrupt();
 
-    // read in buffer buffers
-    this_buffer_size = fread(buf, 1, buf_size, infile);
     int64_t i = 0;
-
-    int msg_size = 0;
-    do {
-      msg_size = get_message_size(buf[i + 2]);
-
+    while (has_full_message(buf, i, this_buffer_size)) {
       count[buf[i + 2] - 'A']++;
-      i += msg_size;
+      i += get_message_size(buf[i + 2]);
+    }
 
-    } while (i + msg_size <= this_buffer_size && bytes_read + i <= filesize);
-
-    // align the file pointer to read in a full message again
-    const int64_t offset = i - this_buffer_size;
-    fseeko64(infile, offset, SEEK_CUR);
-    bytes_read += i;
+    reader.consume(i);
   }
 
-  free(buf);
-  fclose(infile);
   return count;
 }
 
 // [[Rcpp::export]]
 Rcpp::DataFrame count_messages_impl(std::string filename,
                                     int64_t max_buffer_size,
-                                    bool quiet) {
+                                    bool quiet,
+                                    std::string index_file) {
+
+  // the index holds the total counts, no need to read the file
+  ItchIndex index(index_file);
+  bool use_index = false;
+  if (index.valid) {
+    ItchReader reader(filename, max_buffer_size);
+    use_index = index.matches(reader);
+  }
 
-  std::vector<int64_t> ct_raw = count_messages_internal(filename, max_buffer_size);
+  std::vector<int64_t> ct_raw;
+  if (use_index) {
+    ct_raw.assign(index.total_counts(), index.total_counts() + N_TYPES);
+  } else {
+    ct_raw = count_messages_internal(filename, max_buffer_size);
+  }
   std::vector<int64_t> count = take_needed_messages(ct_raw);
 
   int64_t total_msgs = 0;
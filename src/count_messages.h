@@ -4,6 +4,8 @@
 #include <Rcpp.h>
 #include "specifications.h"
 #include "helper_functions.h"
+#include "itch_reader.h"
+#include "itch_index.h"
 
 // internal main worker function that counts the messages
 std::vector<int64_t> count_messages_internal(std::string filename,
@@ -12,6 +14,7 @@ std::vector<int64_t> count_messages_internal(std::string filename,
 // Entry function for returning the count data.frame
 Rcpp::DataFrame count_messages_impl(std::string filename,
                                     int64_t max_buffer_size = 1e8,
-                                    bool quiet = false);
+                                    bool quiet = false,
+                                    std::string index_file = "");
 
 #endif // COUNTMESSAGES_H
\ No newline at end of file
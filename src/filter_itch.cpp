@@ -1,10 +1,5 @@
 #include "filter_itch.h"
 
-#ifdef __APPLE__
-#  define fseeko64 fseeko
-#  define ftello64 ftello
-#endif
-
 // [[Rcpp::export]]
 void filter_itch_impl(std::string infile, std::string outfile,
                       int64_t start, int64_t end,
@@ -12,52 +7,27 @@ void filter_itch_impl(std::string infile, std::string outfile,
                       Rcpp::IntegerVector filter_stock_locate,
                       Rcpp::NumericVector min_timestamp,
                       Rcpp::NumericVector max_timestamp,
+                      Rcpp::List filter_payload,
                       bool append,
                       int64_t max_buffer_size,
-                      bool quiet) {
-
-  // treat filters
-  std::vector<char> filter_msgs;
-  std::vector<int>  filter_sloc;
-
-  for (auto f : filter_msg_type) filter_msgs.push_back(Rcpp::as<char>(f));
-  for (int s : filter_stock_locate) filter_sloc.push_back(s);
-
-  const size_t ts_size = min_timestamp.size();
-  std::vector<int64_t> min_ts(ts_size);
-  if (ts_size > 0)
-    std::memcpy(&(min_ts[0]), &(min_timestamp[0]), ts_size * sizeof(int64_t)); 
-
-  std::vector<int64_t> max_ts(ts_size);
-  if (ts_size > 0)
-    std::memcpy(&(max_ts[0]), &(max_timestamp[0]), ts_size * sizeof(int64_t));
-  if (max_ts.size() == 1 && max_ts[0] == -1)
-    max_ts[0] = std::numeric_limits<int64_t>::max();
+                      bool quiet,
+                      std::string index_file) {
 
-  // get the max_ts_value!
-  int64_t max_ts_val = -1;
-  for (auto t : max_ts) if (t > max_ts_val) max_ts_val = t;
-  if (max_ts_val == -1) max_ts_val = std::numeric_limits<int64_t>::max();
+  const MessageFilter filter(filter_msg_type, filter_stock_locate,
+                             min_timestamp, max_timestamp, filter_payload);
+  OrderLineage lineage(filter_payload);
 
   if (end < 0) end = std::numeric_limits<int64_t>::max();
 
-  if (filter_msgs.size() == 0 &&
-      filter_sloc.size() == 0 &&
-      min_ts.size() == 0 &&
-      max_ts.size() == 0 &&
+  if (!filter.active() &&
       start == 0 &&
       end == -1)
     Rcpp::stop("No filters where set, aborting filter process!");
 
   // parse the messages
   // redirect to the correct msg types only
-  FILE* ifile;
-  ifile = fopen(infile.c_str(), "rb");
-  if (ifile == NULL) {
-    char buffer [50];
-    snprintf(buffer, sizeof(buffer), "Input File Error number %i!", errno);
-    Rcpp::stop(buffer);
-  }
+  ItchReader reader(infile, max_buffer_size);
+  const int64_t filesize = reader.filesize;
 
   FILE* ofile;
   std::string omode = append ? "ab" : "wb";
@@ -68,60 +38,53 @@ void filter_itch_impl(std::string infile, std::string outfile,
     Rcpp::stop(buffer);
   }
 
-  // get size of the file
-  if (fseeko64(ifile, 0L, SEEK_END) != 0) {
-    Rcpp::stop("Error seeking to end of file");
-  }
-  int64_t filesize = ftello64(ifile);
-  if (filesize == -1) {
-    Rcpp::stop("Error getting file size");
-  }
-  if (fseeko64(ifile, 0L, SEEK_SET) != 0) {
-    Rcpp::stop("Error seeking back to start of file");
-  }
-
-  // create buffer
-  int64_t buf_size = max_buffer_size > filesize ? filesize : max_buffer_size;
+  // create output buffer
+  int64_t buf_size = max_buffer_size > filesize && !reader.gz ?
+    filesize :
+    max_buffer_size;
   unsigned char * ibuf;
   unsigned char * obuf;
-  ibuf = (unsigned char*) malloc(buf_size);
   obuf = (unsigned char*) malloc(buf_size);
   // Rprintf("Allocating buffer to size %lld\n", buf_size);
 
-  int64_t bytes_read = 0, this_buffer_size = 0, bytes_written = 0;
+  int64_t this_buffer_size = 0, bytes_written = 0;
   int64_t msg_read = 0, msg_count = 0;
   std::vector<int64_t> msg_reads(MSG_CLASS_SIZE, 0);
 
+  // if an index of the file is found, start at the last checkpoint before
+  // the first message that is written (and read only the messages of the
+  // filtered stock_locates), msg_reads holds the number of skipped messages
+  // per class. The lineage needs the orders before the first message, only
+  // the stock_locates are restricted
+  ItchIndex index(index_file);
+  if (index.matches(reader) && lineage.active) {
+    index.restrict_ranges(reader, filter);
+  } else if (index.matches(reader)) {
+    std::vector<int> class_pos(MSG_CLASS_SIZE);
+    for (int c = 0; c < MSG_CLASS_SIZE; c++) class_pos[c] = c;
+    index.seek(reader, filter, start, class_pos, msg_reads);
+  }
+
   int64_t o = 0;
   int msg_size;
   bool max_ts_reached = false;
 
-  while (bytes_read < filesize && !max_ts_reached) {
+  while (!max_ts_reached && (this_buffer_size = reader.next_block(ibuf)) > 0) {
     Rcpp::checkUserInterrupt();
 
-    // read in buffer buffers
-    this_buffer_size = fread(ibuf, 1, buf_size, ifile);
     int64_t i = 0;
-    msg_size = 0;
-
-    do {
+    while (has_full_message(ibuf, i, this_buffer_size)) {
       // check early stop in max_timestamp
       const int64_t cur_ts = getNBytes64<6>(&ibuf[i + 2 + 5]);
-      if (cur_ts > max_ts_val) {
+      if (cur_ts > filter.max_ts) {
         max_ts_reached = true;
         break;
       }
 
       const unsigned char mt = ibuf[i + 2];
-      // Check Filter Messages
-      bool parse_message = true;
-      // only check the filter if previous tests are all OK
-      if (parse_message)
-        parse_message = passes_filter(&ibuf[i + 2], filter_msgs);
-      if (parse_message)
-        parse_message = passes_filter(&ibuf[i + 2 + 1], filter_sloc);
-      if (parse_message)
-        parse_message = passes_filter_in(&ibuf[i + 2 + 5], min_ts, max_ts);
+      // Check Filter Messages, the lineage has to see every message
+      const bool in_lineage = !lineage.active || lineage.passes(&ibuf[i + 2]);
+      bool parse_message = in_lineage && filter.passes(&ibuf[i + 2]);
       // use TYPE_CLASS_TRANSLATOR as we count per message class not per msg_type!
       if (parse_message) {
         // count here the msg_reads to make sure that the count is within the
@@ -158,15 +121,9 @@ void filter_itch_impl(std::string infile, std::string outfile,
 
       msg_count++;
       i += msg_size;
-      // 50 = max msg_size
-    } while (i + 50 <= this_buffer_size && bytes_read + i <= filesize);
-
-    // offset file pointer to fit the next message into the buffer
-    const int64_t offset = i - this_buffer_size;
-    // Rprintf("Filter ibuf at %6lld offsetting by %3lld - Total bytes read %lld\n",
-    //         i, offset, bytes_read + i);
-    fseeko64(ifile, offset, SEEK_CUR);
-    bytes_read += i;
+    }
+
+    reader.consume(i);
   }
 
   if (o > 0) {
@@ -177,14 +134,11 @@ void filter_itch_impl(std::string infile, std::string outfile,
 
   if (!quiet) {
     Rprintf("[Bytes]      scanned %lld, filtered %lld\n",
-            (long long int) filesize, (long long int) bytes_written + o);
+            (long long int) reader.bytes_read, (long long int) bytes_written + o);
     Rprintf("[Messages]   scanned %lld, filtered %lld\n",
             (long long int) msg_count, (long long int) msg_read);
   }
 
-  free(ibuf);
-  fclose(ifile);
-
   free(obuf);
   fclose(ofile);
 }
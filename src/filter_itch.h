@@ -4,6 +4,9 @@
 #include <Rcpp.h>
 #include "specifications.h"
 #include "helper_functions.h"
+#include "itch_reader.h"
+#include "message_filter.h"
+#include "itch_index.h"
 
 void filter_itch_impl(std::string infile, std::string outfile,
                       int64_t start, int64_t end,
@@ -11,8 +14,10 @@ void filter_itch_impl(std::string infile, std::string outfile,
                       Rcpp::IntegerVector filter_stock_locate,
                       Rcpp::NumericVector min_timestamp,
                       Rcpp::NumericVector max_timestamp,
+                      Rcpp::List filter_payload,
                       bool append = false,
                       int64_t max_buffer_size = 1e8,
-                      bool quiet = false);
+                      bool quiet = false,
+                      std::string index_file = "");
 
 #endif // FILTERITCH_H
\ No newline at end of file
@@ -6,6 +6,12 @@ int get_message_size(const unsigned char msg) {
   return MSG_SIZES[msg - 'A'] + 2;
 }
 
+// the position of a message class in MSG_CLASSES, -1 if not found
+int get_class_position(const std::string &cls) {
+  for (int i = 0; i < MSG_CLASS_SIZE; i++) if (MSG_CLASSES[i] == cls) return i;
+  return -1;
+}
+
 // the count_messages_internal function is optimized and therefore contains
 // unused messages (they are used for faster access speeds!)
 // (see also Specifications.h)
@@ -68,33 +74,74 @@ Rcpp::NumericVector to_int64(Rcpp::NumericVector v) {
   return v;
 }
 
-// helper functions that check if a buffer value is in a vector of filters
-// equivalent of R buf_val %in% filter
-bool passes_filter(unsigned char* buf, std::vector<char> &filter) {
-  if (filter.size() == 0) return true;
-  for (unsigned char cc : filter) if (cc == *buf) return true;
-  return false;
-}
-// same helper function as before but for int vector
-bool passes_filter(unsigned char* buf, std::vector<int> &filter) {
-  if (filter.size() == 0) return true;
-  const int val = (int) getNBytes32<2>(&buf[0]);
-  for (int cc : filter) if (cc == val) return true;
-  return false;
-}
-// check larger/smaller inclusive for 6 byte numbers (timestamp)
-// equivalent to R (buf_val >= lower & buf_val <= upper)
-bool passes_filter_in(unsigned char* buf,
-                      std::vector<int64_t> &lower,
-                      std::vector<int64_t> &upper) {
-  // lower and upper have the same size!
-  if (lower.size() == 0) return true;
-  const int64_t val = getNBytes64<6>(buf);
-  for (size_t i = 0; i < lower.size(); i++) {
-    if (val >= lower[i] && val <= upper[i]) return true;
+// converts a string stored as n big endian bytes back to a std::string,
+// whitespaces are dropped for strings longer than one byte (as in getNBytes)
+std::string key_to_string(int64_t key, const int n) {
+  if (key == BLANK_KEY) return " ";
+  unsigned char buf[8];
+  for (int i = n - 1; i >= 0; --i) {
+    buf[i] = key & 0xff;
+    key >>= 8;
   }
+  if (n == 1) return std::string(1, buf[0]);
+  return getNBytes(buf, n);
+}
+
+StringCache::StringCache(const int n) : n(n) {
+  for (int i = 0; i < 256; i++) bytes[i] = NULL;
+}
+
+SEXP StringCache::get(const int64_t key) {
+  if (key == NA_INT64) return NA_STRING;
+
+  if (n == 1) {
+    const unsigned char c = key & 0xff;
+    if (bytes[c] == NULL) bytes[c] = Rf_mkCharLen((const char*) &c, 1);
+    return bytes[c];
+  }
+
+  auto it = keys.find(key);
+  if (it != keys.end()) return it->second;
+
+  // same as key_to_string() but without the std::string
+  char buf[8];
+  int len = 0;
+  if (key == BLANK_KEY) buf[len++] = ' ';
+  for (int i = n - 1; key != BLANK_KEY && i >= 0; --i) {
+    const char c = (key >> (8 * i)) & 0xff;
+    if (c != ' ') buf[len++] = c;
+  }
+  SEXP res = Rf_mkCharLen(buf, len);
+  keys[key] = res;
+  return res;
+}
 
-  return false;
+// helper functions that convert the parsed std::vectors to R vectors
+Rcpp::IntegerVector to_integer(const std::vector<int> &v, int64_t n) {
+  return Rcpp::IntegerVector(v.begin(), v.begin() + n);
+}
+
+Rcpp::LogicalVector to_logical(const std::vector<int> &v, int64_t n) {
+  return Rcpp::LogicalVector(v.begin(), v.begin() + n);
+}
+
+Rcpp::NumericVector to_numeric(const std::vector<double> &v, int64_t n) {
+  return Rcpp::NumericVector(v.begin(), v.begin() + n);
+}
+
+Rcpp::NumericVector to_int64(const std::vector<int64_t> &v, int64_t n) {
+  Rcpp::NumericVector res(n);
+  if (n > 0) std::memcpy(&(res[0]), v.data(), n * sizeof(int64_t));
+  return to_int64(res);
+}
+
+Rcpp::CharacterVector to_character(const std::vector<int64_t> &v, int64_t n,
+                                   const int n_bytes) {
+  Rcpp::CharacterVector res(n);
+  // most values repeat (e.g., stocks, flags), each CHARSXP is created once
+  StringCache cache(n_bytes);
+  for (int64_t i = 0; i < n; i++) SET_STRING_ELT(res, i, cache.get(v[i]));
+  return res;
 }
 
 // sets inside a unsigned char buffer b, 2 bytes from the value val, returns number of bytes changed
@@ -148,16 +195,17 @@ uint64_t set8bytes(unsigned char* b, int64_t val) {
 }
 // sets inside a unsigned char buffer b, n bytes from the string x, returns number of bytes changed
 // i.e., "UFO" with 8 to 0x55534f2020202020 (filled with whitespaces)
+// longer strings are cut to n bytes, no R functions are used (thread-safe)
+uint64_t setCharBytes(unsigned char* b, const char * x, uint64_t n) {
+  const uint64_t len = strlen(x);
+  // copy the string x, filled with n spaces
+  for (uint64_t j = 0; j < n; j++) b[j] = j < len ? x[j] : ' ';
+  return n;
+}
+
 uint64_t setCharBytes(unsigned char* b, std::string x, uint64_t n) {
-  unsigned char *st = new unsigned char[n + 1];
   if (x.size() > n)
     Rprintf("ERROR: setChar Bytes for string '%s' larger than capacity %llu\n",
             x.c_str(), (long long unsigned int) n);
-  for (uint64_t j = 0; j < n; j++) st[j] = ' '; // fill with n spaces
-  for (uint64_t j = 0; j < x.size(); j++) st[j] = x[j]; // copy the string x
-  memcpy(b, st, n);
-  // Rprintf("Set %i unsigned char Bytes from '%s' -> 0x %02x %02x %02x %02x %02x %02x %02x %02x\n",
-  //         n, x.c_str(), b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7]);
-  delete[] st;
-  return n;
+  return setCharBytes(b, x.c_str(), n);
 }
@@ -3,11 +3,14 @@
 
 #include <Rcpp.h>
 #include "specifications.h"
+#include <unordered_map>
 
 // get the message size for a char
 int get_message_size(const unsigned char msg);
 // converts from the long form (MSG_NAMES) to the shorter used form (ACT_MST_NAMES)
 std::vector<int64_t> take_needed_messages(std::vector<int64_t> &v);
+// the position of a message class in MSG_CLASSES, -1 if not found
+int get_class_position(const std::string &cls);
 // formats a number with thousands separator
 std::string format_thousands(int64_t num,
                              const std::string sep = ",",
@@ -41,17 +44,39 @@ std::string getNBytes(unsigned char* buf, const int n = 8, const unsigned char e
 // converts a numeric vector to integer64
 Rcpp::NumericVector to_int64(Rcpp::NumericVector v);
 
-// function that checks if a buffer passes a filter
-bool passes_filter(unsigned char* buf, std::vector<char> &filter);
-bool passes_filter(unsigned char* buf, std::vector<int> &filter);
-bool passes_filter_in(unsigned char* buf, std::vector<int64_t> &lower,
-                      std::vector<int64_t> &upper);
+// short strings of n <= 8 bytes are stored as their big endian value
+// (see getNBytes64), NA_INT64 marks a missing string
+std::string key_to_string(int64_t key, const int n);
+
+// interns the CHARSXPs of string keys of width n: every distinct key is
+// converted to a CHARSXP only once, single bytes use a table of 256 entries.
+// Note: the CHARSXPs are not protected, they must be put into a (protected)
+// character vector before the next allocation and the cache must not outlive it
+class StringCache {
+public:
+  explicit StringCache(const int n);
+  SEXP get(const int64_t key);
+
+private:
+  const int n;
+  SEXP bytes[256];
+  std::unordered_map<int64_t, SEXP> keys;
+};
+
+// convert the first n parsed values to R vectors, v is not changed
+Rcpp::IntegerVector   to_integer(const std::vector<int> &v, int64_t n);
+Rcpp::LogicalVector   to_logical(const std::vector<int> &v, int64_t n);
+Rcpp::NumericVector   to_numeric(const std::vector<double> &v, int64_t n);
+Rcpp::NumericVector   to_int64(const std::vector<int64_t> &v, int64_t n);
+Rcpp::CharacterVector to_character(const std::vector<int64_t> &v, int64_t n,
+                                   const int n_bytes);
 
 // set functions, set X bytes in a buffer
 uint64_t set2bytes(unsigned char* b, int32_t val);
 uint64_t set4bytes(unsigned char* b, int32_t val);
 uint64_t set6bytes(unsigned char* b, int64_t val);
 uint64_t set8bytes(unsigned char* b, int64_t val);
+uint64_t setCharBytes(unsigned char* b, const char * x, uint64_t n);
 uint64_t setCharBytes(unsigned char* b, std::string x, uint64_t n);
 
 #endif //HELPERFUNCTIONS_H
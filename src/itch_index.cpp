@@ -0,0 +1,326 @@
+#include "itch_index.h"
+
+#ifdef __APPLE__
+#  define fseeko64 fseeko
+#  define ftello64 ftello
+#endif
+
+// the header of an index file: magic bytes, version, number of message types
+// (i.e., the size of the counts), the fingerprint of the file, every, number
+// of checkpoints.
+// The checkpoints are followed by the number of postings (-1 if not built),
+// the stock_locate, number of runs, and number of bytes of each posting, and
+// the varint encoded runs of all postings
+const char INDEX_MAGIC[8] = {'R', 'I', 'T', 'C', 'H', 'I', 'D', 'X'};
+const int32_t INDEX_VERSION = 2;
+
+// unsigned LEB128, 7 bits per byte, the high bit marks that more bytes follow
+static void put_varint(std::vector<unsigned char> &out, uint64_t x) {
+  while (x >= 0x80) {
+    out.push_back((unsigned char) (x | 0x80));
+    x >>= 7;
+  }
+  out.push_back((unsigned char) x);
+}
+
+static uint64_t get_varint(const std::vector<unsigned char> &in, size_t &i) {
+  uint64_t x = 0;
+  int shift = 0;
+  while (i < in.size()) {
+    const unsigned char b = in[i++];
+    x |= (uint64_t) (b & 0x7f) << shift;
+    if (!(b & 0x80)) break;
+    shift += 7;
+  }
+  return x;
+}
+
+ItchIndex::ItchIndex(std::string index_file) : filename(index_file) {
+  if (index_file == "") return;
+  FILE* infile = fopen(index_file.c_str(), "rb");
+  if (infile == NULL) return;
+
+  char magic[8];
+  int32_t version, n_types;
+  int64_t n_checkpoints;
+  bool ok = fread(magic, 1, 8, infile) == 8 &&
+    std::memcmp(magic, INDEX_MAGIC, 8) == 0 &&
+    fread(&version, sizeof(int32_t), 1, infile) == 1 &&
+    version == INDEX_VERSION &&
+    fread(&n_types, sizeof(int32_t), 1, infile) == 1 &&
+    n_types == N_TYPES &&
+    fread(&fingerprint, sizeof(FileFingerprint), 1, infile) == 1 &&
+    fread(&every, sizeof(int64_t), 1, infile) == 1 &&
+    fread(&n_checkpoints, sizeof(int64_t), 1, infile) == 1 &&
+    n_checkpoints > 0;
+
+  if (ok) {
+    checkpoints.resize(n_checkpoints);
+    ok = fread(&checkpoints[0], sizeof(IndexCheckpoint), n_checkpoints,
+               infile) == (size_t) n_checkpoints &&
+      fread(&n_postings, sizeof(int64_t), 1, infile) == 1;
+  }
+
+  // the directory of the postings, the runs are read in find_ranges()
+  if (ok && n_postings > 0) {
+    postings.resize(n_postings);
+    int64_t pos = ftello64(infile) + n_postings * 3 * sizeof(int64_t);
+    for (IndexPosting &p : postings) {
+      ok = ok && fread(&p, sizeof(int64_t), 3, infile) == 3;
+      p.pos = pos;
+      pos += p.n_bytes;
+    }
+  }
+  fclose(infile);
+
+  valid = ok;
+  if (!valid) {
+    checkpoints.clear();
+    postings.clear();
+    n_postings = -1;
+  }
+}
+
+bool ItchIndex::matches(const ItchReader &reader) const {
+  return valid && fingerprint.matches(reader.fingerprint);
+}
+
+int64_t ItchIndex::find_start(const MessageFilter &filter, int64_t start,
+                              const std::vector<int> &classes,
+                              std::vector<int64_t> &class_counts) const {
+  class_counts.assign(MSG_CLASS_SIZE, 0);
+  if (!valid) return 0;
+
+  // all messages before a checkpoint have a timestamp of at most the
+  // timestamp of the checkpoint as the messages are ordered by timestamp
+  const int64_t min_ts = filter.min_ts();
+  if (min_ts > 0) {
+    int64_t offset = 0;
+    for (const IndexCheckpoint &cp : checkpoints) {
+      if (cp.timestamp >= min_ts) break;
+      offset = cp.offset;
+    }
+    return offset;
+  }
+
+  if (start <= 0 || !filter.only_msg_type()) return 0;
+
+  // the last checkpoint with at most start messages of each class before it
+  int64_t offset = 0;
+  std::vector<int64_t> cp_counts(MSG_CLASS_SIZE);
+  for (const IndexCheckpoint &cp : checkpoints) {
+    std::fill(cp_counts.begin(), cp_counts.end(), 0);
+    for (int t = 0; t < N_TYPES; t++) {
+      const int cls = TYPE_CLASS_TRANSLATOR[t];
+      if (cls >= 0 && filter.passes_msg_type('A' + t))
+        cp_counts[cls] += cp.counts[t];
+    }
+
+    bool skipped = true;
+    for (const int cls : classes)
+      if (cls >= 0 && cp_counts[cls] > start) skipped = false;
+    if (!skipped) break;
+
+    offset = cp.offset;
+    class_counts = cp_counts;
+  }
+  return offset;
+}
+
+std::vector<ByteRange> ItchIndex::find_ranges(const std::vector<int> &stock_locates) const {
+  std::vector<ByteRange> res;
+  if (!has_postings()) return res;
+
+  FILE* infile = fopen(filename.c_str(), "rb");
+  if (infile == NULL) {
+    char buffer [50];
+    snprintf(buffer, sizeof(buffer), "Index File Error number %i!", errno);
+    Rcpp::stop(buffer);
+  }
+
+  std::vector<unsigned char> bytes;
+  for (const int sl : stock_locates) {
+    auto it = std::lower_bound(
+      postings.begin(), postings.end(), (int64_t) sl,
+      [](const IndexPosting &p, int64_t s) { return p.stock_locate < s; }
+    );
+    if (it == postings.end() || it->stock_locate != sl) continue;
+
+    bytes.resize(it->n_bytes);
+    if (fseeko64(infile, it->pos, SEEK_SET) != 0 ||
+        (it->n_bytes > 0 &&
+         fread(&bytes[0], 1, it->n_bytes, infile) != (size_t) it->n_bytes)) {
+      fclose(infile);
+      Rcpp::stop("Could not read the postings of the index file '%s'",
+                 filename.c_str());
+    }
+
+    size_t i = 0;
+    int64_t last_end = 0;
+    for (int64_t r = 0; r < it->n_runs; r++) {
+      ByteRange br;
+      br.offset = last_end + (int64_t) get_varint(bytes, i);
+      br.size = (int64_t) get_varint(bytes, i);
+      last_end = br.offset + br.size;
+      res.push_back(br);
+    }
+  }
+  fclose(infile);
+
+  // merge the runs of the stock_locates into one sorted list of ranges
+  std::sort(res.begin(), res.end(),
+            [](const ByteRange &a, const ByteRange &b) { return a.offset < b.offset; });
+  size_t n = 0;
+  for (size_t r = 0; r < res.size(); r++) {
+    if (n > 0 && res[n - 1].offset + res[n - 1].size == res[r].offset) {
+      res[n - 1].size += res[r].size;
+    } else {
+      res[n++] = res[r];
+    }
+  }
+  res.resize(n);
+  return res;
+}
+
+void ItchIndex::seek(ItchReader &reader, const MessageFilter &filter,
+                     int64_t start, const std::vector<int> &classes,
+                     std::vector<int64_t> &class_counts) const {
+  reader.seek(find_start(filter, start, classes, class_counts));
+  restrict_ranges(reader, filter);
+}
+
+void ItchIndex::restrict_ranges(ItchReader &reader,
+                                const MessageFilter &filter) const {
+  // the messages of other stock_locates do not pass the filter, they are not
+  // read at all
+  const std::vector<int> stock_locates = filter.stock_locate_values();
+  if (!reader.gz && has_postings() && stock_locates.size() > 0)
+    reader.set_ranges(find_ranges(stock_locates));
+}
+
+// the runs of consecutive messages of a stock_locate while building an index
+struct PostingBuilder {
+  std::vector<unsigned char> bytes;
+  int64_t n_runs = 0, run_start = -1, run_end = 0, last_end = 0;
+
+  void add(int64_t offset, int64_t size) {
+    if (run_start >= 0 && offset == run_end) {
+      run_end += size;
+      return;
+    }
+    flush();
+    run_start = offset;
+    run_end = offset + size;
+  }
+
+  void flush() {
+    if (run_start < 0) return;
+    put_varint(bytes, run_start - last_end);
+    put_varint(bytes, run_end - run_start);
+    last_end = run_end;
+    n_runs++;
+    run_start = -1;
+  }
+};
+
+// [[Rcpp::export]]
+int64_t build_itch_index_impl(std::string filename, std::string index_file,
+                              int64_t every, bool by_stock,
+                              int64_t max_buffer_size, bool quiet) {
+  if (every < 1) Rcpp::stop("every must be at least 1");
+
+  // locate codes have 2 bytes
+  std::vector<PostingBuilder> postings(by_stock ? 65536 : 0);
+
+  ItchReader reader(filename, max_buffer_size);
+
+  std::vector<IndexCheckpoint> checkpoints;
+  IndexCheckpoint cp;
+  std::memset(&cp, 0, sizeof(IndexCheckpoint));
+
+  unsigned char * buf;
+  int64_t this_buffer_size, n_msgs = 0, last_ts = 0;
+
+  while ((this_buffer_size = reader.next_block(buf)) > 0) {
+    Rcpp::checkUserInterrupt();
+
+    int64_t i = 0;
+    while (has_full_message(buf, i, this_buffer_size)) {
+      const unsigned char mt = buf[i + 2];
+      last_ts = getNBytes64<6>(&buf[i + 2 + 5]);
+      const int msg_size = get_message_size(mt);
+      if (n_msgs % every == 0) {
+        cp.offset = reader.bytes_read + i;
+        cp.timestamp = last_ts;
+        checkpoints.push_back(cp);
+      }
+      if (by_stock)
+        postings[getNBytes32<2>(&buf[i + 2 + 1])].add(reader.bytes_read + i,
+                                                      msg_size);
+      cp.counts[mt - 'A']++;
+      n_msgs++;
+      i += msg_size;
+    }
+
+    reader.consume(i);
+  }
+
+  // the last checkpoint holds the total counts, its timestamp is the one of
+  // the last message
+  cp.offset = reader.bytes_read;
+  cp.timestamp = last_ts;
+  checkpoints.push_back(cp);
+
+  FILE* ofile = fopen(index_file.c_str(), "wb");
+  if (ofile == NULL) {
+    char buffer [50];
+    snprintf(buffer, sizeof(buffer), "Output File Error number %i!", errno);
+    Rcpp::stop(buffer);
+  }
+
+  const int32_t n_types = N_TYPES;
+  const int64_t n_checkpoints = checkpoints.size();
+  fwrite(INDEX_MAGIC, 1, 8, ofile);
+  fwrite(&INDEX_VERSION, sizeof(int32_t), 1, ofile);
+  fwrite(&n_types, sizeof(int32_t), 1, ofile);
+  fwrite(&reader.fingerprint, sizeof(FileFingerprint), 1, ofile);
+  fwrite(&every, sizeof(int64_t), 1, ofile);
+  fwrite(&n_checkpoints, sizeof(int64_t), 1, ofile);
+  bool ok = fwrite(&checkpoints[0], sizeof(IndexCheckpoint), n_checkpoints,
+                   ofile) == (size_t) n_checkpoints;
+
+  // only stock_locates with messages get a posting
+  int64_t n_postings = by_stock ? 0 : -1;
+  for (PostingBuilder &p : postings) {
+    p.flush();
+    if (p.n_runs > 0) n_postings++;
+  }
+  ok = ok && fwrite(&n_postings, sizeof(int64_t), 1, ofile) == 1;
+  for (size_t s = 0; s < postings.size(); s++) {
+    if (postings[s].n_runs == 0) continue;
+    const int64_t dir[3] = {(int64_t) s, postings[s].n_runs,
+                            (int64_t) postings[s].bytes.size()};
+    ok = ok && fwrite(dir, sizeof(int64_t), 3, ofile) == 3;
+  }
+  for (PostingBuilder &p : postings) {
+    if (p.n_runs == 0) continue;
+    ok = ok && fwrite(&p.bytes[0], 1, p.bytes.size(), ofile) == p.bytes.size();
+  }
+  fclose(ofile);
+
+  if (!ok) {
+    remove(index_file.c_str());
+    Rcpp::stop("Could not write index file '%s'", index_file.c_str());
+  }
+
+  if (!quiet) {
+    Rprintf("[Index]      %s messages, %s checkpoints\n",
+            format_thousands(n_msgs).c_str(),
+            format_thousands(n_checkpoints).c_str());
+    if (by_stock)
+      Rprintf("[Index]      %s stock_locates\n",
+              format_thousands(n_postings).c_str());
+  }
+
+  return n_checkpoints;
+}
@@ -0,0 +1,105 @@
+#ifndef ITCHINDEX_H
+#define ITCHINDEX_H
+
+#include <Rcpp.h>
+#include "specifications.h"
+#include "helper_functions.h"
+#include "itch_reader.h"
+#include "message_filter.h"
+
+/*
+ * ItchIndex, a sidecar file of an ITCH file (see build_itch_index() in R)
+ *   holding checkpoints every n messages, each checkpoint has
+ *
+ * - the byte offset of a message in the (uncompressed) file
+ * - the timestamp of that message
+ * - the number of messages per message type before that offset
+ *
+ * The first checkpoint is at offset 0, the last one at the end of the file
+ * (i.e., it holds the total counts), the values are stored as native int64.
+ *
+ * Optionally, the index holds the postings of each stock_locate, i.e., the
+ * runs of consecutive messages of a stock_locate as byte ranges. The runs of
+ * a stock_locate are stored as varints of the gap to the end of the previous
+ * run and the size of the run, only the postings of the filtered
+ * stock_locates are read from the index file.
+ *
+ * The main usage is
+ *
+ *   ItchIndex index(index_file);
+ *   if (index.matches(reader)) {
+ *     std::vector<int64_t> class_counts;
+ *     index.seek(reader, filter, start, classes, class_counts);
+ *   }
+ */
+struct IndexCheckpoint {
+  int64_t offset;
+  int64_t timestamp;
+  int64_t counts[N_TYPES];
+};
+
+// the location of the postings of a stock_locate in the index file
+struct IndexPosting {
+  int64_t stock_locate;
+  int64_t n_runs;
+  int64_t n_bytes;
+  int64_t pos;
+};
+
+class ItchIndex {
+public:
+  // reads the index, valid is false if the file does not exist or is not an
+  // index file (an empty filename is allowed)
+  ItchIndex(std::string index_file);
+
+  // checks that the index belongs to the content of the file of the reader
+  // (see FileFingerprint)
+  bool matches(const ItchReader &reader) const;
+
+  // finds the offset at which parsing can start, such that the skipped
+  // messages would not have been parsed: either all of them are before the
+  // min timestamp of the filter or, if only message types are filtered, at
+  // most start messages of each of the classes (positions in MSG_CLASSES)
+  // were skipped. class_counts holds the number of skipped messages passing
+  // the filter per class
+  int64_t find_start(const MessageFilter &filter, int64_t start,
+                     const std::vector<int> &classes,
+                     std::vector<int64_t> &class_counts) const;
+
+  // the byte ranges of the messages of the stock_locates, sorted by offset
+  std::vector<ByteRange> find_ranges(const std::vector<int> &stock_locates) const;
+
+  // moves the reader to find_start() and restricts it (see restrict_ranges)
+  void seek(ItchReader &reader, const MessageFilter &filter, int64_t start,
+            const std::vector<int> &classes,
+            std::vector<int64_t> &class_counts) const;
+
+  // for plain files with postings and a stock_locate filter, restricts the
+  // reader to the ranges of the stock_locates
+  void restrict_ranges(ItchReader &reader, const MessageFilter &filter) const;
+
+  // the total counts per message type
+  const int64_t * total_counts() const { return checkpoints.back().counts; }
+
+  bool has_postings() const { return valid && n_postings >= 0; }
+
+  bool valid = false;
+  FileFingerprint fingerprint;
+  int64_t every = 0;
+  std::vector<IndexCheckpoint> checkpoints;
+
+private:
+  std::string filename;
+  // -1 if the postings were not built
+  int64_t n_postings = -1;
+  // sorted by stock_locate
+  std::vector<IndexPosting> postings;
+};
+
+// Entry function to build the index of an ITCH file
+int64_t build_itch_index_impl(std::string filename, std::string index_file,
+                              int64_t every, bool by_stock,
+                              int64_t max_buffer_size = 1e8,
+                              bool quiet = false);
+
+#endif // ITCHINDEX_H
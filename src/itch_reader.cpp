@@ -0,0 +1,291 @@
+#include "itch_reader.h"
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#ifdef __APPLE__
+#  define fseeko64 fseeko
+#endif
+
+ItchReader::ItchReader(std::string filename, int64_t max_buffer_size) {
+  // a block must hold at least one message (max message size is 52)
+  block_size = max_buffer_size < 52 ? 52 : max_buffer_size;
+
+  // gz-archives start with the magic bytes 0x1f 0x8b
+  unsigned char magic[2] = {0, 0};
+  FILE* infile = fopen(filename.c_str(), "rb");
+  if (infile == NULL) {
+    char buffer [50];
+    snprintf(buffer, sizeof(buffer), "File Error number %i!", errno);
+    Rcpp::stop(buffer);
+  }
+  const size_t n_magic = fread(magic, 1, 2, infile);
+  fclose(infile);
+  gz = n_magic == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+
+  if (gz) {
+    gzfile = gzopen(filename.c_str(), "rb");
+    if (gzfile == NULL) {
+      Rcpp::stop("Could not open file '%s' for gunzip", filename.c_str());
+    }
+    gzbuffer(gzfile, 1 << 17);
+
+    data = (unsigned char*) malloc(block_size);
+    if (data == NULL) {
+      unmap();
+      Rcpp::stop("Out of Memory");
+    }
+    read_gz_fingerprint(filename);
+    return;
+  }
+
+#ifdef _WIN32
+  file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL);
+  if (file_handle == INVALID_HANDLE_VALUE) {
+    file_handle = NULL;
+    char buffer [50];
+    snprintf(buffer, sizeof(buffer), "File Error number %lu!",
+             (unsigned long) GetLastError());
+    Rcpp::stop(buffer);
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_handle, &size)) {
+    CloseHandle(file_handle);
+    Rcpp::stop("Error getting file size");
+  }
+  filesize = (int64_t) size.QuadPart;
+  fingerprint.size = filesize;
+  fingerprint.size32 = (uint32_t) filesize;
+  if (filesize == 0) return;
+
+  map_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (map_handle != NULL)
+    data = (unsigned char*) MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0);
+  if (data == NULL) {
+    unmap();
+    Rcpp::stop("Error mapping file into memory");
+  }
+#else
+  fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    char buffer [50];
+    snprintf(buffer, sizeof(buffer), "File Error number %i!", errno);
+    Rcpp::stop(buffer);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    unmap();
+    Rcpp::stop("Error getting file size");
+  }
+  filesize = (int64_t) st.st_size;
+  fingerprint.size = filesize;
+  fingerprint.size32 = (uint32_t) filesize;
+  if (filesize == 0) return;
+
+  void * ptr = mmap(NULL, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (ptr == MAP_FAILED) {
+    unmap();
+    Rcpp::stop("Error mapping file into memory");
+  }
+  data = (unsigned char*) ptr;
+
+  // the file is walked front to back exactly once: read ahead aggressively
+  madvise(data, filesize, MADV_SEQUENTIAL);
+#endif
+
+  fingerprint.head_crc = crc32(0L, data,
+                               (uInt) std::min(filesize, FINGERPRINT_BYTES));
+}
+
+// the head of the content is inflated with a separate stream, the size is
+// taken from the gzip trailer (CRC32 and ISIZE, both little endian)
+void ItchReader::read_gz_fingerprint(const std::string &filename) {
+  std::vector<unsigned char> head(FINGERPRINT_BYTES);
+  gzFile gzhead = gzopen(filename.c_str(), "rb");
+  const int n = gzhead == NULL ? 0 :
+    gzread(gzhead, &head[0], (unsigned int) head.size());
+  if (gzhead != NULL) gzclose(gzhead);
+  if (n > 0) fingerprint.head_crc = crc32(0L, &head[0], n);
+
+  unsigned char trailer[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  FILE* infile = fopen(filename.c_str(), "rb");
+  if (infile != NULL) {
+    if (fseeko64(infile, -8, SEEK_END) != 0 || fread(trailer, 1, 8, infile) != 8)
+      std::memset(trailer, 0, 8);
+    fclose(infile);
+  }
+  fingerprint.size = -1;
+  fingerprint.size32 = (uint32_t) trailer[4] | (uint32_t) trailer[5] << 8 |
+    (uint32_t) trailer[6] << 16 | (uint32_t) trailer[7] << 24;
+}
+
+ItchReader::~ItchReader() {
+  unmap();
+}
+
+void ItchReader::unmap() {
+  if (gz) {
+    if (data != NULL) free(data);
+    if (gzfile != NULL) gzclose(gzfile);
+    gzfile = NULL;
+    data = NULL;
+    return;
+  }
+
+#ifdef _WIN32
+  if (data != NULL) UnmapViewOfFile(data);
+  if (map_handle != NULL) CloseHandle(map_handle);
+  if (file_handle != NULL) CloseHandle(file_handle);
+  map_handle = NULL;
+  file_handle = NULL;
+#else
+  if (data != NULL) munmap(data, filesize);
+  if (fd != -1) close(fd);
+  fd = -1;
+#endif
+  data = NULL;
+}
+
+int64_t ItchReader::next_block(unsigned char * &buf) {
+  if (gz) {
+    // move the unconsumed (partial) message to the front and refill the
+    // rest of the buffer with newly inflated bytes
+    if (buf_start > 0) {
+      std::memmove(data, &data[buf_start], buf_end - buf_start);
+      buf_end -= buf_start;
+      buf_start = 0;
+    }
+
+    while (!gz_eof && buf_end < block_size) {
+      const int64_t n_max = block_size - buf_end > INT_MAX ?
+        INT_MAX :
+        block_size - buf_end;
+      const int n = gzread(gzfile, &data[buf_end], (unsigned int) n_max);
+      if (n < 0) Rcpp::stop("Error inflating gz file");
+      if (n == 0) gz_eof = true;
+      buf_end += n;
+    }
+
+    buf = data;
+    if (!has_full_message(buf, 0, buf_end)) return 0;
+    return buf_end;
+  }
+
+  int64_t end = filesize;
+  if (use_ranges) {
+    // move to the first range that is not yet fully consumed
+    while (range_idx < ranges.size() &&
+           bytes_read >= ranges[range_idx].offset + ranges[range_idx].size)
+      range_idx++;
+    if (range_idx == ranges.size()) return 0;
+
+    if (bytes_read < ranges[range_idx].offset)
+      bytes_read = ranges[range_idx].offset;
+    end = std::min(ranges[range_idx].offset + ranges[range_idx].size, filesize);
+  }
+
+  const int64_t remaining = end - bytes_read;
+  if (data == NULL || remaining <= 0) return 0;
+
+  buf = &data[bytes_read];
+  const int64_t size = remaining > block_size ? block_size : remaining;
+
+  // a truncated message at the end of the file is never handed out
+  if (!has_full_message(buf, 0, size)) return 0;
+  return size;
+}
+
+void ItchReader::consume(int64_t n) {
+  bytes_read += n;
+
+  if (gz) {
+    buf_start += n;
+    return;
+  }
+
+#ifndef _WIN32
+  // pages that are fully consumed are not needed anymore, drop them from the
+  // resident set instead of keeping the whole file mapped in memory
+  static const int64_t page_size = sysconf(_SC_PAGESIZE);
+  const int64_t release_to = (bytes_read / page_size) * page_size;
+  if (release_to - bytes_released >= block_size) {
+    madvise(&data[bytes_released], release_to - bytes_released, MADV_DONTNEED);
+    bytes_released = release_to;
+  }
+#endif
+}
+
+void ItchReader::seek(int64_t offset) {
+  if (offset <= 0) return;
+
+  if (gz) {
+    // gz-archives are inflated up to the offset
+#if defined(_LARGEFILE64_SOURCE) && _LFS64_LARGEFILE-0
+    if (gzseek64(gzfile, offset, SEEK_SET) != offset)
+      Rcpp::stop("Error seeking in gz file");
+#else
+    if ((int64_t) (z_off_t) offset == offset) {
+      if (gzseek(gzfile, (z_off_t) offset, SEEK_SET) != offset)
+        Rcpp::stop("Error seeking in gz file");
+    } else {
+      // z_off_t cannot hold the offset (32 bit), the bytes are read and dropped
+      if (gzrewind(gzfile) != 0) Rcpp::stop("Error seeking in gz file");
+      int64_t left = offset;
+      while (left > 0) {
+        const unsigned int n_max = left > block_size ?
+          (unsigned int) std::min<int64_t>(block_size, INT_MAX) :
+          (unsigned int) left;
+        const int n = gzread(gzfile, data, n_max);
+        if (n <= 0) Rcpp::stop("Error seeking in gz file");
+        left -= n;
+      }
+    }
+#endif
+    buf_start = 0;
+    buf_end = 0;
+  } else if (offset > filesize) {
+    offset = filesize;
+  }
+  bytes_read = offset;
+}
+
+void ItchReader::set_ranges(std::vector<ByteRange> r) {
+  if (gz) Rcpp::stop("gz-archives cannot be read in ranges");
+
+  ranges.clear();
+  for (const ByteRange &br : r)
+    if (br.offset + br.size > bytes_read) ranges.push_back(br);
+  range_idx = 0;
+  use_ranges = true;
+
+#ifndef _WIN32
+  // only parts of the file are read, reading ahead would load unused pages
+  if (data != NULL) madvise(data, filesize, MADV_RANDOM);
+#endif
+}
+
+std::vector<int64_t> ItchReader::split(int n) {
+  if (gz) Rcpp::stop("gz-archives cannot be split");
+
+  std::vector<int64_t> res(n + 1, bytes_read);
+  const int64_t size = filesize - bytes_read;
+  int64_t i = bytes_read;
+  int part = 1;
+  while (has_full_message(data, i, filesize)) {
+    // the next part starts at the first message after its target offset
+    while (part < n && i - bytes_read >= size / n * part) res[part++] = i;
+    i += get_message_size(data[i + 2]);
+  }
+  while (part <= n) res[part++] = i;
+  return res;
+}
@@ -0,0 +1,138 @@
+#ifndef ITCHREADER_H
+#define ITCHREADER_H
+
+#include <Rcpp.h>
+#include <zlib.h>
+#include "specifications.h"
+#include "helper_functions.h"
+
+// a range of whole messages in a file, [offset, offset + size)
+struct ByteRange {
+  int64_t offset;
+  int64_t size;
+};
+
+// the number of bytes at the start of the content that are part of a
+// FileFingerprint
+const int64_t FINGERPRINT_BYTES = 1 << 16;
+
+/*
+ * FileFingerprint, identifies the (uncompressed) content of an ITCH file for
+ *   the files that hold offsets into it (indices and checkpoints), i.e., a
+ *   plain file and its gz-archive have the same fingerprint.
+ *
+ * - size: the size of the content, -1 if not known (gz-archives)
+ * - size32: the size of the content modulo 2^32, for gz-archives the size
+ *   stored in their trailer (of the last member, i.e., archives with several
+ *   members do not match)
+ * - head_crc: the CRC32 of the first FINGERPRINT_BYTES of the content
+ */
+struct FileFingerprint {
+  int64_t size = -1;
+  uint32_t size32 = 0;
+  uint32_t head_crc = 0;
+
+  // the sizes are compared if both are known, otherwise size32
+  bool matches(const FileFingerprint &other) const {
+    if (head_crc != other.head_crc) return false;
+    if (size >= 0 && other.size >= 0) return size == other.size;
+    return size32 == other.size32;
+  }
+};
+
+/*
+ * ItchReader, a read-only view of an ITCH file that is shared by all
+ *   functions that walk over a file (read, filter, count, ...).
+ *
+ * Plain files are memory-mapped, the blocks handed out by next_block() point
+ * directly into the mapped pages, no bytes are copied into an extra buffer.
+ * gz-archives (detected by their magic bytes) are inflated on the fly into a
+ * buffer of max_buffer_size bytes, i.e., they are read in a single pass with
+ * constant memory and without writing the uncompressed file to disk.
+ *
+ * The main usage is
+ *
+ *   ItchReader reader(filename, max_buffer_size);
+ *   unsigned char * buf;
+ *   int64_t this_buffer_size;
+ *   while ((this_buffer_size = reader.next_block(buf)) > 0) {
+ *     int64_t i = 0;
+ *     while (has_full_message(buf, i, this_buffer_size)) {
+ *       // buf[i + 2] is the message type
+ *       i += get_message_size(buf[i + 2]);
+ *     }
+ *     reader.consume(i);
+ *   }
+ *
+ * A block starts at the first byte that was not yet consumed and is at most
+ * max_buffer_size bytes long, partial messages at the end of a block are
+ * not consumed and are therefore at the beginning of the next block.
+ * If the reader is restricted to byte ranges (see set_ranges()), the blocks
+ * lie within the ranges and the bytes between the ranges are never touched.
+ */
+class ItchReader {
+public:
+  ItchReader(std::string filename, int64_t max_buffer_size = 1e8);
+  ~ItchReader();
+
+  // sets buf to the next block and returns its size, 0 if no full message is left
+  int64_t next_block(unsigned char * &buf);
+  // marks the first n bytes of the current block as used
+  void consume(int64_t n);
+
+  // moves to offset (a message boundary, e.g., from an ItchIndex), must be
+  // called before the first block is read
+  void seek(int64_t offset);
+
+  // plain files only: restricts the blocks to the ranges (sorted by offset and
+  // not overlapping, e.g., from an ItchIndex), ranges before the current
+  // offset are dropped
+  void set_ranges(std::vector<ByteRange> r);
+  bool ranged() const { return use_ranges; }
+
+  // plain files only: splits the rest of the file (from the current offset)
+  // into n parts at message boundaries (found by walking over the message
+  // sizes), returns the n + 1 offsets
+  std::vector<int64_t> split(int n);
+  // plain files only: the mapped file, e.g., for parsing the parts of split()
+  unsigned char * mapped_data() { return data; }
+
+  // filesize is the size of a plain file (0 for gz-archives as the size of
+  // the content is not known upfront), bytes_read counts the consumed bytes
+  int64_t filesize = 0, bytes_read = 0;
+  bool gz = false;
+  // the fingerprint of the content, set when the file is opened
+  FileFingerprint fingerprint;
+
+private:
+  void unmap();
+  void read_gz_fingerprint(const std::string &filename);
+
+  // the mapped file or, for gz-archives, the inflate buffer
+  unsigned char * data = NULL;
+  int64_t block_size, bytes_released = 0;
+
+  // set_ranges() only: the ranges and the position of the current one
+  std::vector<ByteRange> ranges;
+  size_t range_idx = 0;
+  bool use_ranges = false;
+
+  // gz only: data[buf_start, buf_end) holds inflated but unconsumed bytes
+  gzFile gzfile = NULL;
+  int64_t buf_start = 0, buf_end = 0;
+  bool gz_eof = false;
+
+#ifdef _WIN32
+  // HANDLEs, windows.h is only included in the .cpp file
+  void * file_handle = NULL, * map_handle = NULL;
+#else
+  int fd = -1;
+#endif
+};
+
+// checks if buf holds a full message at offset i
+inline bool has_full_message(unsigned char * buf, int64_t i, int64_t size) {
+  return i + 3 <= size && i + get_message_size(buf[i + 2]) <= size;
+}
+
+#endif // ITCHREADER_H
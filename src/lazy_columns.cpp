@@ -0,0 +1,319 @@
+#include "lazy_columns.h"
+#include <memory>
+#include <Rversion.h>
+
+// Altrep.h uses class as a parameter name before R 3.6
+#if R_VERSION < R_Version(3, 6, 0)
+#define class klass
+extern "C" {
+#include <R_ext/Altrep.h>
+}
+#undef class
+#else
+#include <R_ext/Altrep.h>
+#endif
+
+// creates the ALTREP vector of a column (see below), prot is kept alive by it
+static SEXP make_lazy_column(LazyColumn * col, SEXP prot);
+
+// [[Rcpp::export]]
+Rcpp::List read_itch_lazy_impl(std::vector<std::string> classes,
+                               std::string filename,
+                               int64_t start, int64_t end,
+                               Rcpp::CharacterVector filter_msg_type,
+                               Rcpp::IntegerVector filter_stock_locate,
+                               Rcpp::NumericVector min_timestamp,
+                               Rcpp::NumericVector max_timestamp,
+                               Rcpp::List filter_payload,
+                               int64_t max_buffer_size,
+                               bool quiet,
+                               std::vector<std::string> columns,
+                               std::string index_file) {
+
+  const MessageFilter filter(filter_msg_type, filter_stock_locate,
+                             min_timestamp, max_timestamp, filter_payload);
+  OrderLineage lineage(filter_payload);
+
+  // the mapping is kept as long as a column of the file is alive
+  Rcpp::XPtr<ItchReader> reader(new ItchReader(filename, max_buffer_size), true);
+  if (reader->gz) Rcpp::stop("Lazy columns need a plain ITCH file");
+  unsigned char * data = reader->mapped_data();
+
+  // the messages per class (position in MSG_CLASSES), the lazy classes are
+  // owned by external pointers which keep the reader alive
+  std::vector<LazyClass*> lazy(MSG_CLASS_SIZE, NULL);
+  std::map<std::string, SEXP> class_ptrs;
+  Rcpp::List protect_ptrs;
+  for (const std::string &cls : classes) {
+    const int pos = get_class_position(cls);
+    if (pos < 0) Rcpp::stop("Message class '%s' cannot be read lazily", cls.c_str());
+    if (lazy[pos] != NULL) continue;
+
+    lazy[pos] = new LazyClass{cls, data, {}};
+    Rcpp::XPtr<LazyClass> ptr(lazy[pos], true, R_NilValue, reader);
+    protect_ptrs.push_back(ptr);
+    class_ptrs[cls] = ptr;
+  }
+
+  // as in read_itch_impl, the lineage needs all previous messages
+  ItchIndex index(index_file);
+  std::vector<int64_t> skipped(MSG_CLASS_SIZE, 0);
+  if (index.matches(*reader) && lineage.active) {
+    index.restrict_ranges(*reader, filter);
+  } else if (index.matches(*reader)) {
+    std::vector<int> class_pos;
+    for (const std::string &cls : classes)
+      class_pos.push_back(get_class_position(cls));
+    index.seek(*reader, filter, start, class_pos, skipped);
+  }
+
+  // skip and n_max per class (see MessageParser::next_row())
+  std::vector<int64_t> seen(MSG_CLASS_SIZE, 0), first(MSG_CLASS_SIZE), last(MSG_CLASS_SIZE);
+  for (int pos = 0; pos < MSG_CLASS_SIZE; pos++) {
+    first[pos] = start - skipped[pos];
+    last[pos] = end < 0 ? std::numeric_limits<int64_t>::max() : end - skipped[pos];
+  }
+
+  unsigned char * buf;
+  int64_t this_buffer_size, total_msgs = 0;
+  bool max_ts_reached = false;
+
+  while (!max_ts_reached && (this_buffer_size = reader->next_block(buf)) > 0) {
+    Rcpp::checkUserInterrupt();
+
+    int64_t i = 0;
+    while (has_full_message(buf, i, this_buffer_size)) {
+      unsigned char * msg = &buf[i + 2];
+      if (getNBytes64<6>(&msg[5]) > filter.max_ts) {
+        max_ts_reached = true;
+        break;
+      }
+
+      const bool in_lineage = !lineage.active || lineage.passes(msg);
+      if (in_lineage && filter.passes(msg) && msg[0] >= 'A' && msg[0] <= 'h') {
+        const int pos = TYPE_CLASS_TRANSLATOR[msg[0] - 'A'];
+        if (pos >= 0 && lazy[pos] != NULL) {
+          const int64_t k = seen[pos]++;
+          if (k >= first[pos] && k <= last[pos])
+            lazy[pos]->offsets.push_back(msg - data);
+        }
+      }
+
+      i += get_message_size(msg[0]);
+      total_msgs++;
+    }
+    reader->consume(i);
+  }
+
+  // the selected columns of each class, each requested column must exist in
+  // at least one of the classes
+  std::map<std::string, std::vector<std::string>> class_columns;
+  for (auto &cp : class_ptrs) {
+    std::unique_ptr<MessageParser> p(create_parser(cp.first, 0, -1));
+    p->select_columns(columns);
+    class_columns[cp.first] = p->column_names();
+  }
+  for (const std::string &col : columns) {
+    bool found = false;
+    for (auto &cc : class_columns)
+      if (std::find(cc.second.begin(), cc.second.end(), col) != cc.second.end())
+        found = true;
+    if (!found)
+      Rcpp::stop("Column '%s' not found in the selected message classes",
+                 col.c_str());
+  }
+
+  if (!quiet) {
+    Rprintf("[Counting]   num messages %s\n", format_thousands(total_msgs).c_str());
+    for (auto &cp : class_ptrs) {
+      const int64_t n = lazy[get_class_position(cp.first)]->offsets.size();
+      if (n != 0)
+        Rprintf("[Counting]   num '%s' messages %s\n",
+                cp.first.c_str(), format_thousands(n).c_str());
+    }
+  }
+
+  Rcpp::List res;
+  std::map<std::string, Rcpp::List> class_to_df;
+  for (const std::string &cls : classes) {
+    if (class_to_df.count(cls) == 0) {
+      const LazyClass * lc = lazy[get_class_position(cls)];
+      Rcpp::List df;
+      for (const std::string &col : class_columns[cls])
+        df.push_back(make_lazy_column(new LazyColumn(lc, col), class_ptrs[cls]));
+
+      // need to call data.table::setalloccol() on data in R!
+      df.names() = class_columns[cls];
+      df.attr("class") = Rcpp::StringVector::create("data.table", "data.frame");
+      class_to_df[cls] = df;
+    }
+    res.push_back(class_to_df[cls]);
+  }
+  res.attr("names") = classes;
+  return res;
+}
+
+SEXP LazyColumn::decode(int64_t from, int64_t n) const {
+  // the parser is released also if decoding throws (e.g., std::bad_alloc)
+  std::unique_ptr<MessageParser> p(create_parser(messages->cls, 0, -1));
+  p->select_columns({name});
+  p->init_vectors(n);
+  for (int64_t i = from; i < from + n; i++)
+    p->parse_function(p.get(), &messages->data[messages->offsets[i]]);
+
+  Rcpp::List df = p->get_data_frame();
+  return df[0];
+}
+
+// #############################################################################
+// ALTREP classes
+// #############################################################################
+
+// the class of the lazy columns per R type
+static R_altrep_class_t lazy_integer, lazy_real, lazy_string;
+#if R_VERSION >= R_Version(3, 6, 0)
+static R_altrep_class_t lazy_logical;
+#endif
+
+// data1 of a lazy column holds the LazyColumn, data2 the decoded values
+// (NULL until the column is used)
+static LazyColumn * lazy_column(SEXP x) {
+  return static_cast<LazyColumn*>(R_ExternalPtrAddr(R_altrep_data1(x)));
+}
+
+// decodes a region of the column, the result is not protected
+// Note: called from R, C++ exceptions must not leave the ALTREP methods
+static SEXP decode_region(SEXP x, int64_t from, int64_t n) {
+  char err[256];
+  try {
+    return lazy_column(x)->decode(from, n);
+  } catch (std::exception &e) {
+    snprintf(err, sizeof(err), "Error decoding lazy column: %s", e.what());
+  } catch (...) {
+    snprintf(err, sizeof(err), "Error decoding lazy column");
+  }
+  Rf_error("%s", err);
+}
+
+// the decoded values of the column, the whole column is decoded on first use
+static SEXP materialize(SEXP x) {
+  SEXP values = R_altrep_data2(x);
+  if (values == R_NilValue) {
+    values = decode_region(x, 0, lazy_column(x)->size());
+    R_set_altrep_data2(x, values);
+  }
+  return values;
+}
+
+static SEXP make_lazy_column(LazyColumn * col, SEXP prot) {
+  Rcpp::XPtr<LazyColumn> ptr(col, true, R_NilValue, prot);
+  // the type and class (e.g., integer64) from a column without values
+  Rcpp::RObject proto(col->decode(0, 0));
+
+  Rcpp::RObject res;
+  switch (TYPEOF(proto)) {
+  case INTSXP:  res = R_new_altrep(lazy_integer, ptr, R_NilValue); break;
+  case REALSXP: res = R_new_altrep(lazy_real, ptr, R_NilValue); break;
+  case STRSXP:  res = R_new_altrep(lazy_string, ptr, R_NilValue); break;
+#if R_VERSION >= R_Version(3, 6, 0)
+  case LGLSXP:  res = R_new_altrep(lazy_logical, ptr, R_NilValue); break;
+#endif
+  default:
+    // no ALTREP class for the type, the column is decoded right away
+    return col->decode(0, col->size());
+  }
+  if (proto.hasAttribute("class")) res.attr("class") = proto.attr("class");
+  return res;
+}
+
+static R_xlen_t lazy_length(SEXP x) {
+  return lazy_column(x)->size();
+}
+
+static Rboolean lazy_inspect(SEXP x, int, int, int, void (*)(SEXP, int, int, int)) {
+  Rprintf("lazy ITCH column '%s' (%s)\n", lazy_column(x)->column_name().c_str(),
+          R_altrep_data2(x) == R_NilValue ? "not decoded" : "decoded");
+  return TRUE;
+}
+
+static const void * lazy_dataptr_or_null(SEXP x) {
+  SEXP values = R_altrep_data2(x);
+  if (values == R_NilValue) return NULL;
+  return DATAPTR_RO(values);
+}
+
+static void * lazy_dataptr(SEXP x, Rboolean) {
+  return (void *) DATAPTR_RO(materialize(x));
+}
+
+// copies a region from the decoded values or decodes only the region
+template<typename T, T* (*ptr)(SEXP)>
+static R_xlen_t lazy_get_region(SEXP x, R_xlen_t i, R_xlen_t n, T * buf) {
+  const R_xlen_t len = lazy_column(x)->size();
+  if (i >= len) return 0;
+  if (i + n > len) n = len - i;
+
+  SEXP values = R_altrep_data2(x);
+  if (values != R_NilValue) {
+    std::memcpy(buf, ptr(values) + i, n * sizeof(T));
+    return n;
+  }
+  SEXP region = PROTECT(decode_region(x, i, n));
+  std::memcpy(buf, ptr(region), n * sizeof(T));
+  UNPROTECT(1);
+  return n;
+}
+
+static int lazy_integer_elt(SEXP x, R_xlen_t i) {
+  return INTEGER(materialize(x))[i];
+}
+
+static double lazy_real_elt(SEXP x, R_xlen_t i) {
+  return REAL(materialize(x))[i];
+}
+
+static SEXP lazy_string_elt(SEXP x, R_xlen_t i) {
+  return STRING_ELT(materialize(x), i);
+}
+
+static void lazy_string_set_elt(SEXP x, R_xlen_t i, SEXP v) {
+  SET_STRING_ELT(materialize(x), i, v);
+}
+
+#if R_VERSION >= R_Version(3, 6, 0)
+static int lazy_logical_elt(SEXP x, R_xlen_t i) {
+  return LOGICAL(materialize(x))[i];
+}
+#endif
+
+static void set_common_methods(R_altrep_class_t cls) {
+  R_set_altrep_Length_method(cls, lazy_length);
+  R_set_altrep_Inspect_method(cls, lazy_inspect);
+  R_set_altvec_Dataptr_method(cls, lazy_dataptr);
+  R_set_altvec_Dataptr_or_null_method(cls, lazy_dataptr_or_null);
+}
+
+// [[Rcpp::init]]
+void init_lazy_columns(DllInfo * dll) {
+  lazy_integer = R_make_altinteger_class("lazy_integer", "RITCH", dll);
+  set_common_methods(lazy_integer);
+  R_set_altinteger_Elt_method(lazy_integer, lazy_integer_elt);
+  R_set_altinteger_Get_region_method(lazy_integer, lazy_get_region<int, INTEGER>);
+
+  lazy_real = R_make_altreal_class("lazy_real", "RITCH", dll);
+  set_common_methods(lazy_real);
+  R_set_altreal_Elt_method(lazy_real, lazy_real_elt);
+  R_set_altreal_Get_region_method(lazy_real, lazy_get_region<double, REAL>);
+
+  lazy_string = R_make_altstring_class("lazy_string", "RITCH", dll);
+  set_common_methods(lazy_string);
+  R_set_altstring_Elt_method(lazy_string, lazy_string_elt);
+  R_set_altstring_Set_elt_method(lazy_string, lazy_string_set_elt);
+
+#if R_VERSION >= R_Version(3, 6, 0)
+  lazy_logical = R_make_altlogical_class("lazy_logical", "RITCH", dll);
+  set_common_methods(lazy_logical);
+  R_set_altlogical_Elt_method(lazy_logical, lazy_logical_elt);
+  R_set_altlogical_Get_region_method(lazy_logical, lazy_get_region<int, LOGICAL>);
+#endif
+}
@@ -0,0 +1,65 @@
+#ifndef LAZYCOLUMNS_H
+#define LAZYCOLUMNS_H
+
+#include <Rcpp.h>
+#include "specifications.h"
+#include "helper_functions.h"
+#include "itch_reader.h"
+#include "message_filter.h"
+#include "itch_index.h"
+#include "read_functions.h"
+
+// Entry function to read message classes with lazy columns, only the offsets
+// of the messages are collected, the values are decoded when a column is used
+Rcpp::List read_itch_lazy_impl(std::vector<std::string> classes,
+                               std::string filename,
+                               int64_t start, int64_t end,
+                               Rcpp::CharacterVector filter_msg_type,
+                               Rcpp::IntegerVector filter_stock_locate,
+                               Rcpp::NumericVector min_timestamp,
+                               Rcpp::NumericVector max_timestamp,
+                               Rcpp::List filter_payload,
+                               int64_t max_buffer_size = 1e8,
+                               bool quiet = false,
+                               std::vector<std::string> columns = {},
+                               std::string index_file = "");
+
+// the messages of one class in a mapped file, data points into the mapping
+// of an ItchReader, which must outlive the LazyClass
+struct LazyClass {
+  std::string cls;
+  unsigned char * data;
+  // the offsets of the messages (their message type) in file order
+  std::vector<int64_t> offsets;
+};
+
+/*
+ * LazyColumn, a column of a message class that is decoded on demand.
+ *
+ * The columns are returned as ALTREP vectors (see init_lazy_columns()), a
+ * column is decoded by the MessageParser of its class with only this column
+ * selected, i.e., by the same code as in read_itch_impl.
+ * The whole column is decoded when it is first used (e.g., its data pointer
+ * or an element is accessed) and kept afterwards, a region of a column that
+ * was not yet decoded (Get_region) is decoded without keeping it.
+ */
+class LazyColumn {
+public:
+  LazyColumn(const LazyClass * messages, std::string name) :
+    messages(messages), name(name) {}
+
+  int64_t size() const { return messages->offsets.size(); }
+  const std::string & column_name() const { return name; }
+  // decodes the values of the messages [from, from + n) into an R vector
+  SEXP decode(int64_t from, int64_t n) const;
+
+private:
+  const LazyClass * messages;
+  std::string name;
+};
+
+// registers the ALTREP classes of the lazy columns, called when the package
+// is loaded
+void init_lazy_columns(DllInfo * dll);
+
+#endif // LAZYCOLUMNS_H
@@ -0,0 +1,196 @@
+#include "lifetimes.h"
+
+// the status of an order as an 8 byte string (see key_to_string)
+static int64_t status_key(char status) {
+  const char * s = status == 'F' ? "filled  " :
+    status == 'C' ? "canceled" : "open    ";
+  return getNBytes64<8>((unsigned char *) s);
+}
+
+LifetimeTracker::LifetimeTracker() : stocks(65536, 0x2020202020202020) {
+  columns = {
+    {"order_ref", &order_ref}, {"stock_locate", &stock_locate},
+    {"stock", &stock}, {"buy", &buy}, {"price", &price}, {"shares", &shares},
+    {"timestamp", &timestamp}, {"first_fill_timestamp", &first_fill_timestamp},
+    {"end_timestamp", &end_timestamp}, {"lifetime", &lifetime},
+    {"filled_shares", &filled_shares}, {"canceled_shares", &canceled_shares},
+    {"n_replaces", &n_replaces}, {"status", &status}
+  };
+}
+
+void LifetimeTracker::write_state(const OrderLifetime &o) {
+  first_fill_timestamp[o.row] = o.first_fill;
+  filled_shares[o.row]        = o.filled_shares;
+  canceled_shares[o.row]      = o.canceled_shares;
+  n_replaces[o.row]           = o.n_replaces;
+}
+
+void LifetimeTracker::finish(int64_t ref, OrderLifetime &o, int64_t ts,
+                             char st) {
+  write_state(o);
+  end_timestamp[o.row] = ts;
+  lifetime[o.row]      = ts - timestamp[o.row];
+  status[o.row]        = status_key(st);
+  orders.erase(ref);
+}
+
+void LifetimeTracker::apply(unsigned char * buf) {
+  const int64_t ts = getNBytes64<6>(&buf[5]);
+  const int64_t ref = getNBytes64<8>(&buf[11]);
+
+  switch (buf[0]) {
+  case 'A':
+  case 'F': {
+    const int sl = getNBytes32<2>(&buf[1]);
+    stocks[sl] = getNBytes64<8>(&buf[24]);
+
+    // grow the columns geometrically if they are full
+    if (n_rows >= n_alloc) {
+      n_alloc = std::max(2 * n_alloc, (int64_t) 1024);
+      for (auto &col : columns) col.second->resize(n_alloc);
+    }
+
+    // the row holds the state of an open order until the order ends
+    const int64_t r = n_rows++;
+    const uint32_t n = getNBytes32<4>(&buf[20]);
+    order_ref[r]            = ref;
+    stock_locate[r]         = sl;
+    buy[r]                  = buf[19] == 'B';
+    price[r]                = ((double) getNBytes32<4>(&buf[32])) / 10000.0;
+    shares[r]               = n;
+    timestamp[r]            = ts;
+    first_fill_timestamp[r] = NA_INT64;
+    end_timestamp[r]        = NA_INT64;
+    lifetime[r]             = NA_INT64;
+    filled_shares[r]        = 0;
+    canceled_shares[r]      = 0;
+    n_replaces[r]           = 0;
+    status[r]               = status_key('O');
+
+    OrderLifetime &o = orders.insert(ref);
+    o.row             = r;
+    o.first_fill      = NA_INT64;
+    o.open_shares     = n;
+    o.filled_shares   = 0;
+    o.canceled_shares = 0;
+    o.n_replaces      = 0;
+    break;
+  }
+  case 'E': // executed shares
+  case 'C': // executed shares (at a different price)
+  case 'X': { // canceled shares
+    OrderLifetime * o = orders.find(ref);
+    if (o == NULL) break;
+    const uint32_t n = std::min((uint32_t) getNBytes32<4>(&buf[19]),
+                                o->open_shares);
+    if (buf[0] == 'X') {
+      o->canceled_shares += n;
+    } else {
+      o->filled_shares += n;
+      if (o->first_fill == NA_INT64) o->first_fill = ts;
+    }
+    o->open_shares -= n;
+    if (o->open_shares == 0) finish(ref, *o, ts, buf[0] == 'X' ? 'C' : 'F');
+    break;
+  }
+  case 'D': { // the remaining shares are canceled
+    OrderLifetime * o = orders.find(ref);
+    if (o == NULL) break;
+    o->canceled_shares += o->open_shares;
+    o->open_shares = 0;
+    finish(ref, *o, ts, 'C');
+    break;
+  }
+  case 'U': { // the order continues under the new order_ref
+    const OrderLifetime * orig = orders.find(ref);
+    if (orig == NULL) break;
+    OrderLifetime o = *orig;
+    orders.erase(ref);
+    o.open_shares = getNBytes32<4>(&buf[27]);
+    o.n_replaces++;
+    orders.insert(getNBytes64<8>(&buf[19])) = o;
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+Rcpp::List LifetimeTracker::get_data_frame() {
+  orders.for_each([this](uint64_t, const OrderLifetime &o) {
+    write_state(o);
+  });
+
+  const int64_t n = n_rows;
+  for (auto &col : columns) col.second->resize(n);
+  for (int64_t i = 0; i < n; i++) stock[i] = stocks[stock_locate[i]];
+
+  // the rows are in file order, i.e., ordered by the timestamp of the add
+  // orders, only orders with the same timestamp might need to be reordered
+  auto before = [this](int64_t a, int64_t b) {
+    return timestamp[a] < timestamp[b] ||
+      (timestamp[a] == timestamp[b] && order_ref[a] < order_ref[b]);
+  };
+  bool sorted = true;
+  for (int64_t i = 1; sorted && i < n; i++) sorted = !before(i, i - 1);
+  if (!sorted) {
+    std::vector<int64_t> order(n);
+    for (int64_t i = 0; i < n; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), before);
+    for (auto &col : columns) col.second->permute(order);
+  }
+
+  n_rows = 0;
+  n_alloc = 0;
+  return columns_to_data_frame(columns, n);
+}
+
+// [[Rcpp::export]]
+Rcpp::List order_lifetimes_impl(std::string filename,
+                                Rcpp::IntegerVector filter_stock_locate,
+                                int64_t max_buffer_size,
+                                bool quiet,
+                                std::string index_file) {
+  Rcpp::CharacterVector msg_types = Rcpp::CharacterVector::create(
+    "A", "F", "E", "C", "X", "D", "U"
+  );
+  Rcpp::List no_payload = Rcpp::List::create(
+    Rcpp::Named("min_price") = Rcpp::NumericVector(0),
+    Rcpp::Named("max_price") = Rcpp::NumericVector(0),
+    Rcpp::Named("min_shares") = Rcpp::NumericVector(0),
+    Rcpp::Named("buy") = Rcpp::LogicalVector(0),
+    Rcpp::Named("order_ref") = Rcpp::NumericVector(0),
+    Rcpp::Named("match_number") = Rcpp::NumericVector(0),
+    Rcpp::Named("cross_type") = Rcpp::CharacterVector(0)
+  );
+  const MessageFilter filter(msg_types, filter_stock_locate,
+                             Rcpp::NumericVector(0), Rcpp::NumericVector(0),
+                             no_payload);
+
+  ItchReader reader(filename, max_buffer_size);
+  ItchIndex index(index_file);
+  if (index.matches(reader)) index.restrict_ranges(reader, filter);
+
+  LifetimeTracker tracker;
+  unsigned char * buf;
+  int64_t this_buffer_size;
+
+  while ((this_buffer_size = reader.next_block(buf)) > 0) {
+    Rcpp::checkUserInterrupt();
+
+    int64_t i = 0;
+    while (has_full_message(buf, i, this_buffer_size)) {
+      unsigned char * msg = &buf[i + 2];
+      if (filter.passes(msg)) tracker.apply(msg);
+      i += get_message_size(msg[0]);
+    }
+
+    reader.consume(i);
+  }
+
+  if (!quiet)
+    Rprintf("[Messages]   tracked %s orders\n",
+            format_thousands(tracker.size()).c_str());
+
+  return tracker.get_data_frame();
+}
@@ -0,0 +1,90 @@
+#ifndef LIFETIMES_H
+#define LIFETIMES_H
+
+#include <Rcpp.h>
+#include "specifications.h"
+#include "helper_functions.h"
+#include "itch_reader.h"
+#include "message_filter.h"
+#include "itch_index.h"
+#include "read_functions.h"
+#include "order_store.h"
+
+// Entry function to compute the lifetime and fill statistics of the orders
+Rcpp::List order_lifetimes_impl(std::string filename,
+                                Rcpp::IntegerVector filter_stock_locate,
+                                int64_t max_buffer_size = 1e8,
+                                bool quiet = false,
+                                std::string index_file = "");
+
+// the state of an open order, the values that are known when the order is
+// added are written to its row in the columns right away
+struct OrderLifetime {
+  int64_t row;        // the row of the order in the columns
+  int64_t first_fill; // the timestamp of the first execution, NA_INT64 if none
+  uint32_t open_shares, filled_shares, canceled_shares;
+  uint16_t n_replaces;
+  bool used;
+};
+
+/*
+ * LifetimeTracker, follows each order from its add order ('A' or 'F') through
+ *   its executions ('E', 'C'), cancels ('X'), and replaces ('U') to its end,
+ *   i.e., until all shares are executed or canceled or the order is deleted
+ *   ('D').
+ *
+ * A replaced order continues under its new order_ref (the replace chain is
+ * one order), the shares of the replacing order are the new open shares.
+ * Each add order gets the next row of the columns, which grow geometrically.
+ * The open orders are kept in a BasicOrderStore, the rest of the row of an
+ * order is written at its end, i.e., the finished orders are not held twice.
+ * Orders that are still open at the end of the file are written by
+ * get_data_frame().
+ *
+ * The main usage is
+ *
+ *   LifetimeTracker tracker;
+ *   // buf[0] is the message type
+ *   tracker.apply(buf);
+ *   Rcpp::List df = tracker.get_data_frame();
+ */
+class LifetimeTracker {
+public:
+  LifetimeTracker();
+  // columns point to the members of the object, it must not be copied
+  LifetimeTracker(const LifetimeTracker&) = delete;
+  LifetimeTracker& operator=(const LifetimeTracker&) = delete;
+
+  // applies an order message, messages of unknown orders are ignored
+  void apply(unsigned char * buf);
+  // the orders ordered by their add timestamp and order_ref as a data.frame,
+  // releases the columns
+  Rcpp::List get_data_frame();
+  // the number of orders
+  int64_t size() const { return n_rows; }
+
+private:
+  // writes the fills, cancels, and replaces of the order to its row
+  void write_state(const OrderLifetime &o);
+  // ends the order with the given status
+  void finish(int64_t ref, OrderLifetime &o, int64_t ts, char st);
+
+  BasicOrderStore<OrderLifetime> orders;
+  // the stock of each stock_locate (locate codes have 2 bytes)
+  std::vector<int64_t> stocks;
+
+  int64_t n_rows = 0, n_alloc = 0;
+  Int64Column  order_ref;
+  IntColumn    stock_locate;
+  StrColumn<8> stock;
+  LglColumn    buy;
+  DblColumn    price;
+  IntColumn    shares;
+  Int64Column  timestamp, first_fill_timestamp, end_timestamp, lifetime;
+  IntColumn    filled_shares, canceled_shares, n_replaces;
+  StrColumn<8> status;
+  // the columns (name and values) in the order of the data.frame
+  std::vector<std::pair<std::string, Column*>> columns;
+};
+
+#endif // LIFETIMES_H
@@ -0,0 +1,218 @@
+#include "message_filter.h"
+
+// offsets of the payload fields per message type, 0 if the message type does
+// not have the field
+struct PayloadOffsets {
+  unsigned char price[256], shares[256], side[256], order_ref[256],
+    match_number[256], cross_type[256];
+
+  PayloadOffsets() {
+    std::memset(this, 0, sizeof(PayloadOffsets));
+    price['A'] = 32; price['F'] = 32; price['C'] = 32; price['U'] = 31;
+    price['P'] = 32; price['Q'] = 27;
+
+    // Q has 8 bytes shares, all others 4 bytes
+    shares['A'] = 20; shares['F'] = 20; shares['E'] = 19; shares['C'] = 19;
+    shares['X'] = 19; shares['U'] = 27; shares['P'] = 20; shares['Q'] = 11;
+
+    side['A'] = 19; side['F'] = 19; side['P'] = 19;
+
+    for (const unsigned char mt : {'A', 'F', 'E', 'C', 'X', 'D', 'U', 'P'})
+      order_ref[mt] = 11;
+
+    match_number['E'] = 23; match_number['C'] = 23; match_number['P'] = 36;
+    match_number['Q'] = 31; match_number['B'] = 11;
+
+    cross_type['Q'] = 39; cross_type['I'] = 48;
+  }
+};
+static const PayloadOffsets PAYLOAD_OFFSETS;
+
+static std::vector<int64_t> int64_values(Rcpp::NumericVector x) {
+  std::vector<int64_t> res(x.size());
+  if (x.size() > 0) std::memcpy(&(res[0]), &(x[0]), x.size() * sizeof(int64_t));
+  std::sort(res.begin(), res.end());
+  return res;
+}
+
+// casts a bound to int64_t, bounds out of its range (e.g., Inf) are clamped
+// to the limits (NAs are removed by check_payload_filters())
+static int64_t bound_to_int64(const double x) {
+  const double lim = 9223372036854775808.0; // 2^63
+  if (x >= lim) return std::numeric_limits<int64_t>::max();
+  if (x < -lim) return std::numeric_limits<int64_t>::min();
+  return (int64_t) x;
+}
+
+PayloadFilter::PayloadFilter(Rcpp::List filter) {
+  Rcpp::NumericVector price_min = filter["min_price"];
+  Rcpp::NumericVector price_max = filter["max_price"];
+  Rcpp::NumericVector shares_min = filter["min_shares"];
+  Rcpp::LogicalVector side = filter["buy"];
+  Rcpp::CharacterVector cross = filter["cross_type"];
+
+  if (price_min.size() > 0 || price_max.size() > 0) {
+    has_price = true;
+    // the prices have 4 decimals, round to the next valid price
+    min_price = price_min.size() > 0 ?
+      bound_to_int64(std::ceil(price_min[0] * 10000.0 - 1e-6)) : 0;
+    max_price = price_max.size() > 0 ?
+      bound_to_int64(std::floor(price_max[0] * 10000.0 + 1e-6)) :
+      std::numeric_limits<int64_t>::max();
+  }
+  if (shares_min.size() > 0) {
+    has_shares = true;
+    min_shares = bound_to_int64(std::ceil(shares_min[0]));
+  }
+  if (side.size() > 0) buy = side[0] ? 1 : 0;
+
+  // the lineage of the order_refs is checked by an OrderLineage
+  follow_replaces = filter.containsElementNamed("follow_replaces") &&
+    Rcpp::as<bool>(filter["follow_replaces"]);
+  order_refs = int64_values(filter["order_ref"]);
+  match_numbers = int64_values(filter["match_number"]);
+  for (auto c : cross) cross_types.push_back(Rcpp::as<char>(c));
+
+  active = has_price || has_shares || buy != -1 || order_refs.size() > 0 ||
+    match_numbers.size() > 0 || cross_types.size() > 0;
+}
+
+bool PayloadFilter::passes(unsigned char* buf) const {
+  if (!active) return true;
+  const unsigned char mt = buf[0];
+
+  if (has_price) {
+    const unsigned char o = PAYLOAD_OFFSETS.price[mt];
+    if (o == 0) return false;
+    const int64_t val = getNBytes32<4>(&buf[o]);
+    if (val < min_price || val > max_price) return false;
+  }
+  if (has_shares) {
+    const unsigned char o = PAYLOAD_OFFSETS.shares[mt];
+    if (o == 0) return false;
+    const int64_t val = mt == 'Q' ? getNBytes64<8>(&buf[o]) : getNBytes32<4>(&buf[o]);
+    if (val < min_shares) return false;
+  }
+  if (buy != -1) {
+    const unsigned char o = PAYLOAD_OFFSETS.side[mt];
+    if (o == 0 || (buf[o] == 'B') != (buy == 1)) return false;
+  }
+  if (order_refs.size() > 0 && !follow_replaces) {
+    const unsigned char o = PAYLOAD_OFFSETS.order_ref[mt];
+    if (o == 0 || !std::binary_search(order_refs.begin(), order_refs.end(),
+                                      getNBytes64<8>(&buf[o])))
+      return false;
+  }
+  if (match_numbers.size() > 0) {
+    const unsigned char o = PAYLOAD_OFFSETS.match_number[mt];
+    if (o == 0 || !std::binary_search(match_numbers.begin(), match_numbers.end(),
+                                      getNBytes64<8>(&buf[o])))
+      return false;
+  }
+  if (cross_types.size() > 0) {
+    const unsigned char o = PAYLOAD_OFFSETS.cross_type[mt];
+    if (o == 0 || std::find(cross_types.begin(), cross_types.end(),
+                            (char) buf[o]) == cross_types.end())
+      return false;
+  }
+  return true;
+}
+
+OrderLineage::OrderLineage(Rcpp::List filter) {
+  if (!filter.containsElementNamed("follow_replaces") ||
+      !Rcpp::as<bool>(filter["follow_replaces"]))
+    return;
+
+  const std::vector<int64_t> seeds = int64_values(filter["order_ref"]);
+  order_refs.insert(seeds.begin(), seeds.end());
+  active = order_refs.size() > 0;
+}
+
+bool OrderLineage::passes(unsigned char* buf) {
+  const unsigned char o = PAYLOAD_OFFSETS.order_ref[buf[0]];
+  if (o == 0) return false;
+
+  auto it = order_refs.find(getNBytes64<8>(&buf[o]));
+  if (it == order_refs.end()) return false;
+
+  // the order_refs are not reused during a day, i.e., the replaced and the
+  // deleted order_refs do not appear again
+  if (buf[0] == 'U') {
+    order_refs.erase(it);
+    order_refs.insert(getNBytes64<8>(&buf[19]));
+  } else if (buf[0] == 'D') {
+    order_refs.erase(it);
+  }
+  return true;
+}
+
+MessageFilter::MessageFilter(Rcpp::CharacterVector filter_msg_type,
+                             Rcpp::IntegerVector filter_stock_locate,
+                             Rcpp::NumericVector min_timestamp,
+                             Rcpp::NumericVector max_timestamp,
+                             Rcpp::List filter_payload) :
+  payload(filter_payload) {
+
+  // msg_type
+  for (int i = 0; i < 256; i++) msg_types[i] = false;
+  for (auto f : filter_msg_type) {
+    msg_types[(unsigned char) Rcpp::as<char>(f)] = true;
+    has_msg_type = true;
+  }
+
+  // stock_locate, locate codes have 2 bytes
+  stock_locates.assign(65536 / 64, 0);
+  for (int s : filter_stock_locate) {
+    has_stock_locate = true;
+    if (s < 0 || s > 65535) continue;
+    stock_locates[s >> 6] |= (uint64_t) 1 << (s & 63);
+  }
+
+  // timestamp, min and max have the same length, -1 as max is open ended
+  const size_t ts_size = min_timestamp.size();
+  std::vector<std::pair<int64_t, int64_t>> intervals(ts_size);
+  for (size_t i = 0; i < ts_size; i++) {
+    std::memcpy(&intervals[i].first, &(min_timestamp[i]), sizeof(int64_t));
+    std::memcpy(&intervals[i].second, &(max_timestamp[i]), sizeof(int64_t));
+    if (intervals[i].second == -1)
+      intervals[i].second = std::numeric_limits<int64_t>::max();
+  }
+  std::sort(intervals.begin(), intervals.end());
+
+  for (auto &iv : intervals) {
+    if (iv.first > iv.second) continue;
+    // merge overlapping or adjacent intervals
+    if (ts_upper.size() > 0 &&
+        (ts_upper.back() == std::numeric_limits<int64_t>::max() ||
+         iv.first <= ts_upper.back() + 1)) {
+      ts_upper.back() = std::max(ts_upper.back(), iv.second);
+    } else {
+      ts_lower.push_back(iv.first);
+      ts_upper.push_back(iv.second);
+    }
+  }
+
+  if (ts_size > 0) {
+    // all intervals are empty, no message passes
+    if (ts_lower.size() == 0) {
+      ts_lower.push_back(std::numeric_limits<int64_t>::max());
+      ts_upper.push_back(std::numeric_limits<int64_t>::min());
+    }
+    max_ts = ts_upper.back();
+  }
+}
+
+bool MessageFilter::passes_timestamp(const int64_t ts) const {
+  // the last interval that starts at or before ts
+  auto it = std::upper_bound(ts_lower.begin(), ts_lower.end(), ts);
+  if (it == ts_lower.begin()) return false;
+  return ts <= ts_upper[it - ts_lower.begin() - 1];
+}
+
+std::vector<int> MessageFilter::stock_locate_values() const {
+  std::vector<int> res;
+  if (!has_stock_locate) return res;
+  for (int s = 0; s < 65536; s++)
+    if (stock_locates[s >> 6] & ((uint64_t) 1 << (s & 63))) res.push_back(s);
+  return res;
+}
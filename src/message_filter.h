@@ -0,0 +1,138 @@
+#ifndef MESSAGEFILTER_H
+#define MESSAGEFILTER_H
+
+#include <Rcpp.h>
+#include <unordered_set>
+#include "specifications.h"
+#include "helper_functions.h"
+
+// filters on the payload of a message (price, shares, side, order_ref,
+// match_number, and cross_type), the values are compared on the raw bytes.
+// A message that does not have a filtered field (e.g., a price for 'D'
+// messages) does not pass the filter, equivalent to NAs in R.
+// If the replaces are followed, the order_refs are checked by an OrderLineage
+// instead.
+// filter is a list as returned by check_payload_filters() in R
+struct PayloadFilter {
+  PayloadFilter(Rcpp::List filter);
+  bool passes(unsigned char* buf) const;
+
+  // true if any of the filters is set
+  bool active = false;
+
+private:
+  bool has_price = false, has_shares = false, follow_replaces = false;
+  // price in 1/10000 dollars as in the message
+  int64_t min_price = 0, max_price = 0, min_shares = 0;
+  // -1 if not set, 0 sell, 1 buy
+  int buy = -1;
+  // sorted values, empty if not set
+  std::vector<int64_t> order_refs, match_numbers;
+  std::vector<char> cross_types;
+};
+
+/*
+ * MessageFilter, the filters of the read and filter functions compiled into
+ *   lookup structures, so that checking a message costs the same regardless
+ *   of the number of filtered values:
+ *
+ * - msg_type: a mask of 256 entries
+ * - stock_locate: a bitmap of 65536 bits
+ * - timestamp: the intervals sorted and merged, found by binary search
+ * - payload: see PayloadFilter
+ *
+ * The main usage is
+ *
+ *   const MessageFilter filter(filter_msg_type, filter_stock_locate,
+ *                              min_timestamp, max_timestamp, filter_payload);
+ *   // buf[i + 2] is the message type
+ *   if (filter.passes(&buf[i + 2])) ...
+ */
+class MessageFilter {
+public:
+  MessageFilter(Rcpp::CharacterVector filter_msg_type,
+                Rcpp::IntegerVector filter_stock_locate,
+                Rcpp::NumericVector min_timestamp,
+                Rcpp::NumericVector max_timestamp,
+                Rcpp::List filter_payload);
+
+  // checks if the message in buf passes all filters
+  bool passes(unsigned char* buf) const {
+    if (has_msg_type && !msg_types[buf[0]]) return false;
+    if (has_stock_locate) {
+      const int sl = getNBytes32<2>(&buf[1]);
+      if (!(stock_locates[sl >> 6] & ((uint64_t) 1 << (sl & 63)))) return false;
+    }
+    if (ts_lower.size() > 0 && !passes_timestamp(getNBytes64<6>(&buf[5])))
+      return false;
+    return payload.passes(buf);
+  }
+
+  // true if any of the filters is set
+  bool active() const {
+    return has_msg_type || has_stock_locate || ts_lower.size() > 0 ||
+      payload.active;
+  }
+
+  bool passes_msg_type(const unsigned char mt) const {
+    return !has_msg_type || msg_types[mt];
+  }
+  // true if only message types are filtered, i.e., the number of messages
+  // passing the filter is known from the counts per message type
+  bool only_msg_type() const {
+    return !has_stock_locate && ts_lower.size() == 0 && !payload.active;
+  }
+  // the filtered stock_locates, empty if stock_locate is not filtered
+  std::vector<int> stock_locate_values() const;
+  // no message before this timestamp passes the filter
+  int64_t min_ts() const {
+    return ts_lower.size() > 0 ? ts_lower[0] : 0;
+  }
+
+  // no message after this timestamp passes the filter (files are ordered by
+  // timestamp, i.e., the file does not need to be read any further)
+  int64_t max_ts = std::numeric_limits<int64_t>::max();
+
+private:
+  bool passes_timestamp(const int64_t ts) const;
+
+  bool has_msg_type = false, has_stock_locate = false;
+  bool msg_types[256];
+  std::vector<uint64_t> stock_locates;
+  // sorted and non-overlapping, inclusive intervals
+  std::vector<int64_t> ts_lower, ts_upper;
+  PayloadFilter payload;
+};
+
+/*
+ * OrderLineage, the order_refs of the filtered orders and of all orders that
+ *   replace them ('U' messages), i.e., the whole life of the orders.
+ *
+ * The order_refs of the payload filter are the seeds, a replace adds the new
+ * order_ref and a delete ('D') ends an order. The messages must be checked in
+ * file order and each message must be checked (whether it passes the other
+ * filters or not), otherwise later order_refs of a lineage are missed.
+ *
+ * The main usage is
+ *
+ *   OrderLineage lineage(filter_payload);
+ *   // buf[i + 2] is the message type
+ *   const bool in_lineage = !lineage.active || lineage.passes(&buf[i + 2]);
+ *   if (in_lineage && filter.passes(&buf[i + 2])) ...
+ */
+class OrderLineage {
+public:
+  // active if the order_refs are filtered and follow_replaces is set
+  OrderLineage(Rcpp::List filter);
+
+  // checks if the message belongs to the lineage (messages with an order_ref,
+  // see PayloadFilter) and follows its replaces and deletes
+  bool passes(unsigned char* buf);
+
+  bool active = false;
+
+private:
+  std::unordered_set<int64_t> order_refs;
+};
+
+#endif // MESSAGEFILTER_H
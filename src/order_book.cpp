@@ -0,0 +1,597 @@
+#include "order_book.h"
+
+// grows the columns geometrically if row i does not fit
+static void ensure_size(const std::vector<Column*> &cols, int64_t i,
+                        int64_t &size) {
+  if (i < size) return;
+  size = size == 0 ? 1024 : size * 2;
+  for (Column * c : cols) c->resize(size);
+}
+
+// only order messages of the stocks are applied, the filter is shared with
+// the read functions (i.e., the postings of an index are used if present)
+static MessageFilter order_filter(Rcpp::IntegerVector filter_stock_locate) {
+  Rcpp::CharacterVector msg_types =
+    Rcpp::CharacterVector::create("A", "F", "E", "C", "X", "D", "U");
+  Rcpp::List no_payload = Rcpp::List::create(
+    Rcpp::Named("min_price") = Rcpp::NumericVector(0),
+    Rcpp::Named("max_price") = Rcpp::NumericVector(0),
+    Rcpp::Named("min_shares") = Rcpp::NumericVector(0),
+    Rcpp::Named("buy") = Rcpp::LogicalVector(0),
+    Rcpp::Named("order_ref") = Rcpp::NumericVector(0),
+    Rcpp::Named("match_number") = Rcpp::NumericVector(0),
+    Rcpp::Named("cross_type") = Rcpp::CharacterVector(0)
+  );
+  return MessageFilter(msg_types, filter_stock_locate,
+                       Rcpp::NumericVector(0), Rcpp::NumericVector(0),
+                       no_payload);
+}
+
+// the header of a checkpoint file: magic bytes, version, the fingerprint of
+// the file (see FileFingerprint), offset, timestamp, the number of
+// stock_locates and the stock_locates (int32), the number of books and the
+// stock_locate and stock of each book, the number of orders and the orders
+const char CHECKPOINT_MAGIC[8] = {'R', 'I', 'T', 'C', 'H', 'C', 'K', 'P'};
+const int32_t CHECKPOINT_VERSION = 2;
+
+// an open order in a checkpoint file
+struct CheckpointOrder {
+  int64_t  order_ref;
+  uint32_t price, shares, mpid;
+  uint16_t stock_locate;
+  uint8_t  buy, pad;
+};
+
+// starts the books at the checkpoint or, without a checkpoint, moves the
+// reader to the messages of the filter if the index matches the file.
+// Returns the timestamp of the checkpoint, -1 without a checkpoint
+static int64_t start_books(OrderBooks &books, ItchReader &reader,
+                           const MessageFilter &filter, std::string index_file,
+                           std::string checkpoint_file) {
+  ItchIndex index(index_file);
+  if (checkpoint_file == "") {
+    if (index.matches(reader)) {
+      std::vector<int64_t> class_counts;
+      index.seek(reader, filter, 0, std::vector<int>(), class_counts);
+    }
+    return -1;
+  }
+
+  const CheckpointInfo info = books.restore(checkpoint_file,
+                                            filter.stock_locate_values());
+  if (!info.fingerprint.matches(reader.fingerprint))
+    Rcpp::stop("The checkpoint '%s' does not belong to the file",
+               checkpoint_file.c_str());
+
+  reader.seek(info.offset);
+  if (index.matches(reader)) index.restrict_ranges(reader, filter);
+  return info.timestamp;
+}
+
+int OrderBooks::apply(unsigned char * buf) {
+  switch (buf[0]) {
+  case 'A':
+  case 'F': {
+    OrderEntry o;
+    o.stock_locate = getNBytes32<2>(&buf[1]);
+    o.buy          = buf[19] == 'B';
+    o.shares       = getNBytes32<4>(&buf[20]);
+    o.price        = getNBytes32<4>(&buf[32]);
+    o.mpid         = buf[0] == 'F' ? getNBytes64<4>(&buf[36]) : 0x20202020;
+    books[o.stock_locate].stock = getNBytes64<8>(&buf[24]);
+    add_order(getNBytes64<8>(&buf[11]), o);
+    return o.stock_locate;
+  }
+  case 'E': // executed shares
+  case 'C': // executed shares (at a different price, the order keeps its price)
+  case 'X': // canceled shares
+    return reduce_order(getNBytes64<8>(&buf[11]), getNBytes32<4>(&buf[19]));
+  case 'D':
+    return reduce_order(getNBytes64<8>(&buf[11]), -1);
+  case 'U': {
+    // the new order keeps the side and the stock of the original order
+    const int64_t order_ref = getNBytes64<8>(&buf[11]);
+    const OrderEntry * orig = orders.find(order_ref);
+    if (orig == NULL) return -1;
+    OrderEntry o = *orig;
+    reduce_order(order_ref, -1);
+    o.shares = getNBytes32<4>(&buf[27]);
+    o.price  = getNBytes32<4>(&buf[31]);
+    add_order(getNBytes64<8>(&buf[19]), o);
+    return o.stock_locate;
+  }
+  default:
+    return -1;
+  }
+}
+
+void OrderBooks::add_order(int64_t order_ref, const OrderEntry &o) {
+  OrderEntry &entry = orders.insert(order_ref);
+  entry = o;
+  entry.used = true;
+  Book &book = books[o.stock_locate];
+  Level &l = o.buy ? book.bids[o.price] : book.asks[o.price];
+  l.shares += o.shares;
+  l.n_orders++;
+}
+
+int OrderBooks::reduce_order(int64_t order_ref, int64_t shares) {
+  OrderEntry * it = orders.find(order_ref);
+  if (it == NULL) return -1;
+
+  OrderEntry &o = *it;
+  const bool remove = shares < 0 || shares >= (int64_t) o.shares;
+  if (remove) shares = o.shares;
+
+  Book &book = books[o.stock_locate];
+  if (o.buy) {
+    reduce_level(book.bids, o.price, shares, remove);
+  } else {
+    reduce_level(book.asks, o.price, shares, remove);
+  }
+
+  const int stock_locate = o.stock_locate;
+  if (remove) {
+    orders.erase(order_ref);
+  } else {
+    o.shares -= shares;
+  }
+  return stock_locate;
+}
+
+template<typename Levels>
+void OrderBooks::reduce_level(Levels &levels, int64_t price, int64_t shares,
+                              bool remove) {
+  auto it = levels.find(price);
+  if (it == levels.end()) return;
+  it->second.shares -= shares;
+  if (remove) it->second.n_orders--;
+  if (it->second.n_orders <= 0) levels.erase(it);
+}
+
+void OrderBooks::snapshot(int64_t ts, int64_t n_levels) {
+  for (auto &b : books) {
+    store_levels(ts, b.first, b.second, true, b.second.bids, n_levels);
+    store_levels(ts, b.first, b.second, false, b.second.asks, n_levels);
+  }
+}
+
+template<typename Levels>
+void OrderBooks::store_levels(int64_t ts, int sl, const Book &book, bool is_buy,
+                              const Levels &levels, int64_t n_levels) {
+  int lvl = 1;
+  for (auto &pl : levels) {
+    if (n_levels >= 0 && lvl > n_levels) break;
+
+    ensure_size({&timestamp, &stock_locate, &stock, &buy, &level, &price,
+                 &shares, &n_orders_col}, index, size);
+
+    timestamp[index]    = ts;
+    stock_locate[index] = sl;
+    stock[index]        = book.stock;
+    buy[index]          = is_buy;
+    level[index]        = lvl;
+    price[index]        = ((double) pl.first) / 10000.0;
+    shares[index]       = pl.second.shares;
+    n_orders_col[index] = pl.second.n_orders;
+    index++;
+    lvl++;
+  }
+}
+
+Rcpp::List OrderBooks::get_data_frame() {
+  return columns_to_data_frame({
+    {"timestamp", &timestamp}, {"stock_locate", &stock_locate},
+    {"stock", &stock}, {"buy", &buy}, {"level", &level}, {"price", &price},
+    {"shares", &shares}, {"n_orders", &n_orders_col}
+  }, index);
+}
+
+Bbo OrderBooks::bbo(int sl) const {
+  Bbo res;
+  auto it = books.find(sl);
+  if (it == books.end()) return res;
+
+  const Book &book = it->second;
+  if (book.bids.size() > 0) {
+    res.bid_price  = book.bids.begin()->first;
+    res.bid_shares = book.bids.begin()->second.shares;
+  }
+  if (book.asks.size() > 0) {
+    res.ask_price  = book.asks.begin()->first;
+    res.ask_shares = book.asks.begin()->second.shares;
+  }
+  return res;
+}
+
+int64_t OrderBooks::stock_name(int sl) const {
+  auto it = books.find(sl);
+  return it == books.end() ? 0x2020202020202020 : it->second.stock;
+}
+
+std::vector<int> OrderBooks::stock_locates() const {
+  std::vector<int> res;
+  for (auto &b : books) res.push_back(b.first);
+  return res;
+}
+
+void OrderBooks::save(std::string checkpoint_file,
+                      const CheckpointInfo &info) const {
+  FILE* ofile = fopen(checkpoint_file.c_str(), "wb");
+  if (ofile == NULL) {
+    char buffer [50];
+    snprintf(buffer, sizeof(buffer), "Output File Error number %i!", errno);
+    Rcpp::stop(buffer);
+  }
+
+  const int64_t n_locates = info.stock_locates.size();
+  const int64_t n_books = books.size();
+  const int64_t n = orders.size();
+  fwrite(CHECKPOINT_MAGIC, 1, 8, ofile);
+  fwrite(&CHECKPOINT_VERSION, sizeof(int32_t), 1, ofile);
+  fwrite(&info.fingerprint, sizeof(FileFingerprint), 1, ofile);
+  fwrite(&info.offset, sizeof(int64_t), 1, ofile);
+  fwrite(&info.timestamp, sizeof(int64_t), 1, ofile);
+  fwrite(&n_locates, sizeof(int64_t), 1, ofile);
+  for (const int sl : info.stock_locates) {
+    const int32_t s = sl;
+    fwrite(&s, sizeof(int32_t), 1, ofile);
+  }
+  fwrite(&n_books, sizeof(int64_t), 1, ofile);
+  for (auto &b : books) {
+    const int64_t book[2] = {b.first, b.second.stock};
+    fwrite(book, sizeof(int64_t), 2, ofile);
+  }
+  bool ok = fwrite(&n, sizeof(int64_t), 1, ofile) == 1;
+
+  // the orders are written in chunks
+  std::vector<CheckpointOrder> chunk;
+  chunk.reserve(4096);
+  auto flush = [&]() {
+    if (chunk.size() > 0)
+      ok = ok && fwrite(&chunk[0], sizeof(CheckpointOrder), chunk.size(),
+                        ofile) == chunk.size();
+    chunk.clear();
+  };
+  orders.for_each([&](uint64_t order_ref, const OrderEntry &o) {
+    CheckpointOrder co;
+    co.order_ref    = order_ref;
+    co.price        = o.price;
+    co.shares       = o.shares;
+    co.mpid         = o.mpid;
+    co.stock_locate = o.stock_locate;
+    co.buy          = o.buy;
+    co.pad          = 0;
+    chunk.push_back(co);
+    if (chunk.size() == 4096) flush();
+  });
+  flush();
+  fclose(ofile);
+
+  if (!ok) {
+    remove(checkpoint_file.c_str());
+    Rcpp::stop("Could not write checkpoint file '%s'", checkpoint_file.c_str());
+  }
+}
+
+CheckpointInfo OrderBooks::restore(std::string checkpoint_file,
+                                   const std::vector<int> &stock_locates) {
+  FILE* infile = fopen(checkpoint_file.c_str(), "rb");
+  if (infile == NULL) {
+    char buffer [50];
+    snprintf(buffer, sizeof(buffer), "Checkpoint File Error number %i!", errno);
+    Rcpp::stop(buffer);
+  }
+
+  CheckpointInfo info;
+  char magic[8];
+  int32_t version;
+  int64_t n_locates = 0, n_books = 0, n = 0;
+  bool ok = fread(magic, 1, 8, infile) == 8 &&
+    std::memcmp(magic, CHECKPOINT_MAGIC, 8) == 0 &&
+    fread(&version, sizeof(int32_t), 1, infile) == 1 &&
+    version == CHECKPOINT_VERSION &&
+    fread(&info.fingerprint, sizeof(FileFingerprint), 1, infile) == 1 &&
+    fread(&info.offset, sizeof(int64_t), 1, infile) == 1 &&
+    fread(&info.timestamp, sizeof(int64_t), 1, infile) == 1 &&
+    fread(&n_locates, sizeof(int64_t), 1, infile) == 1 &&
+    n_locates >= 0 && n_locates <= 65536;
+
+  for (int64_t i = 0; ok && i < n_locates; i++) {
+    int32_t sl;
+    ok = fread(&sl, sizeof(int32_t), 1, infile) == 1;
+    info.stock_locates.push_back(sl);
+  }
+  if (!ok) {
+    fclose(infile);
+    Rcpp::stop("'%s' is not a checkpoint file", checkpoint_file.c_str());
+  }
+
+  // a checkpoint of some stock_locates can only restore (some of) them
+  bool covered = info.stock_locates.size() == 0 || stock_locates.size() > 0;
+  for (const int sl : stock_locates)
+    if (info.stock_locates.size() > 0 &&
+        !std::binary_search(info.stock_locates.begin(),
+                            info.stock_locates.end(), sl))
+      covered = false;
+  if (!covered) {
+    fclose(infile);
+    Rcpp::stop("The checkpoint '%s' does not hold all filtered stock_locates",
+               checkpoint_file.c_str());
+  }
+
+  // only the books and orders of the filtered stock_locates are restored
+  std::vector<bool> wanted(65536, stock_locates.size() == 0);
+  for (const int sl : stock_locates) wanted[sl] = true;
+
+  ok = fread(&n_books, sizeof(int64_t), 1, infile) == 1;
+  for (int64_t i = 0; ok && i < n_books; i++) {
+    int64_t book[2];
+    ok = fread(book, sizeof(int64_t), 2, infile) == 2 &&
+      book[0] >= 0 && book[0] < 65536;
+    if (ok && wanted[book[0]]) books[book[0]].stock = book[1];
+  }
+  ok = ok && fread(&n, sizeof(int64_t), 1, infile) == 1;
+
+  std::vector<CheckpointOrder> chunk(4096);
+  while (ok && n > 0) {
+    const int64_t k = std::min(n, (int64_t) chunk.size());
+    ok = fread(&chunk[0], sizeof(CheckpointOrder), k, infile) == (size_t) k;
+    for (int64_t i = 0; ok && i < k; i++) {
+      const CheckpointOrder &co = chunk[i];
+      if (!wanted[co.stock_locate]) continue;
+      OrderEntry o;
+      o.price        = co.price;
+      o.shares       = co.shares;
+      o.mpid         = co.mpid;
+      o.stock_locate = co.stock_locate;
+      o.buy          = co.buy != 0;
+      add_order(co.order_ref, o);
+    }
+    n -= k;
+  }
+  fclose(infile);
+
+  if (!ok)
+    Rcpp::stop("Could not read the checkpoint file '%s'",
+               checkpoint_file.c_str());
+  return info;
+}
+
+void BboSeries::add(int64_t ts, int sl, int64_t stk, const Bbo &bbo) {
+  ensure_size({&timestamp, &stock_locate, &stock, &bid_price, &bid_shares,
+               &ask_price, &ask_shares}, index, n_alloc);
+
+  timestamp[index]    = ts;
+  stock_locate[index] = sl;
+  stock[index]        = stk;
+  bid_price[index]    = bbo.bid_price < 0 ? NA_REAL : ((double) bbo.bid_price) / 10000.0;
+  bid_shares[index]   = bbo.bid_shares;
+  ask_price[index]    = bbo.ask_price < 0 ? NA_REAL : ((double) bbo.ask_price) / 10000.0;
+  ask_shares[index]   = bbo.ask_shares;
+  index++;
+}
+
+Rcpp::List BboSeries::get_data_frame() {
+  return columns_to_data_frame({
+    {"timestamp", &timestamp}, {"stock_locate", &stock_locate},
+    {"stock", &stock}, {"bid_price", &bid_price}, {"bid_shares", &bid_shares},
+    {"ask_price", &ask_price}, {"ask_shares", &ask_shares}
+  }, index);
+}
+
+// [[Rcpp::export]]
+Rcpp::List order_book_impl(std::string filename,
+                           Rcpp::IntegerVector filter_stock_locate,
+                           Rcpp::NumericVector snapshots,
+                           int64_t n_levels,
+                           int64_t max_buffer_size,
+                           bool quiet,
+                           std::string index_file,
+                           std::string checkpoint_file) {
+
+  const MessageFilter filter = order_filter(filter_stock_locate);
+
+  // the timestamps of the snapshots as int64 (integer64 in R), sorted
+  std::vector<int64_t> snaps(snapshots.size());
+  if (snapshots.size() > 0)
+    std::memcpy(&snaps[0], &(snapshots[0]), snapshots.size() * sizeof(int64_t));
+  std::sort(snaps.begin(), snaps.end());
+
+  ItchReader reader(filename, max_buffer_size);
+  OrderBooks books;
+  const int64_t checkpoint_ts = start_books(books, reader, filter, index_file,
+                                            checkpoint_file);
+  if (snaps.size() > 0 && snaps[0] < checkpoint_ts)
+    Rcpp::stop("The timestamps must not be before the checkpoint");
+
+  unsigned char * buf;
+  int64_t this_buffer_size, n_msgs = 0;
+  int64_t last_ts = std::max(checkpoint_ts, (int64_t) 0);
+  size_t snap = 0;
+  bool done = false;
+
+  while (!done && (this_buffer_size = reader.next_block(buf)) > 0) {
+    Rcpp::checkUserInterrupt();
+
+    int64_t i = 0;
+    while (has_full_message(buf, i, this_buffer_size)) {
+      unsigned char * msg = &buf[i + 2];
+      if (filter.passes(msg)) {
+        const int64_t ts = getNBytes64<6>(&msg[5]);
+        // the books at a snapshot hold all messages up to its timestamp
+        while (snap < snaps.size() && ts > snaps[snap])
+          books.snapshot(snaps[snap++], n_levels);
+        if (snaps.size() > 0 && snap == snaps.size()) {
+          done = true;
+          break;
+        }
+
+        books.apply(msg);
+        last_ts = ts;
+        n_msgs++;
+      }
+      i += get_message_size(msg[0]);
+    }
+
+    reader.consume(i);
+  }
+
+  // snapshots after the last message, without snapshots the books at the
+  // end of the file (at the timestamp of the last applied message)
+  while (snap < snaps.size()) books.snapshot(snaps[snap++], n_levels);
+  if (snaps.size() == 0) books.snapshot(last_ts, n_levels);
+
+  if (!quiet) {
+    Rprintf("[Messages]   applied %s order messages\n",
+            format_thousands(n_msgs).c_str());
+    Rprintf("[Orders]     %s open orders\n",
+            format_thousands(books.n_orders()).c_str());
+  }
+
+  return books.get_data_frame();
+}
+
+// [[Rcpp::export]]
+Rcpp::List bbo_impl(std::string filename,
+                    Rcpp::IntegerVector filter_stock_locate,
+                    int64_t interval,
+                    int64_t max_buffer_size,
+                    bool quiet,
+                    std::string index_file,
+                    std::string checkpoint_file) {
+
+  const MessageFilter filter = order_filter(filter_stock_locate);
+  ItchReader reader(filename, max_buffer_size);
+  OrderBooks books;
+  const int64_t checkpoint_ts = start_books(books, reader, filter, index_file,
+                                            checkpoint_file);
+
+  BboSeries series;
+  // the last emitted bbo per stock_locate (locate codes have 2 bytes)
+  std::vector<Bbo> last(interval > 0 ? 0 : 65536);
+  unsigned char * buf;
+  int64_t this_buffer_size, n_msgs = 0, grid = -1;
+
+  // the books of a checkpoint are emitted at its timestamp, the grid starts
+  // at the first grid point at or after the checkpoint
+  if (checkpoint_ts >= 0 && interval > 0) {
+    grid = ((checkpoint_ts + interval - 1) / interval) * interval;
+  } else if (checkpoint_ts >= 0) {
+    for (const int sl : books.stock_locates()) {
+      last[sl] = books.bbo(sl);
+      series.add(checkpoint_ts, sl, books.stock_name(sl), last[sl]);
+    }
+  }
+
+  while ((this_buffer_size = reader.next_block(buf)) > 0) {
+    Rcpp::checkUserInterrupt();
+
+    int64_t i = 0;
+    while (has_full_message(buf, i, this_buffer_size)) {
+      unsigned char * msg = &buf[i + 2];
+      if (filter.passes(msg)) {
+        const int64_t ts = getNBytes64<6>(&msg[5]);
+
+        if (interval > 0) {
+          // the books at a grid point hold all messages up to its timestamp,
+          // grid points before the first message are not emitted
+          if (grid < 0) grid = (ts / interval) * interval;
+          while (ts > grid) {
+            for (const int sl : books.stock_locates())
+              series.add(grid, sl, books.stock_name(sl), books.bbo(sl));
+            grid += interval;
+          }
+        }
+
+        const int sl = books.apply(msg);
+        if (interval <= 0 && sl >= 0) {
+          const Bbo bbo = books.bbo(sl);
+          if (bbo != last[sl]) {
+            series.add(ts, sl, books.stock_name(sl), bbo);
+            last[sl] = bbo;
+          }
+        }
+        n_msgs++;
+      }
+      i += get_message_size(msg[0]);
+    }
+
+    reader.consume(i);
+  }
+
+  // the last grid point (at or after the last message) holds the books at
+  // the end of the file
+  if (interval > 0 && grid >= 0) {
+    for (const int sl : books.stock_locates())
+      series.add(grid, sl, books.stock_name(sl), books.bbo(sl));
+  }
+
+  if (!quiet) {
+    Rprintf("[Messages]   applied %s order messages\n",
+            format_thousands(n_msgs).c_str());
+    Rprintf("[BBO]        %s rows\n", format_thousands(series.size()).c_str());
+  }
+
+  return series.get_data_frame();
+}
+
+// [[Rcpp::export]]
+int64_t write_order_checkpoint_impl(std::string filename,
+                                    std::string checkpoint_file,
+                                    Rcpp::IntegerVector filter_stock_locate,
+                                    Rcpp::NumericVector timestamp,
+                                    int64_t max_buffer_size,
+                                    bool quiet,
+                                    std::string index_file) {
+  if (timestamp.size() != 1) Rcpp::stop("timestamp must have length 1");
+  int64_t max_ts;
+  std::memcpy(&max_ts, &(timestamp[0]), sizeof(int64_t));
+
+  const MessageFilter filter = order_filter(filter_stock_locate);
+  ItchReader reader(filename, max_buffer_size);
+  OrderBooks books;
+  start_books(books, reader, filter, index_file, "");
+
+  unsigned char * buf;
+  int64_t this_buffer_size, n_msgs = 0, offset = -1;
+
+  while (offset < 0 && (this_buffer_size = reader.next_block(buf)) > 0) {
+    Rcpp::checkUserInterrupt();
+
+    int64_t i = 0;
+    while (has_full_message(buf, i, this_buffer_size)) {
+      unsigned char * msg = &buf[i + 2];
+      if (filter.passes(msg)) {
+        // the checkpoint continues at the first message after the timestamp
+        if (getNBytes64<6>(&msg[5]) > max_ts) {
+          offset = reader.bytes_read + i;
+          break;
+        }
+        books.apply(msg);
+        n_msgs++;
+      }
+      i += get_message_size(msg[0]);
+    }
+
+    reader.consume(i);
+  }
+  if (offset < 0) offset = reader.bytes_read;
+
+  CheckpointInfo info;
+  info.fingerprint = reader.fingerprint;
+  info.offset = offset;
+  info.timestamp = max_ts;
+  info.stock_locates = filter.stock_locate_values();
+  books.save(checkpoint_file, info);
+
+  if (!quiet) {
+    Rprintf("[Messages]   applied %s order messages\n",
+            format_thousands(n_msgs).c_str());
+    Rprintf("[Checkpoint] %s open orders at offset %s\n",
+            format_thousands(books.n_orders()).c_str(),
+            format_thousands(offset).c_str());
+  }
+
+  return offset;
+}
@@ -0,0 +1,181 @@
+#ifndef ORDERBOOK_H
+#define ORDERBOOK_H
+
+#include <Rcpp.h>
+#include <map>
+#include <functional>
+#include "specifications.h"
+#include "helper_functions.h"
+#include "itch_reader.h"
+#include "message_filter.h"
+#include "itch_index.h"
+#include "read_functions.h"
+#include "order_store.h"
+
+// Entry function to reconstruct the order books of an ITCH file
+Rcpp::List order_book_impl(std::string filename,
+                           Rcpp::IntegerVector filter_stock_locate,
+                           Rcpp::NumericVector snapshots,
+                           int64_t n_levels,
+                           int64_t max_buffer_size = 1e8,
+                           bool quiet = false,
+                           std::string index_file = "",
+                           std::string checkpoint_file = "");
+
+// Entry function to compute the best bid and offer (top of book) series
+Rcpp::List bbo_impl(std::string filename,
+                    Rcpp::IntegerVector filter_stock_locate,
+                    int64_t interval,
+                    int64_t max_buffer_size = 1e8,
+                    bool quiet = false,
+                    std::string index_file = "",
+                    std::string checkpoint_file = "");
+
+// Entry function to write the open orders at a timestamp to a checkpoint
+int64_t write_order_checkpoint_impl(std::string filename,
+                                    std::string checkpoint_file,
+                                    Rcpp::IntegerVector filter_stock_locate,
+                                    Rcpp::NumericVector timestamp,
+                                    int64_t max_buffer_size = 1e8,
+                                    bool quiet = false,
+                                    std::string index_file = "");
+
+// the position of a checkpoint of the order books in an ITCH file: the
+// fingerprint of the file, the offset of the first message after the
+// checkpoint, the timestamp up to which all messages are applied, and the
+// stock_locates of the books (all if empty)
+struct CheckpointInfo {
+  FileFingerprint fingerprint;
+  int64_t offset = 0, timestamp = 0;
+  std::vector<int> stock_locates;
+};
+
+// the best bid and offer of a book, the prices are in 1/10000 dollars,
+// a price of -1 (and 0 shares) marks an empty side
+struct Bbo {
+  int64_t bid_price = -1, bid_shares = 0, ask_price = -1, ask_shares = 0;
+
+  bool operator==(const Bbo &o) const {
+    return bid_price == o.bid_price && bid_shares == o.bid_shares &&
+      ask_price == o.ask_price && ask_shares == o.ask_shares;
+  }
+  bool operator!=(const Bbo &o) const { return !(*this == o); }
+};
+
+/*
+ * OrderBooks, the limit order books of all stocks, rebuilt by applying the
+ *   order messages (A, F, E, C, X, D, U) in file order.
+ *
+ * Each open order is kept by its order_ref (see OrderStore), each stock has a
+ * price-level book per side holding the sum of the open shares and the number
+ * of orders at each price. Orders that are not known (e.g., the file starts during the
+ * day) are ignored.
+ *
+ * The main usage is
+ *
+ *   OrderBooks books;
+ *   // buf[0] is the message type
+ *   const int stock_locate = books.apply(buf);
+ *   books.snapshot(timestamp, n_levels);
+ *   Rcpp::List df = books.get_data_frame();
+ *
+ * The open orders can be saved to a checkpoint file and restored, e.g., to
+ * continue the books at the offset of the checkpoint instead of replaying
+ * the file from its start.
+ */
+class OrderBooks {
+public:
+  // applies an order message to the books, returns the stock_locate of the
+  // book or -1 if the message did not change a book (e.g., unknown orders)
+  int apply(unsigned char * buf);
+  // stores the best n_levels (all levels if n_levels < 0) of each side of
+  // all books as rows with the given timestamp
+  void snapshot(int64_t timestamp, int64_t n_levels);
+  // the stored snapshots as a data.frame, releases the columns
+  Rcpp::List get_data_frame();
+
+  // the number of orders that are currently open
+  size_t n_orders() const { return orders.size(); }
+
+  // the best bid and offer of a book
+  Bbo bbo(int stock_locate) const;
+  // the stock (8 bytes, see key_to_string) of a book
+  int64_t stock_name(int stock_locate) const;
+  // the stock_locates of all books, sorted
+  std::vector<int> stock_locates() const;
+
+  // writes the open orders and the stocks of the books to a checkpoint file
+  void save(std::string checkpoint_file, const CheckpointInfo &info) const;
+  // restores the open orders of the stock_locates (all if empty) from a
+  // checkpoint file and rebuilds their books, returns the position
+  CheckpointInfo restore(std::string checkpoint_file,
+                         const std::vector<int> &stock_locates);
+
+private:
+  struct Level {
+    int64_t shares = 0;
+    int n_orders = 0;
+  };
+  struct Book {
+    int64_t stock = 0x2020202020202020; // "        ", until the first order
+    // bids ordered from the best (highest) price, asks from the lowest
+    std::map<int64_t, Level, std::greater<int64_t>> bids;
+    std::map<int64_t, Level> asks;
+  };
+
+  void add_order(int64_t order_ref, const OrderEntry &o);
+  // reduces the open shares of an order, all shares if shares < 0, returns
+  // the stock_locate of the order, -1 if the order is unknown
+  int reduce_order(int64_t order_ref, int64_t shares);
+  template<typename Levels>
+  void reduce_level(Levels &levels, int64_t price, int64_t shares, bool remove);
+  template<typename Levels>
+  void store_levels(int64_t timestamp, int stock_locate, const Book &book,
+                    bool buy, const Levels &levels, int64_t n_levels);
+
+  OrderStore orders;
+  // ordered by stock_locate
+  std::map<int, Book> books;
+
+  // the snapshots
+  int64_t size = 0, index = 0;
+  Int64Column  timestamp;
+  IntColumn    stock_locate;
+  StrColumn<8> stock;
+  LglColumn    buy;
+  IntColumn    level;
+  DblColumn    price;
+  Int64Column  shares;
+  IntColumn    n_orders_col;
+};
+
+/*
+ * BboSeries, the rows of the best bid and offer series of read_bbo().
+ *
+ * The main usage is
+ *
+ *   BboSeries series;
+ *   series.add(timestamp, stock_locate, books.stock_name(stock_locate),
+ *              books.bbo(stock_locate));
+ *   Rcpp::List df = series.get_data_frame();
+ */
+class BboSeries {
+public:
+  void add(int64_t timestamp, int stock_locate, int64_t stock, const Bbo &bbo);
+  // the rows as a data.frame, releases the columns
+  Rcpp::List get_data_frame();
+  // the number of rows
+  int64_t size() const { return index; }
+
+private:
+  int64_t n_alloc = 0, index = 0;
+  Int64Column  timestamp;
+  IntColumn    stock_locate;
+  StrColumn<8> stock;
+  DblColumn    bid_price;
+  Int64Column  bid_shares;
+  DblColumn    ask_price;
+  Int64Column  ask_shares;
+};
+
+#endif // ORDERBOOK_H
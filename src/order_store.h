@@ -0,0 +1,216 @@
+#ifndef ORDERSTORE_H
+#define ORDERSTORE_H
+
+#include <Rcpp.h>
+#include <unordered_map>
+#include "helper_functions.h"
+
+// the state of an open order
+struct OrderEntry {
+  uint32_t price;
+  uint32_t shares;
+  uint16_t stock_locate;
+  bool buy;
+  bool used;
+  // the 4 byte mpid (see key_to_string), only used by the executions
+  uint32_t mpid;
+};
+
+/*
+ * OrderStore, the open orders of a day by their order_ref.
+ *
+ * The store holds OrderEntry values (see the typedef below), other entry
+ * types need a bool used member and must be trivially copyable (new pages are
+ * zeroed with memset).
+ *
+ * The order_refs of a day are assigned (roughly) sequentially, the orders are
+ * therefore stored in a paged array indexed directly by the order_ref: the
+ * upper bits select a page of PAGE_SIZE entries, the lower bits the entry in
+ * the page. A lookup is two array accesses without any hashing, and orders
+ * that are added at about the same time are close in memory.
+ *
+ * Pages are only allocated when an order on them is added. A page whose
+ * orders are all removed is put back into a pool and reused for the next new
+ * page, i.e., the memory is bounded by the pages with open orders. Very large
+ * order_refs (outside of MAX_PAGES pages) are kept in a hash map.
+ *
+ * The main usage is
+ *
+ *   OrderStore store;
+ *   OrderEntry &o = store.insert(order_ref);
+ *   o.shares = ...;
+ *   OrderEntry * p = store.find(order_ref); // NULL if not open
+ *   store.erase(order_ref);
+ */
+template<typename Entry>
+class BasicOrderStore {
+public:
+  BasicOrderStore() {}
+  ~BasicOrderStore() {
+    for (Page * p : pages) delete p;
+    for (Page * p : pool) delete p;
+  }
+  BasicOrderStore(const BasicOrderStore&) = delete;
+  BasicOrderStore& operator=(const BasicOrderStore&) = delete;
+
+  // the open order or NULL
+  Entry * find(uint64_t order_ref) {
+    const uint64_t pg = order_ref >> PAGE_BITS;
+    if (pg >= MAX_PAGES) {
+      auto it = overflow.find(order_ref);
+      return it == overflow.end() ? NULL : &it->second;
+    }
+    if (pg >= pages.size() || pages[pg] == NULL) return NULL;
+    Entry &o = pages[pg]->entries[order_ref & PAGE_MASK];
+    return o.used ? &o : NULL;
+  }
+
+  // the entry of a new order (an open order with the same order_ref is
+  // overwritten)
+  Entry & insert(uint64_t order_ref) {
+    const uint64_t pg = order_ref >> PAGE_BITS;
+    if (pg >= MAX_PAGES) {
+      Entry &o = overflow[order_ref];
+      if (!o.used) n_orders++;
+      o.used = true;
+      return o;
+    }
+    if (pg >= pages.size()) pages.resize(pg + 1, NULL);
+    if (pages[pg] == NULL) pages[pg] = new_page();
+
+    Page * p = pages[pg];
+    Entry &o = p->entries[order_ref & PAGE_MASK];
+    if (!o.used) {
+      p->n_used++;
+      n_orders++;
+    }
+    o.used = true;
+    return o;
+  }
+
+  void erase(uint64_t order_ref) {
+    const uint64_t pg = order_ref >> PAGE_BITS;
+    if (pg >= MAX_PAGES) {
+      if (overflow.erase(order_ref) > 0) n_orders--;
+      return;
+    }
+    if (pg >= pages.size() || pages[pg] == NULL) return;
+
+    Page * p = pages[pg];
+    Entry &o = p->entries[order_ref & PAGE_MASK];
+    if (!o.used) return;
+    o.used = false;
+    n_orders--;
+
+    // all orders of the page are closed, keep it for the next new page
+    if (--p->n_used == 0) {
+      pages[pg] = NULL;
+      if (pool.size() < MAX_POOL) {
+        pool.push_back(p);
+      } else {
+        delete p;
+      }
+    }
+  }
+
+  // the number of open orders
+  size_t size() const { return n_orders; }
+
+  // calls f(order_ref, entry) for all open orders
+  template<typename F>
+  void for_each(F f) const {
+    for (size_t pg = 0; pg < pages.size(); pg++) {
+      if (pages[pg] == NULL) continue;
+      for (uint64_t i = 0; i < PAGE_SIZE; i++) {
+        const Entry &o = pages[pg]->entries[i];
+        if (o.used) f(((uint64_t) pg << PAGE_BITS) | i, o);
+      }
+    }
+    for (auto &it : overflow) f(it.first, it.second);
+  }
+
+private:
+  static const int PAGE_BITS = 12;
+  static const uint64_t PAGE_SIZE = (uint64_t) 1 << PAGE_BITS;
+  static const uint64_t PAGE_MASK = PAGE_SIZE - 1;
+  // pages for order_refs up to 2^36 (a directory of at most 128 MB)
+  static const uint64_t MAX_PAGES = (uint64_t) 1 << 24;
+  static const size_t MAX_POOL = 64;
+
+  struct Page {
+    Entry entries[PAGE_SIZE];
+    int64_t n_used;
+  };
+
+  // an empty page, from the pool if possible
+  Page * new_page() {
+    Page * p;
+    if (pool.size() > 0) {
+      // all entries of a pooled page are unused already
+      p = pool.back();
+      pool.pop_back();
+    } else {
+      p = new Page;
+      std::memset(p->entries, 0, sizeof(p->entries));
+    }
+    p->n_used = 0;
+    return p;
+  }
+
+  std::vector<Page*> pages;
+  std::vector<Page*> pool;
+  std::unordered_map<uint64_t, Entry> overflow;
+  size_t n_orders = 0;
+};
+
+typedef BasicOrderStore<OrderEntry> OrderStore;
+
+// applies an order message (A, F, E, C, X, D, U, buf[0] is the message type)
+// to the open orders, messages of unknown orders are ignored
+inline void track_order(OrderStore &orders, unsigned char * buf) {
+  const int64_t ref = getNBytes64<8>(&buf[11]);
+
+  switch (buf[0]) {
+  case 'A':
+  case 'F': {
+    OrderEntry &o = orders.insert(ref);
+    o.stock_locate = getNBytes32<2>(&buf[1]);
+    o.buy          = buf[19] == 'B';
+    o.shares       = getNBytes32<4>(&buf[20]);
+    o.price        = getNBytes32<4>(&buf[32]);
+    o.mpid         = buf[0] == 'F' ? getNBytes64<4>(&buf[36]) : 0x20202020;
+    break;
+  }
+  case 'E':
+  case 'C':
+  case 'X': {
+    OrderEntry * o = orders.find(ref);
+    if (o == NULL) break;
+    const uint32_t n = getNBytes32<4>(&buf[19]);
+    if (n >= o->shares) {
+      orders.erase(ref);
+    } else {
+      o->shares -= n;
+    }
+    break;
+  }
+  case 'D':
+    orders.erase(ref);
+    break;
+  case 'U': {
+    // the new order keeps the side, stock, and mpid of the original order
+    const OrderEntry * orig = orders.find(ref);
+    if (orig == NULL) break;
+    OrderEntry o = *orig;
+    orders.erase(ref);
+    o.shares = getNBytes32<4>(&buf[27]);
+    o.price  = getNBytes32<4>(&buf[31]);
+    orders.insert(getNBytes64<8>(&buf[19])) = o;
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+#endif // ORDERSTORE_H
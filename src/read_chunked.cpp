@@ -0,0 +1,153 @@
+#include "read_chunked.h"
+
+// [[Rcpp::export]]
+Rcpp::List read_itch_chunked_impl(std::vector<std::string> classes,
+                                  std::string filename,
+                                  int64_t start, int64_t end,
+                                  Rcpp::CharacterVector filter_msg_type,
+                                  Rcpp::IntegerVector filter_stock_locate,
+                                  Rcpp::NumericVector min_timestamp,
+                                  Rcpp::NumericVector max_timestamp,
+                                  Rcpp::List filter_payload,
+                                  Rcpp::Function callback,
+                                  int64_t chunk_size,
+                                  int64_t chunk_bytes,
+                                  int64_t max_buffer_size,
+                                  bool quiet,
+                                  std::vector<std::string> columns,
+                                  std::string index_file) {
+  if (chunk_size < 1 && chunk_bytes < 1)
+    Rcpp::stop("Either chunk_size or chunk_bytes must be positive");
+
+  const MessageFilter filter(filter_msg_type, filter_stock_locate,
+                             min_timestamp, max_timestamp, filter_payload);
+  OrderLineage lineage(filter_payload);
+
+  const int n_classes = classes.size();
+  int executions_pos = -1;
+  for (int c = 0; c < n_classes; c++)
+    if (classes[c] == "executions") executions_pos = c;
+
+  // as in read_itch_impl, the executions and the lineage need all order
+  // messages, an index then only restricts the stock_locates
+  ItchReader reader(filename, max_buffer_size);
+  ItchIndex index(index_file);
+  std::vector<int64_t> skipped(MSG_CLASS_SIZE, 0);
+  if (index.matches(reader) && (executions_pos >= 0 || lineage.active)) {
+    index.restrict_ranges(reader, filter);
+  } else if (index.matches(reader)) {
+    std::vector<int> class_pos;
+    for (const std::string &cls : classes)
+      class_pos.push_back(get_class_position(cls));
+    index.seek(reader, filter, start, class_pos, skipped);
+  }
+
+  // one parser per class, the parsers live across the chunks (skip/n_max and
+  // the orders of the executions continue), their vectors grow to the
+  // largest chunk and are reused afterwards
+  ParserTable table;
+  std::vector<MessageParser*> parsers;
+  auto clean_up = [&]() {
+    for (MessageParser * p : parsers) delete p;
+  };
+
+  try {
+    for (int c = 0; c < n_classes; c++) {
+      const int pos = get_class_position(classes[c]);
+      const int64_t n_skipped = pos >= 0 ? skipped[pos] : 0;
+      MessageParser * p = create_parser(classes[c], start - n_skipped,
+                                        end < 0 ? end : end - n_skipped);
+      parsers.push_back(p);
+      p->select_columns(columns);
+      table.add_parser(p);
+    }
+
+    for (const std::string &col : columns) {
+      bool found = false;
+      for (MessageParser * p : parsers) if (p->has_column(col)) found = true;
+      if (!found)
+        Rcpp::stop("Column '%s' not found in the selected message classes",
+                   col.c_str());
+    }
+  } catch (...) {
+    clean_up();
+    throw;
+  }
+
+  ExecutionsParser * executions = executions_pos < 0 ? NULL :
+    static_cast<ExecutionsParser*>(parsers[executions_pos]);
+
+  Rcpp::List res;
+  int64_t n_chunks = 0;
+
+  // passes the parsed messages to the callback and clears the parsers,
+  // chunks without any parsed message are skipped
+  auto flush = [&]() {
+    int64_t n_rows = 0;
+    for (MessageParser * p : parsers) n_rows += p->n_parsed();
+    if (n_rows == 0) return;
+
+    Rcpp::List chunk(n_classes);
+    for (int c = 0; c < n_classes; c++) {
+      chunk[c] = parsers[c]->get_data_frame(true);
+      parsers[c]->clear();
+    }
+    chunk.attr("names") = classes;
+    res.push_back(callback(chunk));
+    n_chunks++;
+  };
+
+  int64_t total_msgs = 0;
+  try {
+    unsigned char * buf;
+    int64_t this_buffer_size;
+    bool max_ts_reached = false;
+    // the number of messages and bytes of the file in the current chunk
+    int64_t chunk_msgs = 0, chunk_used = 0;
+
+    while (!max_ts_reached && (this_buffer_size = reader.next_block(buf)) > 0) {
+      Rcpp::checkUserInterrupt();
+
+      int64_t i = 0;
+      while (has_full_message(buf, i, this_buffer_size)) {
+        unsigned char * msg = &buf[i + 2];
+        if (getNBytes64<6>(&msg[5]) > filter.max_ts) {
+          max_ts_reached = true;
+          break;
+        }
+
+        const bool in_lineage = !lineage.active || lineage.passes(msg);
+        const bool passes = in_lineage && filter.passes(msg);
+        if (passes) table.parse_message(msg);
+        if (executions != NULL) executions->track(msg, passes);
+
+        const int64_t msg_size = get_message_size(msg[0]);
+        i += msg_size;
+        total_msgs++;
+
+        chunk_msgs++;
+        chunk_used += msg_size;
+        if ((chunk_size > 0 && chunk_msgs >= chunk_size) ||
+            (chunk_bytes > 0 && chunk_used >= chunk_bytes)) {
+          flush();
+          chunk_msgs = 0;
+          chunk_used = 0;
+        }
+      }
+      reader.consume(i);
+    }
+    flush();
+  } catch (...) {
+    clean_up();
+    throw;
+  }
+
+  if (!quiet) {
+    Rprintf("[Counting]   num messages %s\n", format_thousands(total_msgs).c_str());
+    Rprintf("[Chunks]     %s chunks passed to FUN\n",
+            format_thousands(n_chunks).c_str());
+  }
+
+  clean_up();
+  return res;
+}
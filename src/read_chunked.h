@@ -0,0 +1,32 @@
+#ifndef READCHUNKED_H
+#define READCHUNKED_H
+
+#include <Rcpp.h>
+#include "specifications.h"
+#include "helper_functions.h"
+#include "itch_reader.h"
+#include "message_filter.h"
+#include "itch_index.h"
+#include "read_functions.h"
+
+// Entry function to read the message classes of an ITCH file in chunks of
+// chunk_size messages (or chunk_bytes bytes) of the file, the data.frames of
+// each chunk are passed to callback, the vectors of the parsers are reused
+// for the next chunk. Returns the results of callback in a list
+Rcpp::List read_itch_chunked_impl(std::vector<std::string> classes,
+                                  std::string filename,
+                                  int64_t start, int64_t end,
+                                  Rcpp::CharacterVector filter_msg_type,
+                                  Rcpp::IntegerVector filter_stock_locate,
+                                  Rcpp::NumericVector min_timestamp,
+                                  Rcpp::NumericVector max_timestamp,
+                                  Rcpp::List filter_payload,
+                                  Rcpp::Function callback,
+                                  int64_t chunk_size = 1e6,
+                                  int64_t chunk_bytes = -1,
+                                  int64_t max_buffer_size = 1e8,
+                                  bool quiet = false,
+                                  std::vector<std::string> columns = {},
+                                  std::string index_file = "");
+
+#endif // READCHUNKED_H
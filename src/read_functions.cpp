@@ -1,8 +1,7 @@
 #include "read_functions.h"
 
-#ifdef __APPLE__
-#  define fseeko64 fseeko
-#  define ftello64 ftello
+#ifdef _OPENMP
+#include <omp.h>
 #endif
 
 // [[Rcpp::export]]
@@ -13,185 +12,227 @@ Rcpp::List read_itch_impl(std::vector<std::string> classes,
                           Rcpp::IntegerVector filter_stock_locate,
                           Rcpp::NumericVector min_timestamp,
                           Rcpp::NumericVector max_timestamp,
+                          Rcpp::List filter_payload,
                           int64_t max_buffer_size,
-                          bool quiet) {
+                          bool quiet,
+                          int n_threads,
+                          std::vector<std::string> columns,
+                          std::string index_file) {
+
+  // the file is only read once, the vectors of the MessageParsers grow while
+  // parsing. If there is an end, at most end - start + 1 messages are parsed
+  // per class, which is used as the initial size of the vectors.
+  int64_t init_size = 0;
+  if (end >= 0) init_size = std::min(end - start + 1, MAX_INIT_VECTOR_SIZE);
+
+  // compile the filters once, they are shared by all threads
+  const MessageFilter filter(filter_msg_type, filter_stock_locate,
+                             min_timestamp, max_timestamp, filter_payload);
+
+  // the executions resolve the orders while reading, i.e., they need all
+  // order messages in file order (set once the parsers are created)
+  const bool has_executions =
+    std::find(classes.begin(), classes.end(), "executions") != classes.end();
+  ExecutionsParser * executions = NULL;
+
+  // the lineage of the filtered order_refs also depends on all previous
+  // messages (see OrderLineage)
+  OrderLineage lineage(filter_payload);
+  const bool sequential = has_executions || lineage.active;
+
+  // parses all full messages in buf with the given parsers,
+  // returns the number of bytes used
+  // Note: this is called from multiple threads, no R functions must be used!
+  auto parse_buffer = [&](unsigned char * buf, int64_t size,
+                          ParserTable &table,
+                          int64_t &n_msgs, bool &max_ts_reached) {
+    int64_t i = 0;
+    while (has_full_message(buf, i, size)) {
+      // check early stop in max_timestamp
+      const int64_t cur_ts = getNBytes64<6>(&buf[i + 2 + 5]);
+      if (cur_ts > filter.max_ts) {
+        max_ts_reached = true;
+        break;
+      }
 
-  std::vector<int64_t> count(N_TYPES, end - start + 1);
-  int64_t total_msgs = 0;
+      const unsigned char mt = buf[i + 2];
+      const bool in_lineage = !lineage.active || lineage.passes(&buf[i + 2]);
+      const bool passes = in_lineage && filter.passes(&buf[i + 2]);
+      if (passes) table.parse_message(&buf[i + 2]);
+      if (executions != NULL) executions->track(&buf[i + 2], passes);
 
-  // if there is an end, don't count all messages but take end - start + 1
-  if (end < 0) {
-    count = count_messages_internal(filename, max_buffer_size);
-    for (int64_t v : count) total_msgs += v;
+      i += get_message_size(mt);
+      n_msgs++;
+    }
+    return i;
+  };
 
-    if (!quiet) Rprintf("[Counting]   num messages %s\n",
-        format_thousands(total_msgs).c_str());
+  ItchReader reader(filename, max_buffer_size);
+
+  // if an index of the file is found, start at the last checkpoint before
+  // the first message that is parsed (and read only the messages of the
+  // filtered stock_locates), skipped holds the number of messages per class
+  // that were skipped. The executions and the lineage need the orders before
+  // the first message, only the stock_locates are restricted
+  ItchIndex index(index_file);
+  std::vector<int64_t> skipped(MSG_CLASS_SIZE, 0);
+  if (index.matches(reader) && sequential) {
+    index.restrict_ranges(reader, filter);
+  } else if (index.matches(reader)) {
+    std::vector<int> class_pos;
+    for (const std::string &cls : classes)
+      class_pos.push_back(get_class_position(cls));
+    index.seek(reader, filter, start, class_pos, skipped);
   }
 
-  std::vector<int64_t> sizes(classes.size());
-
   // initiate the MessageParsers and resize the vectors...
+  // only the requested classes get a parser, all other message types are
+  // ignored by the ParserTable
+  auto create_parsers = [&](ParserTable &table,
+                            std::map<std::string, MessageParser*> &class_to_parsers) {
+    for (const std::string &cls : classes) {
+      if (class_to_parsers.count(cls) > 0) continue;
+
+      const int pos = get_class_position(cls);
+      const int64_t n_skipped = pos >= 0 ? skipped[pos] : 0;
+      MessageParser* msgp_ptr = create_parser(cls, start - n_skipped,
+                                              end < 0 ? end : end - n_skipped);
+      class_to_parsers[cls] = msgp_ptr;
+      msgp_ptr->select_columns(columns);
+      msgp_ptr->init_vectors(init_size);
+      table.add_parser(msgp_ptr);
+    }
+  };
 
-  // for each message class, hold a pointer to a message parser
-  // message classes: 13
+  auto delete_parsers = [](std::map<std::string, MessageParser*> &class_to_parsers) {
+    for (auto &cp : class_to_parsers) delete cp.second;
+    class_to_parsers.clear();
+  };
 
-  // N_TYPES = 40, for each message in MSG_SIZES one
-  std::vector<MessageParser*> msg_parsers(N_TYPES);
+  ParserTable table;
   std::map<std::string, MessageParser*> class_to_parsers;
-
-  MessageParser empty("");
-  for (int i = 0; i < N_TYPES; i++) msg_parsers[i] = &empty;
-
-  // treat filters
-  std::vector<char> filter_msgs;
-  std::vector<int>  filter_sloc;
-
-  for (auto f : filter_msg_type) filter_msgs.push_back(Rcpp::as<char>(f));
-  for (int s : filter_stock_locate) filter_sloc.push_back(s);
-
-  const size_t ts_size = min_timestamp.size();
-  std::vector<int64_t> min_ts(ts_size);
-
-  if (ts_size > 0)
-    std::memcpy(&(min_ts[0]), &(min_timestamp[0]), ts_size * sizeof(int64_t));
-  
-  std::vector<int64_t> max_ts(ts_size);
-  if (ts_size > 0)
-    std::memcpy(&(max_ts[0]), &(max_timestamp[0]), ts_size * sizeof(int64_t));
-
-  if (max_ts.size() == 1 && max_ts[0] == -1)
-    max_ts[0] = std::numeric_limits<int64_t>::max();
-
-  // get the max_ts_value!
-  int64_t max_ts_val = -1;
-  for (auto t : max_ts) if (t > max_ts_val) max_ts_val = t;
-  if (max_ts_val == -1) max_ts_val = std::numeric_limits<int64_t>::max();
-
-  // Rprintf("Loading Message Parsers\n");
-  for (std::string cls : MSG_CLASSES) {
-    // Rprintf("Looking at message class '%s'\n", cls.c_str());
-    MessageParser* msgp_ptr = new MessageParser(cls, start, end);
-
-    // check if this class needs to be activated?!
-    for (const std::string &c : classes) if (c == cls) msgp_ptr->activate();
-
-    int64_t num_msg_this_type = 0;
-    std::vector<char> this_msg_types = msgp_ptr->msg_types;
-
-    for (const unsigned char mt : this_msg_types) num_msg_this_type += count[mt - 'A'];
-
-    if (msgp_ptr->active) {
-      if (!quiet && num_msg_this_type != 0)
-        Rprintf("[Counting]   num '%s' messages %s\n",
-                cls.c_str(), format_thousands(num_msg_this_type).c_str());
-
-      // Rprintf("Active and resized to '%i'\n", num_msg_this_type);
-      msgp_ptr->init_vectors(num_msg_this_type);
+  create_parsers(table, class_to_parsers);
+  if (has_executions)
+    executions = static_cast<ExecutionsParser*>(class_to_parsers["executions"]);
+
+  // each requested column must exist in at least one of the classes
+  for (const std::string &col : columns) {
+    bool found = false;
+    for (auto &cp : class_to_parsers)
+      if (cp.second->has_column(col)) found = true;
+
+    if (!found) {
+      delete_parsers(class_to_parsers);
+      Rcpp::stop("Column '%s' not found in the selected message classes",
+                 col.c_str());
     }
-
-    class_to_parsers[cls] = msgp_ptr;
-    for (const unsigned char mt : msgp_ptr->msg_types) msg_parsers[mt - 'A'] = msgp_ptr;
   }
 
   // parse the messages
   // redirect to the correct msg types only
-  FILE* infile;
-  infile = fopen(filename.c_str(), "rb");
-  if (infile == NULL) {
-    char buffer [50];
-    snprintf(buffer, sizeof(buffer), "File Error number %i!", errno);
-    Rcpp::stop(buffer);
-  }
-
-  // get size of the file
-  if (fseeko64(infile, 0L, SEEK_END) != 0) {
-    Rcpp::stop("Error seeking to end of file");
-  }
-  int64_t filesize = ftello64(infile);
-  if (filesize == -1) {
-    Rcpp::stop("Error getting file size");
-  }
-  if (fseeko64(infile, 0L, SEEK_SET) != 0) {
-    Rcpp::stop("Error seeking back to start of file");
-  }
-
-  // create buffer
-  int64_t buf_size = max_buffer_size > filesize ? filesize : max_buffer_size;
-  unsigned char * buf;
-  buf = (unsigned char*) malloc(sizeof(unsigned char) * buf_size);
-  // Rprintf("Allocating buffer to size %lld\n", buf_size);
+  int64_t total_msgs = 0;
 
-  int64_t bytes_read = 0, this_buffer_size = 0;
-  bool max_ts_reached = false;
+#ifndef _OPENMP
+  n_threads = 1;
+#endif
 
-  while (bytes_read < filesize && !max_ts_reached) {
-    Rcpp::checkUserInterrupt();
+  // the parallel mode needs random access to the file and cannot skip a
+  // number of messages (the counts are only known after parsing), the
+  // executions and the lineage depend on all previous orders
+  if (n_threads > 1 && !reader.gz && !reader.ranged() && start == 0 && end < 0 &&
+      !sequential) {
+    // split the file into more parts than threads to balance the load,
+    // each part is parsed into its own MessageParsers, which are appended
+    // in file order afterwards
+    const int n_parts = n_threads * 4;
+    std::vector<int64_t> bounds = reader.split(n_parts);
+    unsigned char * data = reader.mapped_data();
+
+    std::vector<ParserTable> part_tables(n_parts);
+    std::vector<std::map<std::string, MessageParser*>> part_class_parsers(n_parts);
+    std::vector<int64_t> part_msgs(n_parts, 0);
+    // the error of each part, empty if the part was parsed
+    std::vector<std::string> part_error(n_parts);
+
+    part_tables[0] = table;
+    part_class_parsers[0] = class_to_parsers;
+    for (int p = 1; p < n_parts; p++)
+      create_parsers(part_tables[p], part_class_parsers[p]);
+
+#pragma omp parallel for num_threads(n_threads) schedule(dynamic)
+    for (int p = 0; p < n_parts; p++) {
+      // exceptions (e.g., std::bad_alloc) must not leave the parallel region
+      // as the timestamps are increasing, parts after max_timestamp stop at
+      // their first message
+      try {
+        bool max_ts_reached = false;
+        parse_buffer(&data[bounds[p]], bounds[p + 1] - bounds[p],
+                     part_tables[p], part_msgs[p], max_ts_reached);
+      } catch (std::bad_alloc &) {
+        part_error[p] = "Out of Memory";
+      } catch (std::exception &e) {
+        part_error[p] = e.what();
+      } catch (...) {
+        part_error[p] = "Unknown error while parsing";
+      }
+    }
 
-    // read in buffer buffers
-    this_buffer_size = fread(buf, 1, buf_size, infile);
-    int64_t i = 0;
+    // the error of the first part that failed is raised
+    std::string error;
+    for (int p = 0; p < n_parts; p++) {
+      if (error.empty()) error = part_error[p];
+      total_msgs += part_msgs[p];
+    }
 
-    int msg_size = 0;
-    do {
-      // Rprintf("offset %lld:%lld (size size %lld) '%c'\n",
-      //         bytes_read + i, bytes_read + i + get_message_size(buf[i + 2]),
-      //         get_message_size(buf[i + 2]), buf[i + 2]);
+    for (int p = 1; p < n_parts; p++) {
+      for (auto &cp : class_to_parsers)
+        cp.second->append(*part_class_parsers[p][cp.first]);
+      delete_parsers(part_class_parsers[p]);
+    }
 
-      // check early stop in max_timestamp
-      const int64_t cur_ts = getNBytes64<6>(&buf[i + 2 + 5]);
-      if (cur_ts > max_ts_val) {
-        max_ts_reached = true;
-        break;
-      }
+    if (!error.empty()) {
+      delete_parsers(class_to_parsers);
+      Rcpp::stop(error);
+    }
+  } else {
+    unsigned char * buf;
+    int64_t this_buffer_size;
+    bool max_ts_reached = false;
+
+    while (!max_ts_reached && (this_buffer_size = reader.next_block(buf)) > 0) {
+      Rcpp::checkUserInterrupt();
+      reader.consume(parse_buffer(buf, this_buffer_size, table,
+                                  total_msgs, max_ts_reached));
+    }
+  }
 
-      const unsigned char mt = buf[i + 2];
-      // Check Filter Messages
-      bool parse_message = true;
-      // only check the filter if previous tests are all OK
-      if (parse_message)
-        parse_message = passes_filter(&buf[i + 2], filter_msgs);
-      if (parse_message)
-        parse_message = passes_filter(&buf[i + 2 + 1], filter_sloc);
-      if (parse_message)
-        parse_message = passes_filter_in(&buf[i + 2 + 5], min_ts, max_ts);
-
-      msg_size = get_message_size(mt);
-
-      if (parse_message) msg_parsers[mt - 'A']->parse_message(&buf[i + 2]);
-
-      // Rprintf("  take ? %i\n", msg_parsers[mt - 'A']->active ? 1 : 0);
-      // Rprintf("msg size %lld\n", msg_size);
-      i += msg_size;
-      // Rprintf("  i %lld\n", i);
-
-      // Rprintf("i + msg_size <= this_buffer_size %lld <= %lld\n",
-      // i + msg_size, this_buffer_size);
-      // Rprintf("bytes_read + i <= filesize %lld <= %lld\n",
-      // bytes_read + i, filesize);
-
-    } while (i + msg_size <= this_buffer_size && bytes_read + i <= filesize);
-
-    // offset file pointer to fit the next message into the buffer
-    const int64_t offset = i - this_buffer_size;
-    fseeko64(infile, offset, SEEK_CUR);
-    bytes_read += i;
+  if (!quiet) {
+    Rprintf("[Counting]   num messages %s\n", format_thousands(total_msgs).c_str());
+    for (std::string cls : classes) {
+      const int64_t n = class_to_parsers[cls]->n_parsed();
+      if (n != 0)
+        Rprintf("[Counting]   num '%s' messages %s\n",
+                cls.c_str(), format_thousands(n).c_str());
+    }
   }
-  
 
   // gather the data.frames into a list
   Rcpp::List res;
   Rcpp::CharacterVector res_names;
 
-  for (std::string cls : classes)
-    res.push_back(class_to_parsers[cls]->get_data_frame());
+  // get_data_frame() releases the vectors of a parser, i.e., can be called once
+  std::map<std::string, Rcpp::List> class_to_df;
+  for (std::string cls : classes) {
+    if (class_to_df.count(cls) == 0)
+      class_to_df[cls] = class_to_parsers[cls]->get_data_frame();
+    res.push_back(class_to_df[cls]);
+  }
 
   res.attr("names") = classes;
 
   // clean up
-  free(buf);
-  fclose(infile);
   // delete MessageParser (msgp_ptr) objects
-  for (std::string cls : MSG_CLASSES) delete class_to_parsers[cls];
+  delete_parsers(class_to_parsers);
 
   return res;
 }
@@ -201,724 +242,534 @@ Rcpp::List read_itch_impl(std::vector<std::string> classes,
 // Message Parser Functions
 // #############################################################################
 
-MessageParser::MessageParser(std::string type, int64_t start_count, int64_t end_count) {
-  std::vector<std::string> base_colnames = {
-    "msg_type", "stock_locate", "tracking_number", "timestamp"
-  };
-
+MessageParser::MessageParser(int64_t start_count, int64_t end_count) {
   this->start_count = start_count;
   this->end_count = end_count == -1 ? std::numeric_limits<int64_t>::max() : end_count;
-  this->type = type;
-
-  if (type == "system_events") {
-    msg_types = {'S'};
-    colnames = {"event_code"};
-  } else if (type == "stock_directory") {
-    msg_types = {'R'};
-    colnames = {"stock", "market_category", "financial_status", "lot_size",
-                "round_lots_only", "issue_classification", "issue_subtype",
-                "authentic", "short_sell_closeout", "ipo_flag",
-                "luld_price_tier", "etp_flag", "etp_leverage", "inverse"};
-  } else if (type == "trading_status") {
-    msg_types = {'H', 'h'};
-    colnames = {"stock", "trading_state", "reserved", "reason", "market_code",
-                "operation_halted"};
-  } else if (type == "reg_sho") {
-    msg_types = {'Y'};
-    colnames = {"stock", "regsho_action"};
-  } else if (type == "market_participant_states") {
-    msg_types = {'L'};
-    colnames = {"mpid", "stock", "primary_mm", "mm_mode", "participant_state"};
-  } else if (type == "mwcb") {
-    msg_types = {'V', 'W'};
-    colnames = {"level1", "level2", "level3", "breached_level"};
-  } else if (type == "ipo") {
-    msg_types = {'K'};
-    colnames = {"stock", "release_time", "release_qualifier", "ipo_price"};
-  } else if (type == "luld") {
-    msg_types = {'J'};
-    colnames = {"stock", "reference_price", "upper_price", "lower_price",
-                "extension"};
-  } else if (type == "orders") {
-    msg_types = {'A', 'F'};
-    colnames = {"order_ref", "buy", "shares", "stock", "price", "mpid"};
-  } else if (type == "modifications") {
-    msg_types = {'E', 'C', 'X', 'D', 'U'};
-    colnames = {"order_ref", "shares", "match_number", "printable", "price",
-                "new_order_ref"};
-  } else if (type == "trades") {
-    msg_types = {'P', 'Q', 'B'};
-    colnames = {"order_ref", "buy", "shares", "stock", "price",
-                "match_number", "cross_type"};
-  } else if (type == "noii") {
-    msg_types = {'I'};
-    colnames = {"paired_shares", "imbalance_shares", "imbalance_direction",
-                "stock", "far_price", "near_price", "reference_price",
-                "cross_type", "variation_indicator"};
-  } else if (type == "rpii") {
-    msg_types = {'N'};
-    colnames = {"stock", "interest_flag"};
-  } else if (type == "") {
-    msg_types = {};
-    colnames = {};
-  } else {
-    Rprintf("Unkown type of type '%s'\n", type.c_str());
-    Rcpp::stop("Unknown message type\n");
-  }
-  colnames.insert(colnames.begin(), base_colnames.begin(), base_colnames.end());
-}
 
-// activates the class so that it actually parses messages when asked!
-// this is done to make it easier to parse multiple classes.
-void MessageParser::activate() {
-  active = true;
+  add_columns({{"msg_type", &msg_type}, {"stock_locate", &stock_locate},
+               {"tracking_number", &tracking_number}, {"timestamp", &timestamp}});
 }
 
+// adds columns (name and values) to the end of the data.frame
+void MessageParser::add_columns(std::vector<std::pair<std::string, Column*>> cols) {
+  columns.insert(columns.end(), cols.begin(), cols.end());
+}
 
-// creates and resizes all needed vectors to a given size (n)
-void MessageParser::init_vectors(int64_t n) {
-  if (!active) return;
-  size = n;
-  // Rprintf("Resize %s to %lld\n", type.c_str(), n);
-
-  msg_type        = Rcpp::CharacterVector(n);
-  stock_locate    = Rcpp::IntegerVector(n);
-  tracking_number = Rcpp::IntegerVector(n);
-  timestamp       = Rcpp::NumericVector(n);
-
-  if (type == "system_events") {
-
-    event_code = Rcpp::CharacterVector(n);
-
-  } else if (type == "stock_directory") {
-
-    stock                = Rcpp::CharacterVector(n);
-    market_category      = Rcpp::CharacterVector(n);
-    financial_status     = Rcpp::CharacterVector(n);
-    lot_size             = Rcpp::IntegerVector(n);
-    round_lots_only      = Rcpp::LogicalVector(n);
-    issue_classification = Rcpp::CharacterVector(n);
-    issue_subtype        = Rcpp::CharacterVector(n);
-    authentic            = Rcpp::LogicalVector(n);
-    short_sell_closeout  = Rcpp::LogicalVector(n);
-    ipo_flag             = Rcpp::LogicalVector(n);
-    luld_price_tier      = Rcpp::CharacterVector(n);
-    etp_flag             = Rcpp::LogicalVector(n);
-    etp_leverage         = Rcpp::IntegerVector(n);
-    inverse              = Rcpp::LogicalVector(n);
-
-  } else if (type == "trading_status") {
-
-    stock            = Rcpp::CharacterVector(n);
-    trading_state    = Rcpp::CharacterVector(n);
-    reserved         = Rcpp::CharacterVector(n);
-    reason           = Rcpp::CharacterVector(n);
-    market_code      = Rcpp::CharacterVector(n);
-    operation_halted = Rcpp::LogicalVector(n);
-
-  } else if (type == "reg_sho") {
-
-    stock         = Rcpp::CharacterVector(n);
-    regsho_action = Rcpp::CharacterVector(n);
-
-  } else if (type == "market_participant_states") {
-
-    mpid              = Rcpp::CharacterVector(n);
-    stock             = Rcpp::CharacterVector(n);
-    primary_mm        = Rcpp::LogicalVector(n);
-    mm_mode           = Rcpp::CharacterVector(n);
-    participant_state = Rcpp::CharacterVector(n);
-
-  } else if (type == "mwcb") {
-
-    level1         = Rcpp::NumericVector(n);
-    level2         = Rcpp::NumericVector(n);
-    level3         = Rcpp::NumericVector(n);
-    breached_level = Rcpp::IntegerVector(n);
-
-  } else if (type == "ipo") {
-
-    stock             = Rcpp::CharacterVector(n);
-    release_time      = Rcpp::IntegerVector(n);
-    release_qualifier = Rcpp::CharacterVector(n);
-    ipo_price         = Rcpp::NumericVector(n);
-
-  } else if (type == "luld") {
-
-    stock           = Rcpp::CharacterVector(n);
-    reference_price = Rcpp::NumericVector(n);
-    upper_price     = Rcpp::NumericVector(n);
-    lower_price     = Rcpp::NumericVector(n);
-    extension       = Rcpp::IntegerVector(n);
-
-  } else if (type == "orders") {
-
-    order_ref = Rcpp::NumericVector(n);
-    buy       = Rcpp::LogicalVector(n);
-    shares    = Rcpp::IntegerVector(n);
-    stock     = Rcpp::CharacterVector(n);
-    price     = Rcpp::NumericVector(n);
-    mpid      = Rcpp::CharacterVector(n);
-
-  } else if (type == "modifications") {
-
-    order_ref     = Rcpp::NumericVector(n);
-    shares        = Rcpp::IntegerVector(n);
-    match_number  = Rcpp::NumericVector(n);
-    printable     = Rcpp::LogicalVector(n);
-    price         = Rcpp::NumericVector(n);
-    new_order_ref = Rcpp::NumericVector(n);
-
-  } else if (type == "trades") {
-
-    order_ref    = Rcpp::NumericVector(n);
-    buy          = Rcpp::LogicalVector(n);
-    shares       = Rcpp::IntegerVector(n);
-    stock        = Rcpp::CharacterVector(n);
-    price        = Rcpp::NumericVector(n);
-    match_number = Rcpp::NumericVector(n);
-    cross_type   = Rcpp::CharacterVector(n);
-
-  } else if (type == "noii") {
-
-    paired_shares       = Rcpp::NumericVector(n);
-    imbalance_shares    = Rcpp::NumericVector(n);
-    imbalance_direction = Rcpp::CharacterVector(n);
-    stock               = Rcpp::CharacterVector(n);
-    far_price           = Rcpp::NumericVector(n);
-    near_price          = Rcpp::NumericVector(n);
-    reference_price     = Rcpp::NumericVector(n);
-    cross_type          = Rcpp::CharacterVector(n);
-    variation_indicator = Rcpp::CharacterVector(n);
-
-  } else if (type == "rpii") {
-
-    stock         = Rcpp::CharacterVector(n);
-    interest_flag = Rcpp::CharacterVector(n);
+// drops all columns that are not in names, the dropped columns are not
+// allocated, not decoded, and not part of the data.frame
+void MessageParser::select_columns(const std::vector<std::string> &names) {
+  if (names.size() == 0) return;
 
+  for (auto &col : columns) {
+    if (std::find(names.begin(), names.end(), col.first) == names.end()) {
+      col.second->deselect();
+      parse_function = parse_selected_function;
+    }
   }
 }
 
-// prunes all used vectors to its index (= actual used size)
-void MessageParser::prune_vectors() {
-  if (!active) return;
+bool MessageParser::has_column(const std::string &name) const {
+  for (auto &col : columns) if (col.first == name) return true;
+  return false;
+}
 
-  msg_type.erase(        msg_type.begin() + index,         msg_type.end());
-  stock_locate.erase(    stock_locate.begin() + index,     stock_locate.end());
-  tracking_number.erase( tracking_number.begin() + index,  tracking_number.end());
-  timestamp.erase(       timestamp.begin() + index,        timestamp.end());
+std::vector<std::string> MessageParser::column_names() const {
+  std::vector<std::string> res;
+  for (auto &col : columns) if (col.second->selected()) res.push_back(col.first);
+  return res;
+}
 
-  if (type == "system_events") {
-
-    event_code.erase( event_code.begin() + index,  event_code.end());
-
-  } else if (type == "stock_directory") {
-
-    stock.erase(                stock.begin() + index,                 stock.end());
-    market_category.erase(      market_category.begin() + index,       market_category.end());
-    financial_status.erase(     financial_status.begin() + index,      financial_status.end());
-    lot_size.erase(             lot_size.begin() + index,              lot_size.end());
-    round_lots_only.erase(      round_lots_only.begin() + index,       round_lots_only.end());
-    issue_classification.erase( issue_classification.begin() + index,  issue_classification.end());
-    issue_subtype.erase(        issue_subtype.begin() + index,         issue_subtype.end());
-    authentic.erase(            authentic.begin() + index,             authentic.end());
-    short_sell_closeout.erase(  short_sell_closeout.begin() + index,   short_sell_closeout.end());
-    ipo_flag.erase(             ipo_flag.begin() + index,              ipo_flag.end());
-    luld_price_tier.erase(      luld_price_tier.begin() + index,       luld_price_tier.end());
-    etp_flag.erase(             etp_flag.begin() + index,              etp_flag.end());
-    etp_leverage.erase(         etp_leverage.begin() + index,          etp_leverage.end());
-    inverse.erase(              inverse.begin() + index,               inverse.end());
+// inits the vectors to a given size (n), e.g., if the number of messages is
+// known upfront, otherwise the vectors grow while parsing
+void MessageParser::init_vectors(int64_t n) {
+  resize_vectors(n);
+}
 
-  } else if (type == "trading_status") {
+// resizes all vectors to a given size (n), previous values are kept
+void MessageParser::resize_vectors(int64_t n) {
+  size = n;
+  // Rprintf("Resize to %lld\n", n);
+  for (auto &col : columns) col.second->resize(n);
+}
 
-    stock.erase(            stock.begin() + index,             stock.end());
-    trading_state.erase(    trading_state.begin() + index,     trading_state.end());
-    reserved.erase(         reserved.begin() + index,          reserved.end());
-    reason.erase(           reason.begin() + index,            reason.end());
-    market_code.erase(      market_code.begin() + index,       market_code.end());
-    operation_halted.erase( operation_halted.begin() + index,  operation_halted.end());
+// appends the messages of another parser of the same class (e.g., parsed from
+// a later part of the file), the vectors of other are released afterwards
+void MessageParser::append(MessageParser &other) {
+  resize_vectors(index);
 
-  } else if (type == "reg_sho") {
+  for (size_t j = 0; j < columns.size(); j++)
+    columns[j].second->append(*other.columns[j].second, other.index);
 
-    stock.erase(         stock.begin() + index,          stock.end());
-    regsho_action.erase( regsho_action.begin() + index,  regsho_action.end());
+  index += other.index;
+  size = index;
+  n_shares_overflow += other.n_shares_overflow;
+  other.index = 0;
+  other.size = 0;
+}
 
-  } else if (type == "market_participant_states") {
+// counts the message and checks if it needs to be parsed (skip/n_max), if so
+// makes sure that there is room for it in the vectors
+bool MessageParser::next_row() {
+  msg_buf_idx++;
 
-    mpid.erase(              mpid.begin() + index,               mpid.end());
-    stock.erase(             stock.begin() + index,              stock.end());
-    primary_mm.erase(        primary_mm.begin() + index,         primary_mm.end());
-    mm_mode.erase(           mm_mode.begin() + index,            mm_mode.end());
-    participant_state.erase( participant_state.begin() + index,  participant_state.end());
+  // check indices; -1 as msg_buf_idx has already advanced
+  if (msg_buf_idx - 1 < start_count) return false;
+  if (msg_buf_idx - 1 > end_count) return false;
 
-  } else if (type == "mwcb") {
+  // grow the vectors geometrically if they are full
+  if (index >= size) resize_vectors(std::max(2 * size, (int64_t) 1024));
+  return true;
+}
 
-    level1.erase(         level1.begin() + index,          level1.end());
-    level2.erase(         level2.begin() + index,          level2.end());
-    level3.erase(         level3.begin() + index,          level3.end());
-    breached_level.erase( breached_level.begin() + index,  breached_level.end());
+// Converts the messages parsed to a data frame, the vectors are released
+// unless keep is set (then they are reused for the next messages, see clear())
+Rcpp::List MessageParser::get_data_frame(bool keep) {
+  // prune vectors to the number of parsed messages
+  if (!keep && index != size) resize_vectors(index);
 
-  } else if (type == "ipo") {
+  report_overflow();
 
-    stock.erase(             stock.begin() + index,              stock.end());
-    release_time.erase(      release_time.begin() + index,       release_time.end());
-    release_qualifier.erase( release_qualifier.begin() + index,  release_qualifier.end());
-    ipo_price.erase(         ipo_price.begin() + index,          ipo_price.end());
+  // create a dataframe
+  Rcpp::List res;
+  std::vector<std::string> colnames;
+  for (auto &col : columns) {
+    if (!col.second->selected()) continue;
+    res.push_back(keep ? col.second->head_to_r(index) : col.second->to_r());
+    colnames.push_back(col.first);
+  }
 
-  } else if (type == "luld") {
+  // need to call data.table::setalloccol() on data in R!
+  res.names() = colnames;
+  res.attr("class") = Rcpp::StringVector::create("data.table", "data.frame");
 
-    stock.erase(           stock.begin() + index,            stock.end());
-    reference_price.erase( reference_price.begin() + index,  reference_price.end());
-    upper_price.erase(     upper_price.begin() + index,      upper_price.end());
-    lower_price.erase(     lower_price.begin() + index,      lower_price.end());
-    extension.erase(       extension.begin() + index,        extension.end());
+  return res;
+}
 
-  } else if (type == "orders") {
+void MessageParser::to_arrow(ArrowBatch &batch) {
+  report_overflow();
+  for (auto &col : columns)
+    if (col.second->selected()) col.second->to_arrow(batch, col.first, index);
+}
 
-    order_ref.erase( order_ref.begin() + index,  order_ref.end());
-    buy.erase(       buy.begin() + index,        buy.end());
-    shares.erase(    shares.begin() + index,     shares.end());
-    stock.erase(     stock.begin() + index,      stock.end());
-    price.erase(     price.begin() + index,      price.end());
-    mpid.erase(      mpid.begin() + index,       mpid.end());
+void MessageParser::report_overflow() {
+  if (n_shares_overflow > 0)
+    Rcpp::Rcout << "Warning, overflow for shares on " << n_shares_overflow <<
+      " 'Q' message(s)\n";
+  n_shares_overflow = 0;
+}
 
-  } else if (type == "modifications") {
+Rcpp::List columns_to_data_frame(std::vector<std::pair<std::string, Column*>> cols,
+                                 int64_t n) {
+  Rcpp::List res;
+  std::vector<std::string> colnames;
+  for (auto &col : cols) {
+    col.second->resize(n);
+    res.push_back(col.second->to_r());
+    colnames.push_back(col.first);
+  }
 
-    order_ref.erase(     order_ref.begin() + index,      order_ref.end());
-    shares.erase(        shares.begin() + index,         shares.end());
-    match_number.erase(  match_number.begin() + index,   match_number.end());
-    printable.erase(     printable.begin() + index,      printable.end());
-    price.erase(         price.begin() + index,          price.end());
-    new_order_ref.erase( new_order_ref.begin() + index,  new_order_ref.end());
+  // need to call data.table::setalloccol() on data in R!
+  res.names() = colnames;
+  res.attr("class") = Rcpp::StringVector::create("data.table", "data.frame");
+  return res;
+}
 
-  } else if (type == "trades") {
+MessageParser * create_parser(const std::string &cls, int64_t skip, int64_t n_max) {
+  if (cls == "system_events")             return new SystemEventsParser(skip, n_max);
+  if (cls == "stock_directory")           return new StockDirectoryParser(skip, n_max);
+  if (cls == "trading_status")            return new TradingStatusParser(skip, n_max);
+  if (cls == "reg_sho")                   return new RegShoParser(skip, n_max);
+  if (cls == "market_participant_states") return new MarketParticipantStatesParser(skip, n_max);
+  if (cls == "mwcb")                      return new MwcbParser(skip, n_max);
+  if (cls == "ipo")                       return new IpoParser(skip, n_max);
+  if (cls == "luld")                      return new LuldParser(skip, n_max);
+  if (cls == "orders")                    return new OrdersParser(skip, n_max);
+  if (cls == "modifications")             return new ModificationsParser(skip, n_max);
+  if (cls == "executions")                return new ExecutionsParser(skip, n_max);
+  if (cls == "trades")                    return new TradesParser(skip, n_max);
+  if (cls == "noii")                      return new NoiiParser(skip, n_max);
+  if (cls == "rpii")                      return new RpiiParser(skip, n_max);
+
+  Rprintf("Unkown type of type '%s'\n", cls.c_str());
+  Rcpp::stop("Unknown message type\n");
+}
 
-    order_ref.erase(    order_ref.begin() + index,     order_ref.end());
-    buy.erase(          buy.begin() + index,           buy.end());
-    shares.erase(       shares.begin() + index,        shares.end());
-    stock.erase(        stock.begin() + index,         stock.end());
-    price.erase(        price.begin() + index,         price.end());
-    match_number.erase( match_number.begin() + index,  match_number.end());
-    cross_type.erase(   cross_type.begin() + index,    cross_type.end());
-
-  } else if (type == "noii") {
-
-    paired_shares.erase(       paired_shares.begin() + index,        paired_shares.end());
-    imbalance_shares.erase(    imbalance_shares.begin() + index,     imbalance_shares.end());
-    imbalance_direction.erase( imbalance_direction.begin() + index,  imbalance_direction.end());
-    stock.erase(               stock.begin() + index,                stock.end());
-    far_price.erase(           far_price.begin() + index,            far_price.end());
-    near_price.erase(          near_price.begin() + index,           near_price.end());
-    reference_price.erase(     reference_price.begin() + index,      reference_price.end());
-    cross_type.erase(          cross_type.begin() + index,           cross_type.end());
-    variation_indicator.erase( variation_indicator.begin() + index,  variation_indicator.end());
-
-  } else if (type == "rpii") {
-
-    stock.erase(         stock.begin() + index,          stock.end());
-    interest_flag.erase( interest_flag.begin() + index,  interest_flag.end());
+// used for all message types without a parser
+static void ignore_message(MessageParser *, unsigned char *) {}
 
+ParserTable::ParserTable() {
+  for (int i = 0; i < 256; i++) {
+    functions[i] = &ignore_message;
+    parsers[i] = NULL;
   }
 }
 
-// Parses a message if the object is active and the message type belongs to this
-// class!
-void MessageParser::parse_message(unsigned char * buf) {
-
-  if (!active) return;
-
-  // -> if !any(msg_types == buf[2]) return...
-  bool cont = false;
-  for (unsigned char type : msg_types) if (type == buf[0]) cont = true;
-  if (!cont) return;
-
-  msg_buf_idx++;
-
-  // check indices; -1 as msg_buf_idx has already advanced,
-  // msg_buf_idx has already advanced b.c. of possible early returns
-  if (msg_buf_idx - 1 < start_count) return;
-  if (msg_buf_idx - 1 > end_count) {
-    // stop parsing future messages
-    active = false;
-    return;
+void ParserTable::add_parser(MessageParser * parser) {
+  for (const unsigned char mt : parser->msg_types) {
+    functions[mt] = parser->parse_function;
+    parsers[mt] = parser;
   }
+}
 
-  // for all parse:
-  // msg_type, stock_locate, tracking_number and timestamp
-  msg_type[index]        = std::string(1, buf[0]);
-  stock_locate[index]    = getNBytes32<2>(&buf[1]);
-  tracking_number[index] = getNBytes32<2>(&buf[3]);
-  int64_t ts = getNBytes64<6>(&buf[5]);
-  std::memcpy(&(timestamp[index]), &ts, sizeof(double));
-
-  // parse specific values for each message
-  if (type == "system_events") {
-    event_code[index] = std::string(1, buf[11]);
-  } else if (type == "stock_directory") {
-
-    stock[index]                = getNBytes(&buf[11], 8);
-    market_category[index]      = std::string(1, buf[19]);
-    financial_status[index]     = std::string(1, buf[20]);
-    lot_size[index]             = getNBytes32<4>(&buf[21]);
-    round_lots_only[index]      = buf[25] == 'Y';
-    issue_classification[index] = std::string(1, buf[26]);
-    issue_subtype[index]        = getNBytes(&buf[27], 2);
-    authentic[index]            = buf[29] == 'P'; // P is live/production, T is Test
-    short_sell_closeout[index]  = buf[30] == 'Y' ? true : buf[30] == 'N' ? false : NA_LOGICAL;
-    ipo_flag[index]             = buf[31] == 'Y' ? true : buf[31] == 'N' ? false : NA_LOGICAL;
-    luld_price_tier[index]      = std::string(1, buf[32]);
-    etp_flag[index]             = buf[33] == 'Y' ? true : buf[33] == 'N' ? false : NA_LOGICAL;
-    etp_leverage[index]         = getNBytes32<4>(&buf[34]);
-    inverse[index]              = buf[38] == 'Y';
-
-  } else if (type == "trading_status") {
-
-    stock[index] = getNBytes(&buf[11], 8);
-
-    if (buf[0] == 'H') {
-      trading_state[index]    = std::string(1, buf[19]);
-      reserved[index]         = std::string(1, buf[20]);
-      reason[index]           = getNBytes(&buf[21], 4);
-      // fill NAs from h
-      market_code[index]      = NA_STRING;
-      operation_halted[index] = NA_LOGICAL;
-    } else { // buf[0] == 'h'
-      market_code[index]      = std::string(1, buf[19]);
-      operation_halted[index] = buf[20] == 'H';
-      // fill NAs from H
-      trading_state[index]    = NA_STRING;
-      reserved[index]         = NA_STRING;
-      reason[index]           = NA_STRING;
-    }
-
-  } else if (type == "reg_sho") {
-
-    stock[index] = getNBytes(&buf[11], 8);
-    regsho_action[index] = std::string(1, buf[19]);
+// #############################################################################
+// Parse functions for the specific message classes
+// #############################################################################
 
-  } else if (type == "market_participant_states") {
+SystemEventsParser::SystemEventsParser(int64_t skip, int64_t n_max) :
+  MessageParserImpl(skip, n_max) {
+  msg_types = {'S'};
+  add_columns({{"event_code", &event_code}});
+}
 
-    mpid[index]              = getNBytes(&buf[11], 4);
-    stock[index]             = getNBytes(&buf[15], 8);
-    primary_mm[index]        = buf[23] == 'Y';
-    mm_mode[index]           = std::string(1, buf[24]);
-    participant_state[index] = std::string(1, buf[25]);
+template<bool all>
+void SystemEventsParser::parse_fields(unsigned char * buf) {
+  if (all || event_code.selected()) event_code[index] = buf[11];
+}
 
-  } else if (type == "mwcb") {
+StockDirectoryParser::StockDirectoryParser(int64_t skip, int64_t n_max) :
+  MessageParserImpl(skip, n_max) {
+  msg_types = {'R'};
+  add_columns({{"stock", &stock}, {"market_category", &market_category},
+               {"financial_status", &financial_status}, {"lot_size", &lot_size},
+               {"round_lots_only", &round_lots_only},
+               {"issue_classification", &issue_classification},
+               {"issue_subtype", &issue_subtype}, {"authentic", &authentic},
+               {"short_sell_closeout", &short_sell_closeout},
+               {"ipo_flag", &ipo_flag}, {"luld_price_tier", &luld_price_tier},
+               {"etp_flag", &etp_flag}, {"etp_leverage", &etp_leverage},
+               {"inverse", &inverse}});
+}
 
-    if (buf[0] == 'V') {
-      level1[index]         = ((double) getNBytes64<8>(&buf[11])) / 100000000.0;
-      level2[index]         = ((double) getNBytes64<8>(&buf[19])) / 100000000.0;
-      level3[index]         = ((double) getNBytes64<8>(&buf[27])) / 100000000.0;
-      breached_level[index] = NA_INTEGER;
-    } else { // buf[0] == 'W'
-      breached_level[index] = buf[11] - '0';
-      level1[index]         = NA_REAL;
-      level1[index]         = NA_REAL;
-      level1[index]         = NA_REAL;
-    }
+// Y is true, N is false, all others (e.g., ' ', not available) are NA
+static inline int yes_no(const unsigned char c) {
+  return c == 'Y' ? true : c == 'N' ? false : NA_LOGICAL;
+}
 
-  } else if (type == "ipo") {
+template<bool all>
+void StockDirectoryParser::parse_fields(unsigned char * buf) {
+  if (all || stock.selected())                stock[index]                = getNBytes64<8>(&buf[11]);
+  if (all || market_category.selected())      market_category[index]      = buf[19];
+  if (all || financial_status.selected())     financial_status[index]     = buf[20];
+  if (all || lot_size.selected())             lot_size[index]             = getNBytes32<4>(&buf[21]);
+  if (all || round_lots_only.selected())      round_lots_only[index]      = buf[25] == 'Y';
+  if (all || issue_classification.selected()) issue_classification[index] = buf[26];
+  if (all || issue_subtype.selected())        issue_subtype[index]        = getNBytes64<2>(&buf[27]);
+  if (all || authentic.selected())            authentic[index]            = buf[29] == 'P'; // P is live/production, T is Test
+  if (all || short_sell_closeout.selected())  short_sell_closeout[index]  = yes_no(buf[30]);
+  if (all || ipo_flag.selected())             ipo_flag[index]             = yes_no(buf[31]);
+  if (all || luld_price_tier.selected())      luld_price_tier[index]      = buf[32];
+  if (all || etp_flag.selected())             etp_flag[index]             = yes_no(buf[33]);
+  if (all || etp_leverage.selected())         etp_leverage[index]         = getNBytes32<4>(&buf[34]);
+  if (all || inverse.selected())              inverse[index]              = buf[38] == 'Y';
+}
 
-    stock[index]             = getNBytes(&buf[11], 8);
-    release_time[index]      = getNBytes32<4>(&buf[19]);
-    release_qualifier[index] = std::string(1, buf[23]);
-    ipo_price[index]         = ((double) getNBytes32<4>(&buf[24])) / 10000.0;
+TradingStatusParser::TradingStatusParser(int64_t skip, int64_t n_max) :
+  MessageParserImpl(skip, n_max) {
+  msg_types = {'H', 'h'};
+  add_columns({{"stock", &stock}, {"trading_state", &trading_state},
+               {"reserved", &reserved}, {"reason", &reason},
+               {"market_code", &market_code},
+               {"operation_halted", &operation_halted}});
+}
 
-  } else if (type == "luld") {
+template<bool all>
+void TradingStatusParser::parse_fields(unsigned char * buf) {
+  if (all || stock.selected()) stock[index] = getNBytes64<8>(&buf[11]);
+
+  if (buf[0] == 'H') {
+    if (all || trading_state.selected()) trading_state[index] = buf[19];
+    if (all || reserved.selected())      reserved[index]      = buf[20];
+    if (all || reason.selected())        reason[index]        = getNBytes64<4>(&buf[21]);
+    // fill NAs from h
+    if (all || market_code.selected())      market_code[index]      = NA_INT64;
+    if (all || operation_halted.selected()) operation_halted[index] = NA_LOGICAL;
+  } else { // buf[0] == 'h'
+    if (all || market_code.selected())      market_code[index]      = buf[19];
+    if (all || operation_halted.selected()) operation_halted[index] = buf[20] == 'H';
+    // fill NAs from H
+    if (all || trading_state.selected()) trading_state[index] = NA_INT64;
+    if (all || reserved.selected())      reserved[index]      = NA_INT64;
+    if (all || reason.selected())        reason[index]        = NA_INT64;
+  }
+}
 
-    stock[index]           = getNBytes(&buf[11], 8);
-    reference_price[index] = ((double) getNBytes32<4>(&buf[19])) / 10000.0;
-    upper_price[index]     = ((double) getNBytes32<4>(&buf[23])) / 10000.0;
-    lower_price[index]     = ((double) getNBytes32<4>(&buf[27])) / 10000.0;
-    extension[index]       = getNBytes32<4>(&buf[31]);
+RegShoParser::RegShoParser(int64_t skip, int64_t n_max) :
+  MessageParserImpl(skip, n_max) {
+  msg_types = {'Y'};
+  add_columns({{"stock", &stock}, {"regsho_action", &regsho_action}});
+}
 
-  } else if (type == "orders") {
+template<bool all>
+void RegShoParser::parse_fields(unsigned char * buf) {
+  if (all || stock.selected())         stock[index]         = getNBytes64<8>(&buf[11]);
+  if (all || regsho_action.selected()) regsho_action[index] = buf[19];
+}
 
-    const int64_t tmp = getNBytes64<8>(&buf[11]);
-    std::memcpy(&(order_ref[index]), &tmp, sizeof(double));
+MarketParticipantStatesParser::MarketParticipantStatesParser(int64_t skip,
+                                                             int64_t n_max) :
+  MessageParserImpl(skip, n_max) {
+  msg_types = {'L'};
+  add_columns({{"mpid", &mpid}, {"stock", &stock}, {"primary_mm", &primary_mm},
+               {"mm_mode", &mm_mode}, {"participant_state", &participant_state}});
+}
 
-    buy[index]    = buf[19] == 'B';
-    shares[index] = getNBytes32<4>(&buf[20]);
-    stock[index]  = getNBytes(&buf[24], 8);
-    price[index]  = ((double) getNBytes32<4>(&buf[32])) / 10000.0;
+template<bool all>
+void MarketParticipantStatesParser::parse_fields(unsigned char * buf) {
+  if (all || mpid.selected())              mpid[index]              = getNBytes64<4>(&buf[11]);
+  if (all || stock.selected())             stock[index]             = getNBytes64<8>(&buf[15]);
+  if (all || primary_mm.selected())        primary_mm[index]        = buf[23] == 'Y';
+  if (all || mm_mode.selected())           mm_mode[index]           = buf[24];
+  if (all || participant_state.selected()) participant_state[index] = buf[25];
+}
 
-    if (buf[0] == 'F') {
-      mpid[index] = getNBytes(&buf[36], 4);
-    } else {
-      mpid[index] = "";
-    }
+MwcbParser::MwcbParser(int64_t skip, int64_t n_max) :
+  MessageParserImpl(skip, n_max) {
+  msg_types = {'V', 'W'};
+  add_columns({{"level1", &level1}, {"level2", &level2}, {"level3", &level3},
+               {"breached_level", &breached_level}});
+}
 
-  } else if (type == "modifications") {
+template<bool all>
+void MwcbParser::parse_fields(unsigned char * buf) {
+  if (buf[0] == 'V') {
+    if (all || level1.selected())         level1[index]         = ((double) getNBytes64<8>(&buf[11])) / 100000000.0;
+    if (all || level2.selected())         level2[index]         = ((double) getNBytes64<8>(&buf[19])) / 100000000.0;
+    if (all || level3.selected())         level3[index]         = ((double) getNBytes64<8>(&buf[27])) / 100000000.0;
+    if (all || breached_level.selected()) breached_level[index] = NA_INTEGER;
+  } else { // buf[0] == 'W'
+    if (all || breached_level.selected()) breached_level[index] = buf[11] - '0';
+    if (all || level1.selected())         level1[index]         = NA_REAL;
+    if (all || level2.selected())         level2[index]         = NA_REAL;
+    if (all || level3.selected())         level3[index]         = NA_REAL;
+  }
+}
 
-    const int64_t tmp = getNBytes64<8>(&buf[11]);
-    std::memcpy(&(order_ref[index]), &tmp, sizeof(double));
-
-    if (buf[0] == 'E') {
-      shares[index]       = getNBytes32<4>(&buf[19]);// executed shares
-
-      const int64_t tt = getNBytes64<8>(&buf[23]);
-      std::memcpy(&(match_number[index]), &tt, sizeof(double));
-
-      // empty assigns
-      printable[index]    = NA_LOGICAL;
-      price[index]        = NA_REAL;
-      std::memcpy(&(new_order_ref[index]), &NA_INT64, sizeof(double));
-
-    } else if (buf[0] == 'C') {
-      shares[index]       = getNBytes32<4>(&buf[19]);// executed shares
-
-      const int64_t tt = getNBytes64<8>(&buf[23]);
-      std::memcpy(&(match_number[index]), &tt, sizeof(double));
-
-      printable[index]    = buf[31] == 'P';
-      price[index]        = ((double) getNBytes32<4>(&buf[32])) / 10000.0;
-      // empty assigns
-      std::memcpy(&(new_order_ref[index]), &NA_INT64, sizeof(double));
-
-    } else if (buf[0] == 'X') {
-      shares[index] = getNBytes32<4>(&buf[19]); // canceled shares
-      // empty assigns
-      std::memcpy(&(match_number[index]), &NA_INT64, sizeof(double));
-      printable[index] = NA_LOGICAL;
-      price[index]     = NA_REAL;
-      std::memcpy(&(new_order_ref[index]), &NA_INT64, sizeof(double));
-
-    } else if (buf[0] == 'D') {
-      shares[index]    = NA_INTEGER;
-      std::memcpy(&(match_number[index]), &NA_INT64, sizeof(double));
-      printable[index] = NA_LOGICAL;
-      price[index]     = NA_REAL;
-      std::memcpy(&(new_order_ref[index]), &NA_INT64, sizeof(double));
-
-    } else if (buf[0] == 'U') {
-
-      const int64_t tt = getNBytes64<8>(&buf[19]);
-      std::memcpy(&(new_order_ref[index]), &tt, sizeof(double));
-
-      shares[index] = getNBytes32<4>(&buf[27]);
-      price[index]  = ((double) getNBytes32<4>(&buf[31])) / 10000.0;
-      // empty assigns
-      std::memcpy(&(match_number[index]), &NA_INT64, sizeof(double));
-      printable[index] = NA_LOGICAL;
-    }
+IpoParser::IpoParser(int64_t skip, int64_t n_max) :
+  MessageParserImpl(skip, n_max) {
+  msg_types = {'K'};
+  add_columns({{"stock", &stock}, {"release_time", &release_time},
+               {"release_qualifier", &release_qualifier},
+               {"ipo_price", &ipo_price}});
+}
 
-  } else if (type == "trades") {
-
-    int64_t tmp;
-
-    if (buf[0] == 'P') {
-      tmp = getNBytes64<8>(&buf[11]);
-      std::memcpy(&(order_ref[index]), &tmp, sizeof(double));
-
-      buy[index] = buf[19] == 'B';
-      shares[index] = getNBytes32<4>(&buf[20]);
-
-      stock[index]  = getNBytes(&buf[24], 8);
-      price[index]  = ((double) getNBytes32<4>(&buf[32])) / 10000.0;
-
-      const int64_t tt = getNBytes64<8>(&buf[36]);
-      std::memcpy(&(match_number[index]), &tt, sizeof(double));
-
-      // empty assigns
-      cross_type[index] = NA_STRING;
-    } else if (buf[0] == 'Q') {
-      // only Q has 8 byte shares... otherwise 4 bytes for shares...
-      tmp = getNBytes64<8>(&buf[11]);
-      if (tmp >= INT32_MAX)
-        Rcpp::Rcout <<
-          "Warning, overflow for shares on message 'Q' at position " <<
-            index << "\n";
-      shares[index] = (int32_t) tmp;
-
-      stock[index] = getNBytes(&buf[19], 8);
-      price[index] = ((double) getNBytes32<4>(&buf[27])) / 10000.0;
-
-
-      const int64_t tt = getNBytes64<8>(&buf[31]);
-      std::memcpy(&(match_number[index]), &tt, sizeof(double));
-
-      cross_type[index] = std::string(1, buf[39]);
-      //empty assigns
-      std::memcpy(&(order_ref[index]), &NA_INT64, sizeof(double));
-      buy[index] = false; // NA_LOGICAL;
-      // WARNING: Message Q: bool has no NA... default is TRUE
-    } else if (buf[0] == 'B') {
-
-      const int64_t tt = getNBytes64<8>(&buf[11]);
-      std::memcpy(&(match_number[index]), &tt, sizeof(double));
-      // empty assigns
-      std::memcpy(&(order_ref[index]), &NA_INT64, sizeof(double));
-      buy[index]        = NA_LOGICAL;
-      shares[index]     = NA_INTEGER;
-      stock[index]      = " ";
-      price[index]      = NA_REAL;
-      cross_type[index] = ' ';
-    }
+template<bool all>
+void IpoParser::parse_fields(unsigned char * buf) {
+  if (all || stock.selected())             stock[index]             = getNBytes64<8>(&buf[11]);
+  if (all || release_time.selected())      release_time[index]      = getNBytes32<4>(&buf[19]);
+  if (all || release_qualifier.selected()) release_qualifier[index] = buf[23];
+  if (all || ipo_price.selected())         ipo_price[index]         = ((double) getNBytes32<4>(&buf[24])) / 10000.0;
+}
 
-  } else if (type == "noii") {
+LuldParser::LuldParser(int64_t skip, int64_t n_max) :
+  MessageParserImpl(skip, n_max) {
+  msg_types = {'J'};
+  add_columns({{"stock", &stock}, {"reference_price", &reference_price},
+               {"upper_price", &upper_price}, {"lower_price", &lower_price},
+               {"extension", &extension}});
+}
 
-    const int64_t tmp = getNBytes64<8>(&buf[11]);
-    std::memcpy(&(paired_shares[index]), &tmp, sizeof(double));
+template<bool all>
+void LuldParser::parse_fields(unsigned char * buf) {
+  if (all || stock.selected())           stock[index]           = getNBytes64<8>(&buf[11]);
+  if (all || reference_price.selected()) reference_price[index] = ((double) getNBytes32<4>(&buf[19])) / 10000.0;
+  if (all || upper_price.selected())     upper_price[index]     = ((double) getNBytes32<4>(&buf[23])) / 10000.0;
+  if (all || lower_price.selected())     lower_price[index]     = ((double) getNBytes32<4>(&buf[27])) / 10000.0;
+  if (all || extension.selected())       extension[index]       = getNBytes32<4>(&buf[31]);
+}
 
-    const int64_t tt = getNBytes64<8>(&buf[19]);
-    std::memcpy(&(imbalance_shares[index]), &tt, sizeof(double));
+OrdersParser::OrdersParser(int64_t skip, int64_t n_max) :
+  MessageParserImpl(skip, n_max) {
+  msg_types = {'A', 'F'};
+  add_columns({{"order_ref", &order_ref}, {"buy", &buy}, {"shares", &shares},
+               {"stock", &stock}, {"price", &price}, {"mpid", &mpid}});
+}
 
-    imbalance_direction[index] = std::string(1, buf[27]);
-    stock[index]               = getNBytes(&buf[28], 8);
-    far_price[index]           = ((double) getNBytes32<4>(&buf[36])) / 10000.0;
-    near_price[index]          = ((double) getNBytes32<4>(&buf[40])) / 10000.0;
-    reference_price[index]     = ((double) getNBytes32<4>(&buf[44])) / 10000.0;
-    cross_type[index]          = std::string(1, buf[48]);
-    variation_indicator[index] = std::string(1, buf[49]);
+template<bool all>
+void OrdersParser::parse_fields(unsigned char * buf) {
+  if (all || order_ref.selected()) order_ref[index] = getNBytes64<8>(&buf[11]);
+  if (all || buy.selected())       buy[index]       = buf[19] == 'B';
+  if (all || shares.selected())    shares[index]    = getNBytes32<4>(&buf[20]);
+  if (all || stock.selected())     stock[index]     = getNBytes64<8>(&buf[24]);
+  if (all || price.selected())     price[index]     = ((double) getNBytes32<4>(&buf[32])) / 10000.0;
 
-  } else if (type == "rpii") {
+  if (buf[0] == 'F') {
+    if (all || mpid.selected()) mpid[index] = getNBytes64<4>(&buf[36]);
+  } else {
+    if (all || mpid.selected()) mpid[index] = 0x20202020; // "    ", i.e., an empty mpid
+  }
+}
 
-    stock[index]         = getNBytes(&buf[11], 8);
-    interest_flag[index] = std::string(1, buf[19]);
+ModificationsParser::ModificationsParser(int64_t skip, int64_t n_max) :
+  MessageParserImpl(skip, n_max) {
+  msg_types = {'E', 'C', 'X', 'D', 'U'};
+  add_columns({{"order_ref", &order_ref}, {"shares", &shares},
+               {"match_number", &match_number}, {"printable", &printable},
+               {"price", &price}, {"new_order_ref", &new_order_ref}});
+}
 
+template<bool all>
+void ModificationsParser::parse_fields(unsigned char * buf) {
+  if (all || order_ref.selected()) order_ref[index] = getNBytes64<8>(&buf[11]);
+
+  if (buf[0] == 'E') {
+    if (all || shares.selected())       shares[index]       = getNBytes32<4>(&buf[19]); // executed shares
+    if (all || match_number.selected()) match_number[index] = getNBytes64<8>(&buf[23]);
+    // empty assigns
+    if (all || printable.selected())     printable[index]     = NA_LOGICAL;
+    if (all || price.selected())         price[index]         = NA_REAL;
+    if (all || new_order_ref.selected()) new_order_ref[index] = NA_INT64;
+
+  } else if (buf[0] == 'C') {
+    if (all || shares.selected())       shares[index]       = getNBytes32<4>(&buf[19]); // executed shares
+    if (all || match_number.selected()) match_number[index] = getNBytes64<8>(&buf[23]);
+    if (all || printable.selected())    printable[index]    = buf[31] == 'P';
+    if (all || price.selected())        price[index]        = ((double) getNBytes32<4>(&buf[32])) / 10000.0;
+    // empty assigns
+    if (all || new_order_ref.selected()) new_order_ref[index] = NA_INT64;
+
+  } else if (buf[0] == 'X') {
+    if (all || shares.selected()) shares[index] = getNBytes32<4>(&buf[19]); // canceled shares
+    // empty assigns
+    if (all || match_number.selected())  match_number[index]  = NA_INT64;
+    if (all || printable.selected())     printable[index]     = NA_LOGICAL;
+    if (all || price.selected())         price[index]         = NA_REAL;
+    if (all || new_order_ref.selected()) new_order_ref[index] = NA_INT64;
+
+  } else if (buf[0] == 'D') {
+    if (all || shares.selected())        shares[index]        = NA_INTEGER;
+    if (all || match_number.selected())  match_number[index]  = NA_INT64;
+    if (all || printable.selected())     printable[index]     = NA_LOGICAL;
+    if (all || price.selected())         price[index]         = NA_REAL;
+    if (all || new_order_ref.selected()) new_order_ref[index] = NA_INT64;
+
+  } else if (buf[0] == 'U') {
+    if (all || new_order_ref.selected()) new_order_ref[index] = getNBytes64<8>(&buf[19]);
+    if (all || shares.selected())        shares[index]        = getNBytes32<4>(&buf[27]);
+    if (all || price.selected())         price[index]         = ((double) getNBytes32<4>(&buf[31])) / 10000.0;
+    // empty assigns
+    if (all || match_number.selected()) match_number[index] = NA_INT64;
+    if (all || printable.selected())    printable[index]    = NA_LOGICAL;
   }
+}
 
-  index++;
+ExecutionsParser::ExecutionsParser(int64_t skip, int64_t n_max) :
+  MessageParserImpl(skip, n_max), stocks(65536, 0x2020202020202020) {
+  add_columns({{"order_ref", &order_ref}, {"buy", &buy}, {"shares", &shares},
+               {"stock", &stock}, {"price", &price}, {"mpid", &mpid},
+               {"match_number", &match_number}, {"printable", &printable}});
 }
 
-// Converts the messages parsed to a data frame
-Rcpp::List MessageParser::get_data_frame() {
-  // if (index == 0) {
-  //   Rcpp::List res(colnames.size());
-  //   res.attr("names") = colnames;
-  //   res.attr("class") = Rcpp::StringVector::create("data.table", "data.frame");
-  //   return res;
-  // }
+void ExecutionsParser::track(unsigned char * buf, bool passes) {
+  if (passes && (buf[0] == 'E' || buf[0] == 'C')) parse_function(this, buf);
+  if (buf[0] == 'A' || buf[0] == 'F')
+    stocks[getNBytes32<2>(&buf[1])] = getNBytes64<8>(&buf[24]);
+  track_order(orders, buf);
+}
 
-  // prune vector
-  if (index != msg_type.size()) {
-    // Rprintf("Pruning found index '%lld' msg_type_size '%lld'!\n",
-    //         index, msg_type.size());
-    prune_vectors();
+template<bool all>
+void ExecutionsParser::parse_fields(unsigned char * buf) {
+  // the order is only looked up if one of its columns is selected
+  const bool need_order = all || buy.selected() || mpid.selected() || price.selected();
+  const OrderEntry * o = need_order ? orders.find(getNBytes64<8>(&buf[11])) : NULL;
+
+  if (all || order_ref.selected())    order_ref[index]    = getNBytes64<8>(&buf[11]);
+  if (all || shares.selected())       shares[index]       = getNBytes32<4>(&buf[19]); // executed shares
+  if (all || match_number.selected()) match_number[index] = getNBytes64<8>(&buf[23]);
+  if (all || stock.selected())        stock[index]        = stocks[getNBytes32<2>(&buf[1])];
+
+  // orders that are not known (e.g., the file starts during the day)
+  if (all || buy.selected())  buy[index]  = o == NULL ? NA_LOGICAL : o->buy;
+  if (all || mpid.selected()) mpid[index] = o == NULL ? NA_INT64 : (int64_t) o->mpid;
+
+  if (buf[0] == 'E') {
+    if (all || price.selected())     price[index]     = o == NULL ? NA_REAL : ((double) o->price) / 10000.0;
+    if (all || printable.selected()) printable[index] = NA_LOGICAL;
+  } else { // buf[0] == 'C', executed at a different price
+    if (all || price.selected())     price[index]     = ((double) getNBytes32<4>(&buf[32])) / 10000.0;
+    if (all || printable.selected()) printable[index] = buf[31] == 'P';
   }
-  // create a dataframe
-  Rcpp::List res(colnames.size());
-  res[0] = msg_type;
-  res[1] = stock_locate;
-  res[2] = tracking_number;
-  res[3] = to_int64(timestamp);
-
-  if (type == "system_events") {
-
-    res[4] = event_code;
-
-  } else if (type == "stock_directory") {
-
-    res[4]  = stock;
-    res[5]  = market_category;
-    res[6]  = financial_status;
-    res[7]  = lot_size;
-    res[8]  = round_lots_only;
-    res[9]  = issue_classification;
-    res[10] = issue_subtype;
-    res[11] = authentic;
-    res[12] = short_sell_closeout;
-    res[13] = ipo_flag;
-    res[14] = luld_price_tier;
-    res[15] = etp_flag;
-    res[16] = etp_leverage;
-    res[17] = inverse;
-
-  } else if (type == "trading_status") {
-
-    res[4]  = stock;
-    res[5]  = trading_state;
-    res[6]  = reserved;
-    res[7]  = reason;
-    res[8]  = market_code;
-    res[9]  = operation_halted;
-
-  } else if (type == "reg_sho") {
-
-    res[4]  = stock;
-    res[5]  = regsho_action;
-
-  } else if (type == "market_participant_states") {
-
-    res[4]  = mpid;
-    res[5]  = stock;
-    res[6]  = primary_mm;
-    res[7]  = mm_mode;
-    res[8]  = participant_state;
-
-  } else if (type == "mwcb") {
-
-    res[4] = level1;
-    res[5] = level2;
-    res[6] = level3;
-    res[7] = breached_level;
-
-  } else if (type == "ipo") {
-
-    res[4] = stock;
-    res[5] = release_time;
-    res[6] = release_qualifier;
-    res[7] = ipo_price;
-
-  } else if (type == "luld") {
-
-    res[4] = stock;
-    res[5] = reference_price;
-    res[6] = upper_price;
-    res[7] = lower_price;
-    res[8] = extension;
-
-  } else if (type == "orders") {
-
-    res[4] = to_int64(order_ref);
-    res[5] = buy;
-    res[6] = shares;
-    res[7] = stock;
-    res[8] = price;
-    res[9] = mpid;
-
-  } else if (type == "modifications") {
-
-    res[4] = to_int64(order_ref);
-    res[5] = shares;
-    res[6] = to_int64(match_number);
-    res[7] = printable;
-    res[8] = price;
-    res[9] = to_int64(new_order_ref);
-
-  } else if (type == "trades") {
-
-    res[4]  = to_int64(order_ref);
-    res[5]  = buy;
-    res[6]  = shares;
-    res[7]  = stock;
-    res[8]  = price;
-    res[9]  = to_int64(match_number);
-    res[10] = cross_type;
-
-  } else if (type == "noii") {
-
-    res[4]  = to_int64(paired_shares);
-    res[5]  = to_int64(imbalance_shares);
-    res[6]  = imbalance_direction;
-    res[7]  = stock;
-    res[8]  = far_price;
-    res[9]  = near_price;
-    res[10] = reference_price;
-    res[11] = cross_type;
-    res[12] = variation_indicator;
-
-  } else if (type == "rpii") {
-
-    res[4] = stock;
-    res[5] = interest_flag;
+}
+
+TradesParser::TradesParser(int64_t skip, int64_t n_max) :
+  MessageParserImpl(skip, n_max) {
+  msg_types = {'P', 'Q', 'B'};
+  add_columns({{"order_ref", &order_ref}, {"buy", &buy}, {"shares", &shares},
+               {"stock", &stock}, {"price", &price},
+               {"match_number", &match_number}, {"cross_type", &cross_type}});
+}
 
+template<bool all>
+void TradesParser::parse_fields(unsigned char * buf) {
+  if (buf[0] == 'P') {
+    if (all || order_ref.selected())    order_ref[index]    = getNBytes64<8>(&buf[11]);
+    if (all || buy.selected())          buy[index]          = buf[19] == 'B';
+    if (all || shares.selected())       shares[index]       = getNBytes32<4>(&buf[20]);
+    if (all || stock.selected())        stock[index]        = getNBytes64<8>(&buf[24]);
+    if (all || price.selected())        price[index]        = ((double) getNBytes32<4>(&buf[32])) / 10000.0;
+    if (all || match_number.selected()) match_number[index] = getNBytes64<8>(&buf[36]);
+    // empty assigns
+    if (all || cross_type.selected()) cross_type[index] = NA_INT64;
+
+  } else if (buf[0] == 'Q') {
+    // only Q has 8 byte shares... otherwise 4 bytes for shares...
+    const int64_t tmp = getNBytes64<8>(&buf[11]);
+    // reported in get_data_frame (no R calls while parsing)
+    if (tmp >= INT32_MAX) n_shares_overflow++;
+    if (all || shares.selected())       shares[index]       = (int32_t) tmp;
+    if (all || stock.selected())        stock[index]        = getNBytes64<8>(&buf[19]);
+    if (all || price.selected())        price[index]        = ((double) getNBytes32<4>(&buf[27])) / 10000.0;
+    if (all || match_number.selected()) match_number[index] = getNBytes64<8>(&buf[31]);
+    if (all || cross_type.selected())   cross_type[index]   = buf[39];
+    //empty assigns
+    if (all || order_ref.selected()) order_ref[index] = NA_INT64;
+    if (all || buy.selected())       buy[index]       = false; // NA_LOGICAL;
+    // WARNING: Message Q: bool has no NA... default is TRUE
+
+  } else if (buf[0] == 'B') {
+    if (all || match_number.selected()) match_number[index] = getNBytes64<8>(&buf[11]);
+    // empty assigns
+    if (all || order_ref.selected())  order_ref[index]  = NA_INT64;
+    if (all || buy.selected())        buy[index]        = NA_LOGICAL;
+    if (all || shares.selected())     shares[index]     = NA_INTEGER;
+    if (all || stock.selected())      stock[index]      = BLANK_KEY; // " ", no stock
+    if (all || price.selected())      price[index]      = NA_REAL;
+    if (all || cross_type.selected()) cross_type[index] = ' ';
   }
+}
 
-  // need to call data.table::setalloccol() on data in R!
-  res.names() = colnames;
-  res.attr("class") = Rcpp::StringVector::create("data.table", "data.frame");
+NoiiParser::NoiiParser(int64_t skip, int64_t n_max) :
+  MessageParserImpl(skip, n_max) {
+  msg_types = {'I'};
+  add_columns({{"paired_shares", &paired_shares},
+               {"imbalance_shares", &imbalance_shares},
+               {"imbalance_direction", &imbalance_direction}, {"stock", &stock},
+               {"far_price", &far_price}, {"near_price", &near_price},
+               {"reference_price", &reference_price},
+               {"cross_type", &cross_type},
+               {"variation_indicator", &variation_indicator}});
+}
 
-  return res;
+template<bool all>
+void NoiiParser::parse_fields(unsigned char * buf) {
+  if (all || paired_shares.selected())       paired_shares[index]       = getNBytes64<8>(&buf[11]);
+  if (all || imbalance_shares.selected())    imbalance_shares[index]    = getNBytes64<8>(&buf[19]);
+  if (all || imbalance_direction.selected()) imbalance_direction[index] = buf[27];
+  if (all || stock.selected())               stock[index]               = getNBytes64<8>(&buf[28]);
+  if (all || far_price.selected())           far_price[index]           = ((double) getNBytes32<4>(&buf[36])) / 10000.0;
+  if (all || near_price.selected())          near_price[index]          = ((double) getNBytes32<4>(&buf[40])) / 10000.0;
+  if (all || reference_price.selected())     reference_price[index]     = ((double) getNBytes32<4>(&buf[44])) / 10000.0;
+  if (all || cross_type.selected())          cross_type[index]          = buf[48];
+  if (all || variation_indicator.selected()) variation_indicator[index] = buf[49];
+}
+
+RpiiParser::RpiiParser(int64_t skip, int64_t n_max) :
+  MessageParserImpl(skip, n_max) {
+  msg_types = {'N'};
+  add_columns({{"stock", &stock}, {"interest_flag", &interest_flag}});
+}
+
+template<bool all>
+void RpiiParser::parse_fields(unsigned char * buf) {
+  if (all || stock.selected())         stock[index]         = getNBytes64<8>(&buf[11]);
+  if (all || interest_flag.selected()) interest_flag[index] = buf[19];
 }
@@ -2,7 +2,12 @@
 #define READFUNCTIONS_H
 
 #include "specifications.h"
-#include "count_messages.h"
+#include "helper_functions.h"
+#include "itch_reader.h"
+#include "message_filter.h"
+#include "itch_index.h"
+#include "order_store.h"
+#include "arrow_writer.h"
 
 // Entry Function for the reading function
 Rcpp::List read_itch_impl(std::vector<std::string> classes,
@@ -12,124 +17,430 @@ Rcpp::List read_itch_impl(std::vector<std::string> classes,
                           Rcpp::IntegerVector filter_stock_locate,
                           Rcpp::NumericVector min_timestamp,
                           Rcpp::NumericVector max_timestamp,
+                          Rcpp::List filter_payload,
                           int64_t max_buffer_size = 1e8,
-                          bool quiet = false);
+                          bool quiet = false,
+                          int n_threads = 1,
+                          std::vector<std::string> columns = {},
+                          std::string index_file = "");
+
+// the maximum initial size of the vectors of a MessageParser, larger vectors
+// are only allocated when the messages are actually found
+const int64_t MAX_INIT_VECTOR_SIZE = 1000000;
+
+/*
+ * Columns hold the parsed values of one variable in a C++ vector, the
+ *   values are only converted to an R vector (to_r) once all messages are
+ *   parsed. Resizing, appending, and converting are virtual (called once per
+ *   column), while the values are written directly with col[i] = value.
+ *
+ * Strings are stored as their raw bytes (see key_to_string), NA_INT64 marks a
+ *   missing string. Each distinct string is converted to a CHARSXP only once
+ *   (see StringCache).
+ *
+ * Columns that are not selected are never allocated and their fields are not
+ *   decoded, the parse functions skip them (see MessageParserImpl).
+ */
+class Column {
+public:
+  virtual ~Column() {}
+  bool selected() const { return is_selected; }
+  // drops the column, its values are no longer stored
+  virtual void deselect() = 0;
+  virtual void resize(int64_t n) = 0;
+  // appends the first n values of another column of the same type and
+  // releases the memory of the other column
+  virtual void append(Column &other, int64_t n) = 0;
+  // reorders the values, the i-th value becomes the value at order[i]
+  virtual void permute(const std::vector<int64_t> &order) = 0;
+  // converts the values to an R vector and releases the C++ memory
+  virtual SEXP to_r() = 0;
+  // converts the first n values to an R vector, the values are kept
+  virtual SEXP head_to_r(int64_t n) = 0;
+  // adds the first n values to an Arrow record batch, the values are kept
+  virtual void to_arrow(ArrowBatch &batch, const std::string &name, int64_t n) = 0;
+
+protected:
+  bool is_selected = true;
+};
+
+template<typename T>
+class TypedColumn : public Column {
+public:
+  T& operator[](int64_t i) { return v[i]; }
+  void deselect() {
+    is_selected = false;
+    std::vector<T>().swap(v);
+  }
+  void resize(int64_t n) { if (is_selected) v.resize(n); }
+  void append(Column &other, int64_t n) {
+    if (!is_selected) return;
+    std::vector<T> &o = static_cast<TypedColumn<T>&>(other).v;
+    v.insert(v.end(), o.begin(), o.begin() + n);
+    std::vector<T>().swap(o);
+  }
+  void permute(const std::vector<int64_t> &order) {
+    if (!is_selected) return;
+    std::vector<T> p(order.size());
+    for (size_t i = 0; i < order.size(); i++) p[i] = v[order[i]];
+    v.swap(p);
+  }
+  SEXP to_r() {
+    SEXP res = head_to_r(v.size());
+    std::vector<T>().swap(v);
+    return res;
+  }
+
+protected:
+  std::vector<T> v;
+};
+
+class IntColumn : public TypedColumn<int> {
+  SEXP head_to_r(int64_t n) { return to_integer(v, n); }
+  void to_arrow(ArrowBatch &b, const std::string &name, int64_t n) {
+    b.add_int32(name, v.data(), n);
+  }
+};
+class LglColumn : public TypedColumn<int> {
+  SEXP head_to_r(int64_t n) { return to_logical(v, n); }
+  void to_arrow(ArrowBatch &b, const std::string &name, int64_t n) {
+    b.add_bool(name, v.data(), n);
+  }
+};
+class DblColumn : public TypedColumn<double> {
+  SEXP head_to_r(int64_t n) { return to_numeric(v, n); }
+  void to_arrow(ArrowBatch &b, const std::string &name, int64_t n) {
+    b.add_float64(name, v.data(), n);
+  }
+};
+class Int64Column : public TypedColumn<int64_t> {
+  SEXP head_to_r(int64_t n) { return to_int64(v, n); }
+  void to_arrow(ArrowBatch &b, const std::string &name, int64_t n) {
+    b.add_int64(name, v.data(), n);
+  }
+};
+// a string of n bytes
+template<int n>
+class StrColumn : public TypedColumn<int64_t> {
+  SEXP head_to_r(int64_t len) { return to_character(v, len, n); }
+  void to_arrow(ArrowBatch &b, const std::string &name, int64_t len) {
+    b.add_utf8(name, v.data(), len, n);
+  }
+};
+
+// converts the first n values of the columns (name and values) to a
+// data.table, releases the columns
+Rcpp::List columns_to_data_frame(std::vector<std::pair<std::string, Column*>> cols,
+                                 int64_t n);
 
 /*
- * Message Parser class, each class holds one "class" (stock_directory,
+ * Message Parser classes, each class holds one "class" (stock_directory,
  *   sytem_events, trades, ...) and is able to parse them.
  *
+ * MessageParser is the common base class, it holds the columns shared by all
+ *   classes and takes care of skip/n_max and the size of the columns.
+ *   Each message class derives from MessageParserImpl (CRTP), which provides
+ *   a static parse function for the class. The parse functions are stored
+ *   in a table of 256 entries (one per message type byte), so that the
+ *   messages are dispatched without comparing any strings and the field
+ *   decoders of each class can be inlined.
+ *
  * The main usage is
  *
- * - create a MessageParser with its type (can be empty for no class)
- * - activate the object if messages need to be parsed later on
- * - init the vectors to appropriate sizes
- * - loop over a buffer and call parse_message on the respective messages
+ * - create the MessageParser for a class with create_parser()
+ * - optionally select the columns that are returned with select_columns(),
+ *   the fields of the other columns are not decoded
+ * - optionally init the vectors to an expected size, the vectors grow
+ *   geometrically while parsing if more messages are found
+ * - add the parsers to a ParserTable
+ * - loop over a buffer and call ParserTable::parse_message() for each message
  * - convert the parsed messages to a data.frame with get_data_frame
- *
- * Note that the class holds vectors for all possible classes but only fills
- * and uses needed classes.
- *
  */
-class MessageParser{
+class MessageParser {
 public:
-  MessageParser(std::string type,
-                int64_t skip = 0,
-                int64_t n_max = std::numeric_limits<int64_t>::max());
+  MessageParser(int64_t skip, int64_t n_max);
+  virtual ~MessageParser() {}
+  // columns point to the members of the object, it must not be copied
+  MessageParser(const MessageParser&) = delete;
+  MessageParser& operator=(const MessageParser&) = delete;
 
-  void activate();
+  // keeps only the given columns (all columns if names is empty)
+  void select_columns(const std::vector<std::string> &names);
+  bool has_column(const std::string &name) const;
+  // the names of the selected columns
+  std::vector<std::string> column_names() const;
   void init_vectors(int64_t n);
-  void parse_message(unsigned char * buf);
-  Rcpp::List get_data_frame();
+  void append(MessageParser &other);
+  Rcpp::List get_data_frame(bool keep = false);
+  // adds the parsed messages (selected columns) to an Arrow record batch
+  void to_arrow(ArrowBatch &batch);
+  // drops the parsed messages, the vectors are kept for the next messages
+  void clear() { index = 0; }
+  // the number of messages parsed so far
+  int64_t n_parsed() const { return index; }
 
+  // parses the message in buf with the parser (of the respective class)
+  typedef void (*ParseFunction)(MessageParser * parser, unsigned char * buf);
+  ParseFunction parse_function;
   std::vector<char> msg_types;
-  bool active = false;
 
-private:
-  void prune_vectors();
+protected:
+  // the parse function that skips the columns that are not selected, replaces
+  // parse_function once a column is deselected
+  ParseFunction parse_selected_function;
 
-  std::string type;
-  // msg_buf_idx is only used when the skip/n_max is used.
-  // index counts the number of messages in the Parser, msg_buf_idx counts the
-  // running number of messages of this type it has seen (but not necessarily parsed!)
+  // returns true if the next message is parsed (skip/n_max), makes room for it
+  bool next_row();
+  void resize_vectors(int64_t n);
+  // all: all columns are selected, otherwise only the selected ones are decoded
+  template<bool all>
+  void parse_header(unsigned char * buf) {
+    if (all || msg_type.selected())        msg_type[index]        = buf[0];
+    if (all || stock_locate.selected())    stock_locate[index]    = getNBytes32<2>(&buf[1]);
+    if (all || tracking_number.selected()) tracking_number[index] = getNBytes32<2>(&buf[3]);
+    if (all || timestamp.selected())       timestamp[index]       = getNBytes64<6>(&buf[5]);
+  }
+  void add_columns(std::vector<std::pair<std::string, Column*>> cols);
+  // prints a warning for the 'Q' messages whose shares overflowed since the
+  // last report
+  void report_overflow();
+
+  // msg_buf_idx counts the running number of messages of this class it has
+  // seen (but not necessarily parsed!), only used when skip/n_max is used.
+  // index counts the number of messages in the Parser, size is the current
+  // length of the vectors (index <= size)
   int64_t size = 0, index = 0, msg_buf_idx = 0, start_count, end_count;
-  std::vector<std::string> colnames;
+  // number of 'Q' messages whose shares do not fit into an int (trades only)
+  int64_t n_shares_overflow = 0;
+
+  // the columns (name and values) in the order of the data.frame
+  std::vector<std::pair<std::string, Column*>> columns;
 
   // general data vectors
-  // NOTE: later classes may use earlier vectors as well,
-  // e.g., noii also uses cross_type, defined under trades...
-
-  Rcpp::CharacterVector msg_type;
-  Rcpp::IntegerVector stock_locate, tracking_number;
-  Rcpp::NumericVector timestamp;
-
-  // system_events
-  Rcpp::CharacterVector    event_code;
-
-  // stock_directory
-  Rcpp::CharacterVector stock;
-  Rcpp::CharacterVector market_category, financial_status;
-  Rcpp::IntegerVector lot_size;
-  Rcpp::LogicalVector round_lots_only;
-  Rcpp::CharacterVector issue_classification;
-  Rcpp::CharacterVector issue_subtype;
-  Rcpp::LogicalVector authentic;
-  Rcpp::LogicalVector short_sell_closeout;
-  Rcpp::LogicalVector ipo_flag;
-  Rcpp::CharacterVector luld_price_tier;
-  Rcpp::LogicalVector etp_flag;
-  Rcpp::IntegerVector etp_leverage;
-  Rcpp::LogicalVector inverse;
-
-  // trading_status
-  Rcpp::CharacterVector trading_state, reserved;
-  Rcpp::CharacterVector reason;
-  Rcpp::CharacterVector market_code;
-  Rcpp::LogicalVector operation_halted;
-
-  // reg_sho
-  Rcpp::CharacterVector regsho_action;
-
-  // Market Participant States
-  Rcpp::LogicalVector primary_mm;
-  Rcpp::CharacterVector mm_mode, participant_state;
-
-  // mwcb
-  Rcpp::NumericVector level1, level2, level3;
-  Rcpp::IntegerVector breached_level;
-
-  // ipo
-  Rcpp::IntegerVector release_time;
-  Rcpp::CharacterVector release_qualifier;
-  Rcpp::NumericVector ipo_price;
-
-  // luld
-  Rcpp::NumericVector reference_price, lower_price, upper_price;
-  Rcpp::IntegerVector extension;
-
-  // orders
-  Rcpp::NumericVector order_ref;
-  Rcpp::LogicalVector buy;
-  Rcpp::IntegerVector shares;
-  Rcpp::NumericVector price;
-  Rcpp::CharacterVector mpid;
-
-  // modifications
-  Rcpp::NumericVector new_order_ref;
-  Rcpp::LogicalVector printable;
-
-  // trades
-  Rcpp::NumericVector match_number;
-  Rcpp::CharacterVector cross_type;
-
-  // noii
-  Rcpp::NumericVector paired_shares, imbalance_shares;
-  Rcpp::CharacterVector imbalance_direction;
-  Rcpp::NumericVector far_price, near_price;
-  Rcpp::CharacterVector variation_indicator;
-
-  // rpii
-  Rcpp::CharacterVector interest_flag;
+  StrColumn<1> msg_type;
+  IntColumn    stock_locate, tracking_number;
+  Int64Column  timestamp;
+};
+
+template<typename Parser>
+class MessageParserImpl : public MessageParser {
+public:
+  MessageParserImpl(int64_t skip, int64_t n_max) : MessageParser(skip, n_max) {
+    parse_function = &MessageParserImpl<Parser>::parse<true>;
+    parse_selected_function = &MessageParserImpl<Parser>::parse<false>;
+  }
+
+  // with all = false, each field is only decoded if its column is selected,
+  // with all = true, the checks are compiled away
+  template<bool all>
+  static void parse(MessageParser * p, unsigned char * buf) {
+    Parser * parser = static_cast<Parser*>(p);
+    if (!parser->next_row()) return;
+    parser->template parse_header<all>(buf);
+    parser->template parse_fields<all>(buf);
+    parser->index++;
+  }
+};
+
+class SystemEventsParser : public MessageParserImpl<SystemEventsParser> {
+public:
+  SystemEventsParser(int64_t skip, int64_t n_max);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  StrColumn<1> event_code;
+};
+
+class StockDirectoryParser : public MessageParserImpl<StockDirectoryParser> {
+public:
+  StockDirectoryParser(int64_t skip, int64_t n_max);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  StrColumn<8> stock;
+  StrColumn<1> market_category, financial_status;
+  IntColumn    lot_size;
+  LglColumn    round_lots_only;
+  StrColumn<1> issue_classification;
+  StrColumn<2> issue_subtype;
+  LglColumn    authentic, short_sell_closeout, ipo_flag;
+  StrColumn<1> luld_price_tier;
+  LglColumn    etp_flag;
+  IntColumn    etp_leverage;
+  LglColumn    inverse;
+};
+
+class TradingStatusParser : public MessageParserImpl<TradingStatusParser> {
+public:
+  TradingStatusParser(int64_t skip, int64_t n_max);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  StrColumn<8> stock;
+  StrColumn<1> trading_state, reserved;
+  StrColumn<4> reason;
+  StrColumn<1> market_code;
+  LglColumn    operation_halted;
+};
+
+class RegShoParser : public MessageParserImpl<RegShoParser> {
+public:
+  RegShoParser(int64_t skip, int64_t n_max);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  StrColumn<8> stock;
+  StrColumn<1> regsho_action;
+};
+
+class MarketParticipantStatesParser :
+  public MessageParserImpl<MarketParticipantStatesParser> {
+public:
+  MarketParticipantStatesParser(int64_t skip, int64_t n_max);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  StrColumn<4> mpid;
+  StrColumn<8> stock;
+  LglColumn    primary_mm;
+  StrColumn<1> mm_mode, participant_state;
+};
+
+class MwcbParser : public MessageParserImpl<MwcbParser> {
+public:
+  MwcbParser(int64_t skip, int64_t n_max);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  DblColumn level1, level2, level3;
+  IntColumn breached_level;
+};
+
+class IpoParser : public MessageParserImpl<IpoParser> {
+public:
+  IpoParser(int64_t skip, int64_t n_max);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  StrColumn<8> stock;
+  IntColumn    release_time;
+  StrColumn<1> release_qualifier;
+  DblColumn    ipo_price;
+};
+
+class LuldParser : public MessageParserImpl<LuldParser> {
+public:
+  LuldParser(int64_t skip, int64_t n_max);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  StrColumn<8> stock;
+  DblColumn    reference_price, upper_price, lower_price;
+  IntColumn    extension;
+};
+
+class OrdersParser : public MessageParserImpl<OrdersParser> {
+public:
+  OrdersParser(int64_t skip, int64_t n_max);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  Int64Column  order_ref;
+  LglColumn    buy;
+  IntColumn    shares;
+  StrColumn<8> stock;
+  DblColumn    price;
+  StrColumn<4> mpid;
+};
+
+class ModificationsParser : public MessageParserImpl<ModificationsParser> {
+public:
+  ModificationsParser(int64_t skip, int64_t n_max);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  Int64Column order_ref;
+  IntColumn   shares;
+  Int64Column match_number;
+  LglColumn   printable;
+  DblColumn   price;
+  Int64Column new_order_ref;
+};
+
+/*
+ * ExecutionsParser, the executions ('E' and 'C') of the modifications
+ *   enriched with the stock, side, price, and mpid of the executed order.
+ *
+ * The orders are resolved while streaming: track() is called for every
+ *   order message (A, F, E, C, X, D, U) in file order, whether it passes the
+ *   filter or not, and keeps the open orders by their order_ref (see
+ *   OrderStore). The parser has no message types, i.e., it is not dispatched
+ *   by the ParserTable.
+ */
+class ExecutionsParser : public MessageParserImpl<ExecutionsParser> {
+public:
+  ExecutionsParser(int64_t skip, int64_t n_max);
+  // applies an order message to the open orders, parses the executions that
+  // pass the filter (before the executed shares are removed)
+  void track(unsigned char * buf, bool passes);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  OrderStore orders;
+  // the stock of each stock_locate (locate codes have 2 bytes)
+  std::vector<int64_t> stocks;
+
+  Int64Column  order_ref;
+  LglColumn    buy;
+  IntColumn    shares;
+  StrColumn<8> stock;
+  DblColumn    price;
+  StrColumn<4> mpid;
+  Int64Column  match_number;
+  LglColumn    printable;
+};
+
+class TradesParser : public MessageParserImpl<TradesParser> {
+public:
+  TradesParser(int64_t skip, int64_t n_max);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  Int64Column  order_ref;
+  LglColumn    buy;
+  IntColumn    shares;
+  StrColumn<8> stock;
+  DblColumn    price;
+  Int64Column  match_number;
+  StrColumn<1> cross_type;
+};
+
+class NoiiParser : public MessageParserImpl<NoiiParser> {
+public:
+  NoiiParser(int64_t skip, int64_t n_max);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  Int64Column  paired_shares, imbalance_shares;
+  StrColumn<1> imbalance_direction;
+  StrColumn<8> stock;
+  DblColumn    far_price, near_price, reference_price;
+  StrColumn<1> cross_type, variation_indicator;
+};
+
+class RpiiParser : public MessageParserImpl<RpiiParser> {
+public:
+  RpiiParser(int64_t skip, int64_t n_max);
+  template<bool all> void parse_fields(unsigned char * buf);
+private:
+  StrColumn<8> stock;
+  StrColumn<1> interest_flag;
+};
+
+// creates the MessageParser for a message class (see MSG_CLASSES)
+MessageParser * create_parser(const std::string &cls, int64_t skip, int64_t n_max);
+
+/*
+ * The dispatch table, one entry for each possible message type byte.
+ * Message types without a parser point to a function that ignores them.
+ */
+struct ParserTable {
+  MessageParser::ParseFunction functions[256];
+  MessageParser * parsers[256];
+
+  ParserTable();
+  void add_parser(MessageParser * parser);
+  // parses a message (buf points to the message type)
+  void parse_message(unsigned char * buf) {
+    functions[buf[0]](parsers[buf[0]], buf);
+  }
 };
 
 #endif // READFUNCTIONS_H
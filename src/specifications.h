@@ -9,6 +9,10 @@
 // Define NA_INT64
 const int64_t NA_INT64 = 1ULL << 63;
 
+// the string key (see key_to_string) of a single space, the padding spaces of
+// other keys are dropped, e.g., the stock of broken trades, which have no stock
+const int64_t BLANK_KEY = NA_INT64 + 1;
+
 // the lengths of the message types ordered based on their ASCII table positions
 // To get the respective positions of a message 'msg' (e.g., 'Q') use MSG_SIZES[msg - 'A'];
 const int MSG_SIZES [] = {
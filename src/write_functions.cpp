@@ -1,5 +1,9 @@
 #include "write_functions.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 
 /*
  * #############################################################################
@@ -8,7 +12,10 @@
  *
  * ll is a list of data.frames, where each df is sorted by timestamp
  * filename, the filename to write to
- * gz if the file should be a gz-compressed file
+ * gz if the file should be a gz-compressed file (with compression_level, -1
+ * for the default level of zlib)
+ * background if the buffers are written (compressed) by a thread while the
+ * next buffer is encoded
  * returns the number of bytes written
  */
 
@@ -17,7 +24,10 @@ int64_t write_itch_impl(Rcpp::List ll, std::string filename,
                         bool append,
                         bool gz,
                         size_t max_buffer_size,
-                        bool quiet) {
+                        bool quiet,
+                        int n_threads,
+                        int compression_level,
+                        bool background) {
 
   if (max_buffer_size > 5e9) {
     Rcpp::warning("max_buffer_size set to > 5e9, capping it to 5e9\n");
@@ -32,125 +42,311 @@ int64_t write_itch_impl(Rcpp::List ll, std::string filename,
   size_t msg_size = 0;
   int64_t total_msgs = 0;
 
-  const int64_t max_val = std::numeric_limits<int64_t>::max();
-  std::vector<int64_t> indices (list_length);
-  std::vector<int64_t> timestamps (list_length);
-
   if (!quiet) Rprintf("[Counting]   ");
-  // initiate the indices, timestamps as well as count the required buffer size
+  // resolve the columns of each data.frame once and count the required
+  // buffer size
+  std::vector<WriteColumns> dfs;
+  dfs.reserve(list_length);
   for (int ii = 0; ii < list_length; ii++) {
-    Rcpp::List df = ll.at(ii);
-    Rcpp::CharacterVector mt = df["msg_type"];
-    Rcpp::NumericVector ts = df["timestamp"];
-
-    // populate the indices
-    indices[ii] = 0;
+    Rcpp::DataFrame df_ii = ll.at(ii);
+    dfs.push_back(WriteColumns(df_ii));
+    const WriteColumns &df = dfs.back();
 
-    // populate the timestamps
-    std::memcpy(&(timestamps[ii]), &(ts[0]), sizeof(int64_t));
-    // Rprintf("ts[0] is %+lld; ts is now %+lld\n", ts[0], timestamps[ii]);
-
-    for (int l = 0; l < mt.size(); l++) {
-      const unsigned char msg = Rcpp::as<char>(mt[l]);
-      msg_size += get_message_size(msg);
-      total_msgs++;
-    }
+    for (int64_t l = 0; l < df.n; l++) msg_size += get_message_size(df.type_at(l));
+    total_msgs += df.n;
   }
   if (!quiet) Rprintf("%s messages (%s bytes) found\n",
       format_thousands(total_msgs).c_str(),
       format_thousands(msg_size).c_str());
 
+  // the next message of each data.frame in a min-heap of their timestamps,
+  // i.e., the data.frames are merged in O(log k) per message. Equal
+  // timestamps are taken from the earlier data.frame in ll first
+  typedef std::pair<int64_t, int> HeapEntry;
+  std::priority_queue<HeapEntry, std::vector<HeapEntry>,
+                      std::greater<HeapEntry>> heap;
+  std::vector<int64_t> indices(list_length, 0);
+  for (int ii = 0; ii < list_length; ii++)
+    if (dfs[ii].n > 0) heap.push(HeapEntry(dfs[ii].timestamp_at(0), ii));
+
   // min of max_buffer_size and msg_size, but only 32 bit for buffer - is large enough
   const size_t buff_size = max_buffer_size > msg_size ? msg_size : max_buffer_size;
-  unsigned char * buf;
-  buf = (unsigned char*) calloc(buff_size, sizeof(unsigned char));
-  int64_t msg_ct = 0;
+  // in the background mode, a buffer is written while the next one is
+  // encoded, i.e., two buffers are used in turn
+  std::vector<unsigned char> bufs[2];
+  bufs[0].resize(buff_size);
+  if (background) bufs[1].resize(buff_size);
+  int cur = 0;
+
+  // one stream for the whole file, i.e., a gz file is a single gzip member
+  ItchWriter writer(filename, append, gz, compression_level, background);
+
+#ifndef _OPENMP
+  n_threads = 1;
+#endif
+  if (n_threads < 1) n_threads = 1;
 
-  // implement multi buffer....
-  int64_t i = 0, total_bytes = 0;
-  bool first_write = true;
+  // the messages of one buffer: their data.frame, row, and offset in the
+  // buffer. As the sizes of the messages are known, the merge order is fixed
+  // first and the messages are then encoded (in parallel) into disjoint ranges
+  std::vector<int> msg_df;
+  std::vector<int64_t> msg_row, msg_offset;
+
+  int64_t total_bytes = 0;
 
   if (!quiet) Rprintf("[Converting] to binary .");
-  while (msg_ct < total_msgs) {
-    // find at which list position (lp) the lowest timestamp is
-    const int lp = get_min_val_pos(timestamps);
-    Rcpp::List df = ll[lp];
-    int64_t lp_idx = indices[lp];
-
-    Rcpp::NumericVector ts = df["timestamp"];
-    Rcpp::CharacterVector mt = df["msg_type"];
-
-    const unsigned char msg_type = Rcpp::as<char>(mt[lp_idx]);
-
-    const int64_t msg_length = get_message_size(msg_type);
-    if (i + msg_length > (int64_t) buff_size) {
-      if (!quiet) Rprintf(".");
-      // write_buffer
-      // append can only be set on the first write... afterwards append by default
-      write_buffer_to_file(buf, i, filename, first_write ? append : true, gz);
-      first_write = false;
-
-      // empty buffer
-      buf = (unsigned char*) realloc(buf, buff_size * sizeof(unsigned char));
-      if (!buf) Rcpp::stop("Out of Memory");
-      total_bytes += i;
-      // reset value in buffer to 0
-      i = 0;
+  while (!heap.empty()) {
+    unsigned char * buf = bufs[cur].data();
+    msg_df.clear();
+    msg_row.clear();
+    msg_offset.clear();
+
+    // merge the messages that fit into the buffer
+    int64_t i = 0;
+    while (!heap.empty()) {
+      // the list position (lp) with the lowest timestamp
+      const int lp = heap.top().second;
+      const WriteColumns &df = dfs[lp];
+      const int64_t lp_idx = indices[lp];
+
+      const int64_t msg_length = get_message_size(df.type_at(lp_idx));
+      if (i + msg_length > (int64_t) buff_size) break;
+      heap.pop();
+
+      msg_df.push_back(lp);
+      msg_row.push_back(lp_idx);
+      msg_offset.push_back(i);
+      i += msg_length;
+
+      // the next row/observation of this df, unless its end is reached
+      indices[lp]++;
+      if (indices[lp] < df.n) heap.push(HeapEntry(df.timestamp_at(indices[lp]), lp));
     }
 
-    // load the message to the buffer
-    i += load_message_to_buffer(&(buf[i]), lp_idx, df);
-
-    // update the timestamps information
-    // lp_idx was increased in load_message_to_buffer by one!
-    if (lp_idx == ts.size()) {
-      // take the max value if the end of this df is reached
-      std::memcpy(&(timestamps[lp]), &max_val, sizeof(int64_t));
-    } else {
-      std::memcpy(&(timestamps[lp]), &(ts[lp_idx]), sizeof(int64_t));
+    // encode the messages, the parse functions use no R API (except for CHAR)
+    const int64_t n_msgs = msg_df.size();
+#pragma omp parallel for num_threads(n_threads) schedule(static)
+    for (int64_t m = 0; m < n_msgs; m++) {
+      int64_t row = msg_row[m];
+      load_message_to_buffer(&buf[msg_offset[m]], row, dfs[msg_df[m]]);
     }
-    // at position lp, the index is increased by one.
-    // next loop, take the next row/observation
-    indices[lp] += 1;
-    msg_ct++;
+
+    if (!quiet) Rprintf(".");
+    writer.write(buf, i);
+    if (background) cur = 1 - cur;
+    total_bytes += i;
+    Rcpp::checkUserInterrupt();
   }
+  if (!quiet) Rprintf("\n");
 
-  if (!quiet) Rprintf("\n[Writing]    to file\n");
-  total_bytes += i;
-  // Rprintf("Write data to file '%s'\n", filename.c_str());
-  write_buffer_to_file(buf, i, filename, first_write ? append : true, gz);
-  free(buf);
+  writer.close();
 
   return total_bytes;
 }
 
+/*
+ * #############################################################################
+ * Resolving the Columns
+ * #############################################################################
+ */
+
+WriteColumns::WriteColumns(Rcpp::DataFrame df) {
+  msg_type        = str_column(df, "msg_type");
+  stock_locate    = int_column(df, "stock_locate");
+  tracking_number = int_column(df, "tracking_number");
+  timestamp       = int64_column(df, "timestamp");
+
+  // the columns of a class are resolved when its first message is found
+  n = df.nrows();
+  for (int64_t l = 0; l < n; l++) {
+    const unsigned char msg = type_at(l);
+    if (!resolved[msg]) resolve_class(df, msg);
+  }
+}
+
+// the columns of the class of the message type, as used by the parse_*_at
+// functions
+void WriteColumns::resolve_class(Rcpp::DataFrame &df, const unsigned char msg) {
+  const char * types = "";
+  switch (msg) {
+    case 'A': case 'F':
+      types = "AF";
+      order_ref = int64_column(df, "order_ref");
+      buy       = lgl_column(df, "buy");
+      shares    = int_column(df, "shares");
+      stock     = str_column(df, "stock");
+      price     = dbl_column(df, "price");
+      mpid      = str_column(df, "mpid");
+      break;
+    case 'P': case 'Q': case 'B':
+      types = "PQB";
+      order_ref    = int64_column(df, "order_ref");
+      buy          = lgl_column(df, "buy");
+      shares       = int_column(df, "shares");
+      stock        = str_column(df, "stock");
+      price        = dbl_column(df, "price");
+      match_number = int64_column(df, "match_number");
+      cross_type   = str_column(df, "cross_type");
+      break;
+    case 'E': case 'C': case 'X': case 'D': case 'U':
+      types = "ECXDU";
+      order_ref     = int64_column(df, "order_ref");
+      shares        = int_column(df, "shares");
+      match_number  = int64_column(df, "match_number");
+      printable     = lgl_column(df, "printable");
+      price         = dbl_column(df, "price");
+      new_order_ref = int64_column(df, "new_order_ref");
+      break;
+    case 'S':
+      types = "S";
+      event_code = str_column(df, "event_code");
+      break;
+    case 'R':
+      types = "R";
+      stock                = str_column(df, "stock");
+      market_category      = str_column(df, "market_category");
+      financial_status     = str_column(df, "financial_status");
+      lot_size             = int_column(df, "lot_size");
+      round_lots_only      = lgl_column(df, "round_lots_only");
+      issue_classification = str_column(df, "issue_classification");
+      issue_subtype        = str_column(df, "issue_subtype");
+      authentic            = lgl_column(df, "authentic");
+      short_sell_closeout  = lgl_column(df, "short_sell_closeout");
+      ipo_flag             = lgl_column(df, "ipo_flag");
+      luld_price_tier      = str_column(df, "luld_price_tier");
+      etp_flag             = lgl_column(df, "etp_flag");
+      etp_leverage         = int_column(df, "etp_leverage");
+      inverse              = lgl_column(df, "inverse");
+      break;
+    case 'H': case 'h':
+      types = "Hh";
+      stock            = str_column(df, "stock");
+      trading_state    = str_column(df, "trading_state");
+      reserved         = str_column(df, "reserved");
+      reason           = str_column(df, "reason");
+      market_code      = str_column(df, "market_code");
+      operation_halted = lgl_column(df, "operation_halted");
+      break;
+    case 'Y':
+      types = "Y";
+      stock         = str_column(df, "stock");
+      regsho_action = str_column(df, "regsho_action");
+      break;
+    case 'L':
+      types = "L";
+      mpid              = str_column(df, "mpid");
+      stock             = str_column(df, "stock");
+      primary_mm        = lgl_column(df, "primary_mm");
+      mm_mode           = str_column(df, "mm_mode");
+      participant_state = str_column(df, "participant_state");
+      break;
+    case 'V': case 'W':
+      types = "VW";
+      level1         = dbl_column(df, "level1");
+      level2         = dbl_column(df, "level2");
+      level3         = dbl_column(df, "level3");
+      breached_level = int_column(df, "breached_level");
+      break;
+    case 'K':
+      types = "K";
+      stock             = str_column(df, "stock");
+      release_time      = int_column(df, "release_time");
+      release_qualifier = str_column(df, "release_qualifier");
+      ipo_price         = dbl_column(df, "ipo_price");
+      break;
+    case 'J':
+      types = "J";
+      stock           = str_column(df, "stock");
+      reference_price = dbl_column(df, "reference_price");
+      upper_price     = dbl_column(df, "upper_price");
+      lower_price     = dbl_column(df, "lower_price");
+      extension       = int_column(df, "extension");
+      break;
+    case 'I':
+      types = "I";
+      paired_shares       = int64_column(df, "paired_shares");
+      imbalance_shares    = int64_column(df, "imbalance_shares");
+      imbalance_direction = str_column(df, "imbalance_direction");
+      stock               = str_column(df, "stock");
+      far_price           = dbl_column(df, "far_price");
+      near_price          = dbl_column(df, "near_price");
+      reference_price     = dbl_column(df, "reference_price");
+      cross_type          = str_column(df, "cross_type");
+      variation_indicator = str_column(df, "variation_indicator");
+      break;
+    case 'N':
+      types = "N";
+      stock         = str_column(df, "stock");
+      interest_flag = str_column(df, "interest_flag");
+      break;
+    default:
+      Rcpp::stop("Unknown message type '%c'", msg);
+      break;
+  }
+  for (const char * t = types; *t != 0; t++) resolved[(unsigned char) *t] = true;
+}
+
+// the column (coerced to the type if needed) must exist in the data.frame
+const SEXP * WriteColumns::str_column(Rcpp::DataFrame &df, const char * name) {
+  if (!df.containsElementNamed(name))
+    Rcpp::stop("Column '%s' not found in the data.frame", name);
+  Rcpp::CharacterVector v = df[name];
+  vectors.push_back(v);
+  return STRING_PTR_RO(v);
+}
+
+const int * WriteColumns::int_column(Rcpp::DataFrame &df, const char * name) {
+  if (!df.containsElementNamed(name))
+    Rcpp::stop("Column '%s' not found in the data.frame", name);
+  Rcpp::IntegerVector v = df[name];
+  vectors.push_back(v);
+  return v.begin();
+}
+
+const int * WriteColumns::lgl_column(Rcpp::DataFrame &df, const char * name) {
+  if (!df.containsElementNamed(name))
+    Rcpp::stop("Column '%s' not found in the data.frame", name);
+  Rcpp::LogicalVector v = df[name];
+  vectors.push_back(v);
+  return v.begin();
+}
+
+const double * WriteColumns::dbl_column(Rcpp::DataFrame &df, const char * name) {
+  if (!df.containsElementNamed(name))
+    Rcpp::stop("Column '%s' not found in the data.frame", name);
+  Rcpp::NumericVector v = df[name];
+  vectors.push_back(v);
+  return v.begin();
+}
+
 /*
  * #############################################################################
  * Parsing Functions
  * #############################################################################
  *
- * Each parsing function takes a buffer, an data.frame and a msg number (position)
- * and returns the number of bytes it has written to the buffer
+ * Each parsing function takes a buffer, the resolved columns of a data.frame
+ * and a msg number (position) and returns the number of bytes it has written
+ * to the buffer
  */
 
 // orders
-uint64_t parse_orders_at(unsigned char * buf, Rcpp::DataFrame df,
+uint64_t parse_orders_at(unsigned char * buf, const WriteColumns &df,
                          uint64_t msg_num) {
 
-  Rcpp::CharacterVector msg_type        = df["msg_type"];
-  Rcpp::IntegerVector   stock_locate    = df["stock_locate"];
-  Rcpp::IntegerVector   tracking_number = df["tracking_number"];
-  Rcpp::NumericVector   timestamp       = df["timestamp"];
-  Rcpp::NumericVector   order_ref       = df["order_ref"];
-  Rcpp::LogicalVector   buy             = df["buy"];
-  Rcpp::IntegerVector   shares          = df["shares"];
-  Rcpp::CharacterVector stock           = df["stock"];
-  Rcpp::NumericVector   price           = df["price"];
-  Rcpp::CharacterVector mpid            = df["mpid"];
+  const SEXP   *msg_type        = df.msg_type;
+  const int    *stock_locate    = df.stock_locate;
+  const int    *tracking_number = df.tracking_number;
+  const double *timestamp       = df.timestamp;
+  const double *order_ref       = df.order_ref;
+  const int    *buy             = df.buy;
+  const int    *shares          = df.shares;
+  const SEXP   *stock           = df.stock;
+  const double *price           = df.price;
+  const SEXP   *mpid            = df.mpid;
 
   uint64_t i = 2; // add two empty bytes at the beginning
   int64_t val64 = 0;
-  const unsigned char msg = Rcpp::as<char>(msg_type[msg_num]);
+  const unsigned char msg = CHAR(msg_type[msg_num])[0];
   buf[i++] = msg;
 
   i += set2bytes(&buf[i], stock_locate[msg_num]);
@@ -164,33 +360,33 @@ uint64_t parse_orders_at(unsigned char * buf, Rcpp::DataFrame df,
 
   buf[i++] = buy[msg_num] ? 'B' : 'S';
   i += set4bytes(&buf[i], shares[msg_num]);
-  i += setCharBytes(&buf[i], std::string(stock[msg_num]), 8);
+  i += setCharBytes(&buf[i], CHAR(stock[msg_num]), 8);
   i += set4bytes(&buf[i], (int) round(price[msg_num] * 10000));
 
-  if (msg == 'F') i += setCharBytes(&buf[i], std::string(mpid[msg_num]), 4);
+  if (msg == 'F') i += setCharBytes(&buf[i], CHAR(mpid[msg_num]), 4);
 
   return i;
 }
 
 // trades
-uint64_t parse_trades_at(unsigned char * buf, Rcpp::DataFrame df,
+uint64_t parse_trades_at(unsigned char * buf, const WriteColumns &df,
                          uint64_t msg_num) {
 
-  Rcpp::CharacterVector msg_type        = df["msg_type"];
-  Rcpp::IntegerVector   stock_locate    = df["stock_locate"];
-  Rcpp::IntegerVector   tracking_number = df["tracking_number"];
-  Rcpp::NumericVector   timestamp       = df["timestamp"];
-  Rcpp::NumericVector   order_ref       = df["order_ref"];
-  Rcpp::LogicalVector   buy             = df["buy"];
-  Rcpp::IntegerVector   shares          = df["shares"];
-  Rcpp::CharacterVector stock           = df["stock"];
-  Rcpp::NumericVector   price           = df["price"];
-  Rcpp::NumericVector   match_number    = df["match_number"];
-  Rcpp::CharacterVector cross_type      = df["cross_type"];
+  const SEXP   *msg_type        = df.msg_type;
+  const int    *stock_locate    = df.stock_locate;
+  const int    *tracking_number = df.tracking_number;
+  const double *timestamp       = df.timestamp;
+  const double *order_ref       = df.order_ref;
+  const int    *buy             = df.buy;
+  const int    *shares          = df.shares;
+  const SEXP   *stock           = df.stock;
+  const double *price           = df.price;
+  const double *match_number    = df.match_number;
+  const SEXP   *cross_type      = df.cross_type;
 
   uint64_t i = 2; // add two empty bytes at the beginning
   int64_t val64 = 0;
-  const unsigned char msg = Rcpp::as<char>(msg_type[msg_num]);
+  const unsigned char msg = CHAR(msg_type[msg_num])[0];
   buf[i++] = msg;
 
   i += set2bytes(&buf[i], stock_locate[msg_num]);
@@ -206,7 +402,7 @@ uint64_t parse_trades_at(unsigned char * buf, Rcpp::DataFrame df,
 
       buf[i++] = buy[msg_num] ? 'B' : 'S';
       i += set4bytes(&buf[i], shares[msg_num]);
-      i += setCharBytes(&buf[i], std::string(stock[msg_num]), 8);
+      i += setCharBytes(&buf[i], CHAR(stock[msg_num]), 8);
       i += set4bytes(&buf[i], (int) round(price[msg_num] * 10000.0));
 
       std::memcpy(&val64, &(match_number[msg_num]), sizeof(int64_t));
@@ -217,11 +413,11 @@ uint64_t parse_trades_at(unsigned char * buf, Rcpp::DataFrame df,
       // shares/cross-shares are usually 4 byte, but in Q its 8 byte
       val64 = (int64_t) shares[msg_num];
       i += set8bytes(&buf[i], val64);
-      i += setCharBytes(&buf[i], std::string(stock[msg_num]), 8);
+      i += setCharBytes(&buf[i], CHAR(stock[msg_num]), 8);
       i += set4bytes(&buf[i], (int) round(price[msg_num] * 10000.0));
       std::memcpy(&val64, &(match_number[msg_num]), sizeof(int64_t));
       i += set8bytes(&buf[i], val64);
-      buf[i++] = Rcpp::as<char>(cross_type[msg_num]);
+      buf[i++] = CHAR(cross_type[msg_num])[0];
       // not used: order_ref, buy
       break;
     case 'B':
@@ -238,23 +434,23 @@ uint64_t parse_trades_at(unsigned char * buf, Rcpp::DataFrame df,
 }
 
 // modifications
-uint64_t parse_modifications_at(unsigned char * buf, Rcpp::DataFrame df,
+uint64_t parse_modifications_at(unsigned char * buf, const WriteColumns &df,
                                 uint64_t msg_num) {
 
-  Rcpp::CharacterVector msg_type        = df["msg_type"];
-  Rcpp::IntegerVector   stock_locate    = df["stock_locate"];
-  Rcpp::IntegerVector   tracking_number = df["tracking_number"];
-  Rcpp::NumericVector   timestamp       = df["timestamp"];
-  Rcpp::NumericVector   order_ref       = df["order_ref"];
-  Rcpp::IntegerVector   shares          = df["shares"];
-  Rcpp::NumericVector   match_number    = df["match_number"];
-  Rcpp::LogicalVector   printable       = df["printable"];
-  Rcpp::NumericVector   price           = df["price"];
-  Rcpp::NumericVector   new_order_ref   = df["new_order_ref"];
+  const SEXP   *msg_type        = df.msg_type;
+  const int    *stock_locate    = df.stock_locate;
+  const int    *tracking_number = df.tracking_number;
+  const double *timestamp       = df.timestamp;
+  const double *order_ref       = df.order_ref;
+  const int    *shares          = df.shares;
+  const double *match_number    = df.match_number;
+  const int    *printable       = df.printable;
+  const double *price           = df.price;
+  const double *new_order_ref   = df.new_order_ref;
 
   uint64_t i = 2; // add two empty bytes at the beginning
   int64_t val64 = 0;
-  const unsigned char msg = Rcpp::as<char>(msg_type[msg_num]);
+  const unsigned char msg = CHAR(msg_type[msg_num])[0];
   buf[i++] = msg;
 
   i += set2bytes(&buf[i], stock_locate[msg_num]);
@@ -299,18 +495,18 @@ uint64_t parse_modifications_at(unsigned char * buf, Rcpp::DataFrame df,
 }
 
 // system_events
-uint64_t parse_system_events_at(unsigned char * buf, Rcpp::DataFrame df,
+uint64_t parse_system_events_at(unsigned char * buf, const WriteColumns &df,
                                 uint64_t msg_num) {
 
-  Rcpp::CharacterVector msg_type        = df["msg_type"];
-  Rcpp::IntegerVector   stock_locate    = df["stock_locate"];
-  Rcpp::IntegerVector   tracking_number = df["tracking_number"];
-  Rcpp::NumericVector   timestamp       = df["timestamp"];
-  Rcpp::CharacterVector event_code      = df["event_code"];
+  const SEXP   *msg_type        = df.msg_type;
+  const int    *stock_locate    = df.stock_locate;
+  const int    *tracking_number = df.tracking_number;
+  const double *timestamp       = df.timestamp;
+  const SEXP   *event_code      = df.event_code;
 
   uint64_t i = 2; // add two empty bytes at the beginning
   int64_t val64 = 0;
-  const unsigned char msg = Rcpp::as<char>(msg_type[msg_num]);
+  const unsigned char msg = CHAR(msg_type[msg_num])[0];
   buf[i++] = msg;
 
   i += set2bytes(&buf[i], stock_locate[msg_num]);
@@ -319,36 +515,36 @@ uint64_t parse_system_events_at(unsigned char * buf, Rcpp::DataFrame df,
   std::memcpy(&val64, &(timestamp[msg_num]), sizeof(int64_t));
   i += set6bytes(&buf[i], val64);
 
-  buf[i++] = Rcpp::as<char>(event_code[msg_num]);
+  buf[i++] = CHAR(event_code[msg_num])[0];
   return i;
 }
 
 // stock_directory
-uint64_t parse_stock_directory_at(unsigned char * buf, Rcpp::DataFrame df,
+uint64_t parse_stock_directory_at(unsigned char * buf, const WriteColumns &df,
                                   uint64_t msg_num) {
 
-  Rcpp::CharacterVector msg_type             = df["msg_type"];
-  Rcpp::IntegerVector   stock_locate         = df["stock_locate"];
-  Rcpp::IntegerVector   tracking_number      = df["tracking_number"];
-  Rcpp::NumericVector   timestamp            = df["timestamp"];
-  Rcpp::CharacterVector stock                = df["stock"];
-  Rcpp::CharacterVector market_category      = df["market_category"];
-  Rcpp::CharacterVector financial_status     = df["financial_status"];
-  Rcpp::IntegerVector   lot_size             = df["lot_size"];
-  Rcpp::LogicalVector   round_lots_only      = df["round_lots_only"];
-  Rcpp::CharacterVector issue_classification = df["issue_classification"];
-  Rcpp::CharacterVector issue_subtype        = df["issue_subtype"];
-  Rcpp::LogicalVector   authentic            = df["authentic"];
-  Rcpp::LogicalVector   short_sell_closeout  = df["short_sell_closeout"];
-  Rcpp::LogicalVector   ipo_flag             = df["ipo_flag"];
-  Rcpp::CharacterVector luld_price_tier      = df["luld_price_tier"];
-  Rcpp::LogicalVector   etp_flag             = df["etp_flag"];
-  Rcpp::IntegerVector   etp_leverage         = df["etp_leverage"];
-  Rcpp::LogicalVector   inverse              = df["inverse"];
+  const SEXP   *msg_type             = df.msg_type;
+  const int    *stock_locate         = df.stock_locate;
+  const int    *tracking_number      = df.tracking_number;
+  const double *timestamp            = df.timestamp;
+  const SEXP   *stock                = df.stock;
+  const SEXP   *market_category      = df.market_category;
+  const SEXP   *financial_status     = df.financial_status;
+  const int    *lot_size             = df.lot_size;
+  const int    *round_lots_only      = df.round_lots_only;
+  const SEXP   *issue_classification = df.issue_classification;
+  const SEXP   *issue_subtype        = df.issue_subtype;
+  const int    *authentic            = df.authentic;
+  const int    *short_sell_closeout  = df.short_sell_closeout;
+  const int    *ipo_flag             = df.ipo_flag;
+  const SEXP   *luld_price_tier      = df.luld_price_tier;
+  const int    *etp_flag             = df.etp_flag;
+  const int    *etp_leverage         = df.etp_leverage;
+  const int    *inverse              = df.inverse;
 
   uint64_t i = 2; // add two empty bytes at the beginning
   int64_t val64 = 0;
-  const unsigned char msg = Rcpp::as<char>(msg_type[msg_num]);
+  const unsigned char msg = CHAR(msg_type[msg_num])[0];
   buf[i++] = msg;
 
   i += set2bytes(&buf[i], stock_locate[msg_num]);
@@ -357,17 +553,17 @@ uint64_t parse_stock_directory_at(unsigned char * buf, Rcpp::DataFrame df,
   std::memcpy(&val64, &(timestamp[msg_num]), sizeof(int64_t));
   i += set6bytes(&buf[i], val64);
 
-  i += setCharBytes(&buf[i], std::string(stock[msg_num]), 8);
-  buf[i++] = Rcpp::as<char>(market_category[msg_num]);
-  buf[i++] = Rcpp::as<char>(financial_status[msg_num]);
+  i += setCharBytes(&buf[i], CHAR(stock[msg_num]), 8);
+  buf[i++] = CHAR(market_category[msg_num])[0];
+  buf[i++] = CHAR(financial_status[msg_num])[0];
   i += set4bytes(&buf[i], lot_size[msg_num]);
   buf[i++] = round_lots_only[msg_num] ? 'Y' : 'N';
-  buf[i++] = Rcpp::as<char>(issue_classification[msg_num]);
-  i += setCharBytes(&buf[i], std::string(issue_subtype[msg_num]), 2);
+  buf[i++] = CHAR(issue_classification[msg_num])[0];
+  i += setCharBytes(&buf[i], CHAR(issue_subtype[msg_num]), 2);
   buf[i++] = authentic[msg_num] ? 'P' : 'T';
   buf[i++] = short_sell_closeout[msg_num] == true ? 'Y' : short_sell_closeout[msg_num] == false ? 'N' : ' ';
   buf[i++] = ipo_flag[msg_num] == true ? 'Y' : ipo_flag[msg_num] == false ? 'N' : ' ';
-  buf[i++] = Rcpp::as<char>(luld_price_tier[msg_num]);
+  buf[i++] = CHAR(luld_price_tier[msg_num])[0];
   buf[i++] = etp_flag[msg_num] == true ? 'Y' : etp_flag[msg_num] == false ? 'N' : ' ';
   i += set4bytes(&buf[i], etp_leverage[msg_num]);
   buf[i++] = inverse[msg_num] ? 'Y' : 'N';
@@ -376,23 +572,23 @@ uint64_t parse_stock_directory_at(unsigned char * buf, Rcpp::DataFrame df,
 }
 
 // trading_status
-uint64_t parse_trading_status_at(unsigned char * buf, Rcpp::DataFrame df,
+uint64_t parse_trading_status_at(unsigned char * buf, const WriteColumns &df,
                                  uint64_t msg_num) {
 
-  Rcpp::CharacterVector msg_type         = df["msg_type"];
-  Rcpp::IntegerVector   stock_locate     = df["stock_locate"];
-  Rcpp::IntegerVector   tracking_number  = df["tracking_number"];
-  Rcpp::NumericVector   timestamp        = df["timestamp"];
-  Rcpp::CharacterVector stock            = df["stock"];
-  Rcpp::CharacterVector trading_state    = df["trading_state"];
-  Rcpp::CharacterVector reserved         = df["reserved"];
-  Rcpp::CharacterVector reason           = df["reason"];
-  Rcpp::CharacterVector market_code      = df["market_code"];
-  Rcpp::LogicalVector   operation_halted = df["operation_halted"];
+  const SEXP   *msg_type         = df.msg_type;
+  const int    *stock_locate     = df.stock_locate;
+  const int    *tracking_number  = df.tracking_number;
+  const double *timestamp        = df.timestamp;
+  const SEXP   *stock            = df.stock;
+  const SEXP   *trading_state    = df.trading_state;
+  const SEXP   *reserved         = df.reserved;
+  const SEXP   *reason           = df.reason;
+  const SEXP   *market_code      = df.market_code;
+  const int    *operation_halted = df.operation_halted;
 
   uint64_t i = 2; // add two empty bytes at the beginning
   int64_t val64 = 0;
-  const unsigned char msg = Rcpp::as<char>(msg_type[msg_num]);
+  const unsigned char msg = CHAR(msg_type[msg_num])[0];
   buf[i++] = msg;
 
   i += set2bytes(&buf[i], stock_locate[msg_num]);
@@ -401,16 +597,16 @@ uint64_t parse_trading_status_at(unsigned char * buf, Rcpp::DataFrame df,
   std::memcpy(&val64, &(timestamp[msg_num]), sizeof(int64_t));
   i += set6bytes(&buf[i], val64);
 
-  i += setCharBytes(&buf[i], std::string(stock[msg_num]), 8);
+  i += setCharBytes(&buf[i], CHAR(stock[msg_num]), 8);
 
   switch (msg) {
     case 'H':
-      buf[i++] = Rcpp::as<char>(trading_state[msg_num]);
-      buf[i++] = Rcpp::as<char>(reserved[msg_num]);
-      i += setCharBytes(&buf[i], std::string(reason[msg_num]), 4);
+      buf[i++] = CHAR(trading_state[msg_num])[0];
+      buf[i++] = CHAR(reserved[msg_num])[0];
+      i += setCharBytes(&buf[i], CHAR(reason[msg_num]), 4);
       break;
     case 'h':
-      buf[i++] = Rcpp::as<char>(market_code[msg_num]);
+      buf[i++] = CHAR(market_code[msg_num])[0];
       buf[i++] = operation_halted[msg_num] ? 'H' : 'T';
       break;
     default:
@@ -422,19 +618,19 @@ uint64_t parse_trading_status_at(unsigned char * buf, Rcpp::DataFrame df,
 }
 
 // reg_sho
-uint64_t parse_reg_sho_at(unsigned char * buf, Rcpp::DataFrame df,
+uint64_t parse_reg_sho_at(unsigned char * buf, const WriteColumns &df,
                           uint64_t msg_num) {
 
-  Rcpp::CharacterVector msg_type        = df["msg_type"];
-  Rcpp::IntegerVector   stock_locate    = df["stock_locate"];
-  Rcpp::IntegerVector   tracking_number = df["tracking_number"];
-  Rcpp::NumericVector   timestamp       = df["timestamp"];
-  Rcpp::CharacterVector stock           = df["stock"];
-  Rcpp::CharacterVector regsho_action   = df["regsho_action"];
+  const SEXP   *msg_type        = df.msg_type;
+  const int    *stock_locate    = df.stock_locate;
+  const int    *tracking_number = df.tracking_number;
+  const double *timestamp       = df.timestamp;
+  const SEXP   *stock           = df.stock;
+  const SEXP   *regsho_action   = df.regsho_action;
 
   uint64_t i = 2; // add two empty bytes at the beginning
   int64_t val64 = 0;
-  const unsigned char msg = Rcpp::as<char>(msg_type[msg_num]);
+  const unsigned char msg = CHAR(msg_type[msg_num])[0];
   buf[i++] = msg;
 
   i += set2bytes(&buf[i], stock_locate[msg_num]);
@@ -442,29 +638,29 @@ uint64_t parse_reg_sho_at(unsigned char * buf, Rcpp::DataFrame df,
 
   std::memcpy(&val64, &(timestamp[msg_num]), sizeof(int64_t));
   i += set6bytes(&buf[i], val64);
-  i += setCharBytes(&buf[i], std::string(stock[msg_num]), 8);
-  buf[i++] = Rcpp::as<char>(regsho_action[msg_num]);
+  i += setCharBytes(&buf[i], CHAR(stock[msg_num]), 8);
+  buf[i++] = CHAR(regsho_action[msg_num])[0];
 
   return i;
 }
 
 // market_participants_states
-uint64_t parse_market_participants_states_at(unsigned char * buf, Rcpp::DataFrame df,
+uint64_t parse_market_participants_states_at(unsigned char * buf, const WriteColumns &df,
                                              uint64_t msg_num) {
 
-  Rcpp::CharacterVector msg_type          = df["msg_type"];
-  Rcpp::IntegerVector   stock_locate      = df["stock_locate"];
-  Rcpp::IntegerVector   tracking_number   = df["tracking_number"];
-  Rcpp::NumericVector   timestamp         = df["timestamp"];
-  Rcpp::CharacterVector mpid              = df["mpid"];
-  Rcpp::CharacterVector stock             = df["stock"];
-  Rcpp::LogicalVector   primary_mm        = df["primary_mm"];
-  Rcpp::CharacterVector mm_mode           = df["mm_mode"];
-  Rcpp::CharacterVector participant_state = df["participant_state"];
+  const SEXP   *msg_type          = df.msg_type;
+  const int    *stock_locate      = df.stock_locate;
+  const int    *tracking_number   = df.tracking_number;
+  const double *timestamp         = df.timestamp;
+  const SEXP   *mpid              = df.mpid;
+  const SEXP   *stock             = df.stock;
+  const int    *primary_mm        = df.primary_mm;
+  const SEXP   *mm_mode           = df.mm_mode;
+  const SEXP   *participant_state = df.participant_state;
 
   uint64_t i = 2; // add two empty bytes at the beginning
   int64_t val64 = 0;
-  const unsigned char msg = Rcpp::as<char>(msg_type[msg_num]);
+  const unsigned char msg = CHAR(msg_type[msg_num])[0];
   buf[i++] = msg;
 
   i += set2bytes(&buf[i], stock_locate[msg_num]);
@@ -472,31 +668,31 @@ uint64_t parse_market_participants_states_at(unsigned char * buf, Rcpp::DataFram
 
   std::memcpy(&val64, &(timestamp[msg_num]), sizeof(int64_t));
   i += set6bytes(&buf[i], val64);
-  i += setCharBytes(&buf[i], std::string(mpid[msg_num]), 4);
-  i += setCharBytes(&buf[i], std::string(stock[msg_num]), 8);
+  i += setCharBytes(&buf[i], CHAR(mpid[msg_num]), 4);
+  i += setCharBytes(&buf[i], CHAR(stock[msg_num]), 8);
   buf[i++] = primary_mm[msg_num] ? 'Y' : 'N';
-  buf[i++] = Rcpp::as<char>(mm_mode[msg_num]);
-  buf[i++] = Rcpp::as<char>(participant_state[msg_num]);
+  buf[i++] = CHAR(mm_mode[msg_num])[0];
+  buf[i++] = CHAR(participant_state[msg_num])[0];
 
   return i;
 }
 
 // mwcb
-uint64_t parse_mwcb_at(unsigned char * buf, Rcpp::DataFrame df,
+uint64_t parse_mwcb_at(unsigned char * buf, const WriteColumns &df,
                        uint64_t msg_num) {
 
-  Rcpp::CharacterVector msg_type        = df["msg_type"];
-  Rcpp::IntegerVector   stock_locate    = df["stock_locate"];
-  Rcpp::IntegerVector   tracking_number = df["tracking_number"];
-  Rcpp::NumericVector   timestamp       = df["timestamp"];
-  Rcpp::NumericVector   level1          = df["level1"];
-  Rcpp::NumericVector   level2          = df["level2"];
-  Rcpp::NumericVector   level3          = df["level3"];
-  Rcpp::IntegerVector   breached_level  = df["breached_level"];
+  const SEXP   *msg_type        = df.msg_type;
+  const int    *stock_locate    = df.stock_locate;
+  const int    *tracking_number = df.tracking_number;
+  const double *timestamp       = df.timestamp;
+  const double *level1          = df.level1;
+  const double *level2          = df.level2;
+  const double *level3          = df.level3;
+  const int    *breached_level  = df.breached_level;
 
   uint64_t i = 2; // add two empty bytes at the beginning
   int64_t val64 = 0;
-  const unsigned char msg = Rcpp::as<char>(msg_type[msg_num]);
+  const unsigned char msg = CHAR(msg_type[msg_num])[0];
   buf[i++] = msg;
 
   i += set2bytes(&buf[i], stock_locate[msg_num]);
@@ -523,21 +719,21 @@ uint64_t parse_mwcb_at(unsigned char * buf, Rcpp::DataFrame df,
 }
 
 // ipo
-uint64_t parse_ipo_at(unsigned char * buf, Rcpp::DataFrame df,
+uint64_t parse_ipo_at(unsigned char * buf, const WriteColumns &df,
                       uint64_t msg_num) {
 
-  Rcpp::CharacterVector msg_type          = df["msg_type"];
-  Rcpp::IntegerVector   stock_locate      = df["stock_locate"];
-  Rcpp::IntegerVector   tracking_number   = df["tracking_number"];
-  Rcpp::NumericVector   timestamp         = df["timestamp"];
-  Rcpp::CharacterVector stock             = df["stock"];
-  Rcpp::IntegerVector   release_time      = df["release_time"];
-  Rcpp::CharacterVector release_qualifier = df["release_qualifier"];
-  Rcpp::NumericVector   ipo_price         = df["ipo_price"];
+  const SEXP   *msg_type          = df.msg_type;
+  const int    *stock_locate      = df.stock_locate;
+  const int    *tracking_number   = df.tracking_number;
+  const double *timestamp         = df.timestamp;
+  const SEXP   *stock             = df.stock;
+  const int    *release_time      = df.release_time;
+  const SEXP   *release_qualifier = df.release_qualifier;
+  const double *ipo_price         = df.ipo_price;
 
   uint64_t i = 2; // add two empty bytes at the beginning
   int64_t val64 = 0;
-  const unsigned char msg = Rcpp::as<char>(msg_type[msg_num]);
+  const unsigned char msg = CHAR(msg_type[msg_num])[0];
   buf[i++] = msg;
 
   i += set2bytes(&buf[i], stock_locate[msg_num]);
@@ -545,31 +741,31 @@ uint64_t parse_ipo_at(unsigned char * buf, Rcpp::DataFrame df,
 
   std::memcpy(&val64, &(timestamp[msg_num]), sizeof(int64_t));
   i += set6bytes(&buf[i], val64);
-  i += setCharBytes(&buf[i], std::string(stock[msg_num]), 8);
+  i += setCharBytes(&buf[i], CHAR(stock[msg_num]), 8);
   i += set4bytes(&buf[i], release_time[msg_num]);
-  buf[i++] = Rcpp::as<char>(release_qualifier[msg_num]);
+  buf[i++] = CHAR(release_qualifier[msg_num])[0];
   i += set4bytes(&buf[i], (int) round(ipo_price[msg_num] * 10000.0));
 
   return i;
 }
 
 // luld
-uint64_t parse_luld_at(unsigned char * buf, Rcpp::DataFrame df,
+uint64_t parse_luld_at(unsigned char * buf, const WriteColumns &df,
                        uint64_t msg_num) {
 
-  Rcpp::CharacterVector msg_type        = df["msg_type"];
-  Rcpp::IntegerVector   stock_locate    = df["stock_locate"];
-  Rcpp::IntegerVector   tracking_number = df["tracking_number"];
-  Rcpp::NumericVector   timestamp       = df["timestamp"];
-  Rcpp::CharacterVector stock           = df["stock"];
-  Rcpp::NumericVector   reference_price = df["reference_price"];
-  Rcpp::NumericVector   upper_price     = df["upper_price"];
-  Rcpp::NumericVector   lower_price     = df["lower_price"];
-  Rcpp::IntegerVector   extension       = df["extension"];
+  const SEXP   *msg_type        = df.msg_type;
+  const int    *stock_locate    = df.stock_locate;
+  const int    *tracking_number = df.tracking_number;
+  const double *timestamp       = df.timestamp;
+  const SEXP   *stock           = df.stock;
+  const double *reference_price = df.reference_price;
+  const double *upper_price     = df.upper_price;
+  const double *lower_price     = df.lower_price;
+  const int    *extension       = df.extension;
 
   uint64_t i = 2; // add two empty bytes at the beginning
   int64_t val64 = 0;
-  const unsigned char msg = Rcpp::as<char>(msg_type[msg_num]);
+  const unsigned char msg = CHAR(msg_type[msg_num])[0];
   buf[i++] = msg;
 
   i += set2bytes(&buf[i], stock_locate[msg_num]);
@@ -578,7 +774,7 @@ uint64_t parse_luld_at(unsigned char * buf, Rcpp::DataFrame df,
   std::memcpy(&val64, &(timestamp[msg_num]), sizeof(int64_t));
   i += set6bytes(&buf[i], val64);
 
-  i += setCharBytes(&buf[i], std::string(stock[msg_num]), 8);
+  i += setCharBytes(&buf[i], CHAR(stock[msg_num]), 8);
   i += set4bytes(&buf[i], (int) round(reference_price[msg_num] * 10000.0));
   i += set4bytes(&buf[i], (int) round(upper_price[msg_num] * 10000.0));
   i += set4bytes(&buf[i], (int) round(lower_price[msg_num] * 10000.0));
@@ -588,26 +784,26 @@ uint64_t parse_luld_at(unsigned char * buf, Rcpp::DataFrame df,
 }
 
 // noii
-uint64_t parse_noii_at(unsigned char * buf, Rcpp::DataFrame df,
+uint64_t parse_noii_at(unsigned char * buf, const WriteColumns &df,
                        uint64_t msg_num) {
 
-  Rcpp::CharacterVector msg_type            = df["msg_type"];
-  Rcpp::IntegerVector   stock_locate        = df["stock_locate"];
-  Rcpp::IntegerVector   tracking_number     = df["tracking_number"];
-  Rcpp::NumericVector   timestamp           = df["timestamp"];
-  Rcpp::NumericVector   paired_shares       = df["paired_shares"];
-  Rcpp::NumericVector   imbalance_shares    = df["imbalance_shares"];
-  Rcpp::CharacterVector imbalance_direction = df["imbalance_direction"];
-  Rcpp::CharacterVector stock               = df["stock"];
-  Rcpp::NumericVector   far_price           = df["far_price"];
-  Rcpp::NumericVector   near_price          = df["near_price"];
-  Rcpp::NumericVector   reference_price     = df["reference_price"];
-  Rcpp::CharacterVector cross_type          = df["cross_type"];
-  Rcpp::CharacterVector variation_indicator = df["variation_indicator"];
+  const SEXP   *msg_type            = df.msg_type;
+  const int    *stock_locate        = df.stock_locate;
+  const int    *tracking_number     = df.tracking_number;
+  const double *timestamp           = df.timestamp;
+  const double *paired_shares       = df.paired_shares;
+  const double *imbalance_shares    = df.imbalance_shares;
+  const SEXP   *imbalance_direction = df.imbalance_direction;
+  const SEXP   *stock               = df.stock;
+  const double *far_price           = df.far_price;
+  const double *near_price          = df.near_price;
+  const double *reference_price     = df.reference_price;
+  const SEXP   *cross_type          = df.cross_type;
+  const SEXP   *variation_indicator = df.variation_indicator;
 
   uint64_t i = 2; // add two empty bytes at the beginning
   int64_t val64 = 0;
-  const unsigned char msg = Rcpp::as<char>(msg_type[msg_num]);
+  const unsigned char msg = CHAR(msg_type[msg_num])[0];
   buf[i++] = msg;
 
   i += set2bytes(&buf[i], stock_locate[msg_num]);
@@ -620,31 +816,31 @@ uint64_t parse_noii_at(unsigned char * buf, Rcpp::DataFrame df,
   i += set8bytes(&buf[i], val64);
   std::memcpy(&val64, &(imbalance_shares[msg_num]), sizeof(int64_t));
   i += set8bytes(&buf[i], val64);
-  buf[i++] = Rcpp::as<char>(imbalance_direction[msg_num]);
-  i += setCharBytes(&buf[i], std::string(stock[msg_num]), 8);
+  buf[i++] = CHAR(imbalance_direction[msg_num])[0];
+  i += setCharBytes(&buf[i], CHAR(stock[msg_num]), 8);
   i += set4bytes(&buf[i], (int) round(far_price[msg_num] * 10000.0));
   i += set4bytes(&buf[i], (int) round(near_price[msg_num] * 10000.0));
   i += set4bytes(&buf[i], (int) round(reference_price[msg_num] * 10000.0));
-  buf[i++] = Rcpp::as<char>(cross_type[msg_num]);
-  buf[i++] = Rcpp::as<char>(variation_indicator[msg_num]);
+  buf[i++] = CHAR(cross_type[msg_num])[0];
+  buf[i++] = CHAR(variation_indicator[msg_num])[0];
 
   return i;
 }
 
 // rpii
-uint64_t parse_rpii_at(unsigned char * buf, Rcpp::DataFrame df,
+uint64_t parse_rpii_at(unsigned char * buf, const WriteColumns &df,
                        uint64_t msg_num) {
 
-  Rcpp::CharacterVector msg_type        = df["msg_type"];
-  Rcpp::IntegerVector   stock_locate    = df["stock_locate"];
-  Rcpp::IntegerVector   tracking_number = df["tracking_number"];
-  Rcpp::NumericVector   timestamp       = df["timestamp"];
-  Rcpp::CharacterVector stock           = df["stock"];
-  Rcpp::CharacterVector interest_flag   = df["interest_flag"];
+  const SEXP   *msg_type        = df.msg_type;
+  const int    *stock_locate    = df.stock_locate;
+  const int    *tracking_number = df.tracking_number;
+  const double *timestamp       = df.timestamp;
+  const SEXP   *stock           = df.stock;
+  const SEXP   *interest_flag   = df.interest_flag;
 
   uint64_t i = 2; // add two empty bytes at the beginning
   int64_t val64 = 0;
-  const unsigned char msg = Rcpp::as<char>(msg_type[msg_num]);
+  const unsigned char msg = CHAR(msg_type[msg_num])[0];
   buf[i++] = msg;
 
   i += set2bytes(&buf[i], stock_locate[msg_num]);
@@ -652,8 +848,8 @@ uint64_t parse_rpii_at(unsigned char * buf, Rcpp::DataFrame df,
 
   std::memcpy(&val64, &(timestamp[msg_num]), sizeof(int64_t));
   i += set6bytes(&buf[i], val64);
-  i += setCharBytes(&buf[i], std::string(stock[msg_num]), 8);
-  buf[i++] = Rcpp::as<char>(interest_flag[msg_num]);
+  i += setCharBytes(&buf[i], CHAR(stock[msg_num]), 8);
+  buf[i++] = CHAR(interest_flag[msg_num])[0];
 
   return i;
 }
@@ -661,10 +857,12 @@ uint64_t parse_rpii_at(unsigned char * buf, Rcpp::DataFrame df,
 // loads from df at position msg_ct one message into the buffer
 // returns the number of bytes written to the buffer
 int64_t load_message_to_buffer(unsigned char * buf, int64_t &msg_ct,
-                               Rcpp::DataFrame df) {
+                               const WriteColumns &df) {
   int64_t i = 0;
-  Rcpp::CharacterVector vec = df["msg_type"];
-  const unsigned char msg = Rcpp::as<char>(vec[0]);
+  // the two leading bytes of a message are empty
+  buf[0] = 0;
+  buf[1] = 0;
+  const unsigned char msg = df.type_at(msg_ct);
   switch (msg) {
     case 'A': case 'F':
       // orders
@@ -728,35 +926,71 @@ int64_t load_message_to_buffer(unsigned char * buf, int64_t &msg_ct,
   return i;
 }
 
-// returns the index at which the min value sits in the index
-int get_min_val_pos(std::vector<int64_t> &x) {
-  const auto min_el = std::min_element(x.begin(), x.end());
-  return std::distance(x.begin(), min_el);
+/*
+ * #############################################################################
+ * Output Stream
+ * #############################################################################
+ */
+
+ItchWriter::ItchWriter(std::string filename, bool append, bool gz,
+                       int compression_level, bool background) :
+  gz(gz), background(background) {
+  std::string mode = append ? "ab" : "wb";
+  if (gz && compression_level >= 0 && compression_level <= 9)
+    mode += std::to_string(compression_level);
+
+  if (gz) {
+    gzfile = gzopen(filename.c_str(), mode.c_str());
+  } else {
+    file = fopen(filename.c_str(), mode.c_str());
+  }
+  if (file == NULL && gzfile == NULL) {
+    char buffer [50];
+    snprintf(buffer, sizeof(buffer), "File Error number %i!", errno);
+    Rcpp::stop(buffer);
+  }
 }
 
-void write_buffer_to_file(unsigned char* buf, int64_t size,
-                          std::string filename, bool append, bool gz) {
-  char mode[] = "wb";// append ? "ab" : "wb";
-  if (append) mode[0] = 'a';
-
-  if (!gz) {
-    FILE* outfile;
-    outfile = fopen(filename.c_str(), mode);
-    if (outfile == NULL) {
-      char buffer [50];
-      snprintf(buffer, sizeof(buffer), "File Error number %i!", errno);
-      Rcpp::stop(buffer);
-    }
-    fwrite(&buf[0], 1, size, outfile);
-    fclose(outfile);
+ItchWriter::~ItchWriter() {
+  wait();
+  if (file != NULL) fclose(file);
+  if (gzfile != NULL) gzclose(gzfile);
+}
+
+void ItchWriter::write(const unsigned char * buf, int64_t size) {
+  wait();
+  if (failed) Rcpp::stop("Could not write to the file");
+  if (background) {
+    thread = std::thread(&ItchWriter::write_now, this, buf, size);
   } else {
-    gzFile gzfile = gzopen(filename.c_str(), mode);
-    if (gzfile == NULL) {
-      char buffer [50];
-      snprintf(buffer, sizeof(buffer), "File Error number %i!", errno);
-      Rcpp::stop(buffer);
+    write_now(buf, size);
+  }
+}
+
+void ItchWriter::close() {
+  wait();
+  int res = 0;
+  if (file != NULL) res = fclose(file);
+  if (gzfile != NULL) res = gzclose(gzfile);
+  file = NULL;
+  gzfile = NULL;
+  if (failed || res != 0) Rcpp::stop("Could not write to the file");
+}
+
+void ItchWriter::wait() {
+  if (thread.joinable()) thread.join();
+}
+
+// gzwrite takes at most an unsigned int, larger buffers are written in parts
+void ItchWriter::write_now(const unsigned char * buf, int64_t size) {
+  const int64_t max_part = 1 << 30;
+  for (int64_t pos = 0; pos < size; pos += max_part) {
+    const int64_t n = std::min(max_part, size - pos);
+    const int64_t written = gz ? (int64_t) gzwrite(gzfile, &buf[pos], n) :
+      (int64_t) fwrite(&buf[pos], 1, n, file);
+    if (written != n) {
+      failed = true;
+      return;
     }
-    gzwrite(gzfile, &buf[0], size);
-    gzclose(gzfile);
   }
 }
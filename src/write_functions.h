@@ -3,39 +3,141 @@
 
 #include <zlib.h>
 #include <Rcpp.h>
+#include <queue>
+#include <thread>
 #include "specifications.h"
 #include "helper_functions.h"
 
+/*
+ * WriteColumns, the columns of a data.frame of ITCH messages resolved once to
+ *   raw pointers, so that the messages can be written without looking up the
+ *   columns by their name for every row.
+ *
+ * Only the columns of the message classes found in the msg_type column are
+ *   resolved (a data.frame may hold several classes, e.g., orders and trades),
+ *   all others are NULL. A missing column or an unknown message type throws
+ *   an error when the data.frame is resolved.
+ * Strings point to the CHARSXPs of the character vectors, 64 bit integers
+ *   (integer64) to the doubles holding their bits.
+ */
+class WriteColumns {
+public:
+  explicit WriteColumns(Rcpp::DataFrame df);
+
+  int64_t n = 0;
+
+  const SEXP *msg_type = NULL, *stock = NULL, *mpid = NULL,
+    *cross_type = NULL, *event_code = NULL, *market_category = NULL,
+    *financial_status = NULL, *issue_classification = NULL,
+    *issue_subtype = NULL, *luld_price_tier = NULL, *trading_state = NULL,
+    *reserved = NULL, *reason = NULL, *market_code = NULL,
+    *regsho_action = NULL, *mm_mode = NULL, *participant_state = NULL,
+    *release_qualifier = NULL, *imbalance_direction = NULL,
+    *variation_indicator = NULL, *interest_flag = NULL;
+
+  const int *stock_locate = NULL, *tracking_number = NULL, *shares = NULL,
+    *lot_size = NULL, *etp_leverage = NULL, *breached_level = NULL,
+    *release_time = NULL, *extension = NULL;
+
+  // logicals
+  const int *buy = NULL, *printable = NULL, *round_lots_only = NULL,
+    *authentic = NULL, *short_sell_closeout = NULL, *ipo_flag = NULL,
+    *etp_flag = NULL, *inverse = NULL, *operation_halted = NULL,
+    *primary_mm = NULL;
+
+  const double *price = NULL, *level1 = NULL, *level2 = NULL, *level3 = NULL,
+    *ipo_price = NULL, *reference_price = NULL, *upper_price = NULL,
+    *lower_price = NULL, *far_price = NULL, *near_price = NULL;
+
+  // integer64
+  const double *timestamp = NULL, *order_ref = NULL, *match_number = NULL,
+    *new_order_ref = NULL, *paired_shares = NULL, *imbalance_shares = NULL;
+
+  unsigned char type_at(int64_t i) const { return CHAR(msg_type[i])[0]; }
+  int64_t timestamp_at(int64_t i) const {
+    int64_t val64;
+    std::memcpy(&val64, &timestamp[i], sizeof(int64_t));
+    return val64;
+  }
+
+private:
+  // the (coerced) vectors, which keeps them protected
+  Rcpp::List vectors;
+  // the message types whose class is resolved
+  bool resolved[256] = {};
+
+  void resolve_class(Rcpp::DataFrame &df, const unsigned char msg);
+
+  const SEXP * str_column(Rcpp::DataFrame &df, const char * name);
+  const int * int_column(Rcpp::DataFrame &df, const char * name);
+  const int * lgl_column(Rcpp::DataFrame &df, const char * name);
+  const double * dbl_column(Rcpp::DataFrame &df, const char * name);
+  const double * int64_column(Rcpp::DataFrame &df, const char * name) {
+    return dbl_column(df, name);
+  }
+};
 
 // parse specific messages into a buffer
-uint64_t parse_orders_at(unsigned char * buf, Rcpp::DataFrame df, uint64_t msg_num);
-uint64_t parse_trades_at(unsigned char * buf, Rcpp::DataFrame df, uint64_t msg_num);
-uint64_t parse_modifications_at(unsigned char * buf, Rcpp::DataFrame df, uint64_t msg_num);
-uint64_t parse_system_events_at(unsigned char * buf, Rcpp::DataFrame df, uint64_t msg_num);
-uint64_t parse_stock_directory_at(unsigned char * buf, Rcpp::DataFrame df, uint64_t msg_num);
-uint64_t parse_trading_status_at(unsigned char * buf, Rcpp::DataFrame df, uint64_t msg_num);
-uint64_t parse_reg_sho_at(unsigned char * buf, Rcpp::DataFrame df, uint64_t msg_num);
-uint64_t parse_market_participants_states_at(unsigned char * buf, Rcpp::DataFrame df, uint64_t msg_num);
-uint64_t parse_mwcb_at(unsigned char * buf, Rcpp::DataFrame df, uint64_t msg_num);
-uint64_t parse_ipo_at(unsigned char * buf, Rcpp::DataFrame df, uint64_t msg_num);
-uint64_t parse_luld_at(unsigned char * buf, Rcpp::DataFrame df, uint64_t msg_num);
-uint64_t parse_noii_at(unsigned char * buf, Rcpp::DataFrame df, uint64_t msg_num);
-uint64_t parse_rpii_at(unsigned char * buf, Rcpp::DataFrame df, uint64_t msg_num);
+uint64_t parse_orders_at(unsigned char * buf, const WriteColumns &df, uint64_t msg_num);
+uint64_t parse_trades_at(unsigned char * buf, const WriteColumns &df, uint64_t msg_num);
+uint64_t parse_modifications_at(unsigned char * buf, const WriteColumns &df, uint64_t msg_num);
+uint64_t parse_system_events_at(unsigned char * buf, const WriteColumns &df, uint64_t msg_num);
+uint64_t parse_stock_directory_at(unsigned char * buf, const WriteColumns &df, uint64_t msg_num);
+uint64_t parse_trading_status_at(unsigned char * buf, const WriteColumns &df, uint64_t msg_num);
+uint64_t parse_reg_sho_at(unsigned char * buf, const WriteColumns &df, uint64_t msg_num);
+uint64_t parse_market_participants_states_at(unsigned char * buf, const WriteColumns &df, uint64_t msg_num);
+uint64_t parse_mwcb_at(unsigned char * buf, const WriteColumns &df, uint64_t msg_num);
+uint64_t parse_ipo_at(unsigned char * buf, const WriteColumns &df, uint64_t msg_num);
+uint64_t parse_luld_at(unsigned char * buf, const WriteColumns &df, uint64_t msg_num);
+uint64_t parse_noii_at(unsigned char * buf, const WriteColumns &df, uint64_t msg_num);
+uint64_t parse_rpii_at(unsigned char * buf, const WriteColumns &df, uint64_t msg_num);
 
 // loads a data.frame at a position into a buffer
-int64_t load_message_to_buffer(unsigned char * buf, int64_t &msg_ct, Rcpp::DataFrame df);
+int64_t load_message_to_buffer(unsigned char * buf, int64_t &msg_ct,
+                               const WriteColumns &df);
+
+/*
+ * ItchWriter, the output stream of a file (plain or gz) that is kept open for
+ *   all buffers of a write, i.e., a gz file is one gzip member and the
+ *   compression continues over the buffers.
+ *
+ * In the background mode, a buffer is written by a thread and write() returns
+ *   immediately, so that the next buffer can be encoded meanwhile. The buffer
+ *   must then not be changed until the next call of write() or close().
+ *   The thread uses no R functions, an error is reported by the next write()
+ *   or close().
+ */
+class ItchWriter {
+public:
+  ItchWriter(std::string filename, bool append = false, bool gz = false,
+             int compression_level = -1, bool background = false);
+  ~ItchWriter();
+  ItchWriter(const ItchWriter&) = delete;
+  ItchWriter& operator=(const ItchWriter&) = delete;
+
+  // writes the first size bytes of buf to the file
+  void write(const unsigned char * buf, int64_t size);
+  // waits for the last buffer and closes the file
+  void close();
 
-// returns the index at which the values are minimum
-int get_min_val_pos(std::vector<int64_t> &x);
+private:
+  const bool gz, background;
+  FILE * file = NULL;
+  gzFile gzfile = NULL;
+  std::thread thread;
+  bool failed = false;
 
-// writes a buffer to file
-void write_buffer_to_file(unsigned char* buf, int64_t size, std::string filename,
-                          bool append = false, bool gz = false);
+  void wait();
+  void write_now(const unsigned char * buf, int64_t size);
+};
 
 // Writes a list of data.frames (already sorted by timestamp)
-// to a file, if specified, the file is a gz.file
+// to a file, if specified, the file is a gz.file. The messages of a buffer are
+// encoded with n_threads threads
 int64_t write_itch_impl(Rcpp::List ll, std::string filename,
                         bool append = false, bool gz = false,
-                        size_t max_buffer_size = 1e9, bool quiet = false);
+                        size_t max_buffer_size = 1e9, bool quiet = false,
+                        int n_threads = 1, int compression_level = -1,
+                        bool background = false);
 
-#endif // WRITEFUNCTIONS_H
\ No newline at end of file
+#endif // WRITEFUNCTIONS_H